@@ -265,6 +265,8 @@ CREATE TABLE IF NOT EXISTS KillStatistics (
 	PRIMARY KEY (WorldID, RaceName)
 );
 
+-- NOTE(fusion): Online lists are kept in memory by the query manager so this
+-- table is no longer written. It's only kept around for existing databases.
 CREATE TABLE IF NOT EXISTS OnlineCharacters (
 	WorldID INTEGER NOT NULL,
 	Name TEXT NOT NULL COLLATE NOCASE,
@@ -0,0 +1,16 @@
+-- NOTE(fusion): Kill statistics by time period, so the website can show kills
+-- over the last day, week, or month. New statistics go into hourly buckets,
+-- which the query manager rolls up into daily and then monthly buckets as they
+-- get older. `Period` is 0 for hours, 1 for days, and 2 for months, and
+-- `PeriodStart` is the UTC start of the bucket.
+CREATE TABLE IF NOT EXISTS KillStatisticsHistory (
+	WorldID INTEGER NOT NULL,
+	Period INTEGER NOT NULL,
+	PeriodStart INTEGER NOT NULL,
+	RaceName TEXT NOT NULL COLLATE NOCASE,
+	TimesKilled INTEGER NOT NULL,
+	PlayersKilled INTEGER NOT NULL,
+	PRIMARY KEY (WorldID, Period, PeriodStart, RaceName)
+);
+CREATE INDEX IF NOT EXISTS KillStatisticsHistoryPeriodIndex
+		ON KillStatisticsHistory(Period, PeriodStart);
@@ -0,0 +1,6 @@
+-- NOTE(fusion): Covers the query manager's highscore load, which reads every
+-- character that isn't deleted in rank order (`WorldID`, then `Level` highest
+-- first, then `Name`). `CharacterID` is the rowid and is already part of every
+-- index entry, so the table itself is never touched.
+CREATE INDEX IF NOT EXISTS CharactersHighscoreIndex
+		ON Characters(WorldID, Level DESC, Name, Profession) WHERE Deleted = 0;
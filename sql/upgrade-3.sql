@@ -0,0 +1,15 @@
+-- NOTE(fusion): Indexes for hot statements that were sorting with a temporary
+-- b-tree or going to the table for columns the index didn't have.
+--	Game servers page through a world's characters in id order when loading the
+-- player index, which now comes straight from the index without a sort or any
+-- table lookups.
+CREATE INDEX IF NOT EXISTS CharactersWorldCharacterIndex
+		ON Characters(WorldID, CharacterID, Name);
+
+--	Account character lists are loaded as whole rows for the record cache, so
+-- they can't be covered, but they're ordered by id, which is now the index
+-- order. Online character counts only look at `IsOnline` which is still in the
+-- index so they're still covered.
+DROP INDEX IF EXISTS CharactersAccountIndex;
+CREATE INDEX IF NOT EXISTS CharactersAccountIndex
+		ON Characters(AccountID, CharacterID, IsOnline);
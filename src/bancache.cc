@@ -0,0 +1,268 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): Active account and IP address banishments are kept in memory
+// so login checks don't need to touch the database. Each table is a simple open
+// addressing hash table keyed by account id or IP address, with the time the
+// banishment expires, or `INT_MAX` for permanent banishments. Expired entries
+// are just ignored by lookups and dropped whenever the table is rebuilt.
+//	Both tables are loaded from the database at startup and reloaded whenever
+// the database's `data_version` changes (e.g. when a banishment is lifted from
+// the sqlite shell). Banishments inserted by us are added as they're inserted,
+// and the previous expire time of each entry they touch is kept in a small undo
+// log so they can be reverted if the transaction that inserted them is rolled
+// back.
+#define BAN_CACHE_MAX_UNDO 16
+
+struct TBanEntry{
+	int Key;
+	int Until;
+};
+
+struct TBanTable{
+	int NumEntries;
+	int Capacity;
+	TBanEntry *Entries;
+};
+
+struct TBanUndoEntry{
+	TBanTable *Table;
+	int Key;
+	int Until;
+};
+
+static TBanTable g_AccountBans;
+static TBanTable g_IPAddressBans;
+static TBanUndoEntry g_BanUndo[BAN_CACHE_MAX_UNDO];
+static int g_NumBanUndo;
+static int g_BanCacheDataVersion;
+static bool g_BanCacheLoaded;
+
+static int GetUnixTime(void){
+	return (int)time(NULL);
+}
+
+static int BanExpireTime(int Issued, int Until){
+	// NOTE(fusion): Same as `(Until = Issued OR Until > UNIXEPOCH())`.
+	return (Until == Issued ? INT_MAX : Until);
+}
+
+static uint32 HashBanKey(int Key){
+	uint32 Hash = (uint32)Key * 0x9E3779B1U;
+	return Hash ^ (Hash >> 16);
+}
+
+static void ClearBanTable(TBanTable *Table){
+	free(Table->Entries);
+	memset(Table, 0, sizeof(TBanTable));
+}
+
+static void LinkBanEntry(TBanTable *Table, int Key, int Until){
+	ASSERT(Table->Capacity > 0 && Table->NumEntries < Table->Capacity);
+	int Mask = Table->Capacity - 1;
+	int Index = (int)(HashBanKey(Key) & (uint32)Mask);
+	while(true){
+		TBanEntry *Entry = &Table->Entries[Index];
+		if(Entry->Until == 0){
+			Entry->Key = Key;
+			Entry->Until = Until;
+			Table->NumEntries += 1;
+			break;
+		}else if(Entry->Key == Key){
+			Entry->Until = std::max<int>(Entry->Until, Until);
+			break;
+		}
+		Index = (Index + 1) & Mask;
+	}
+}
+
+static void InsertBanEntry(TBanTable *Table, int Key, int Until){
+	// NOTE(fusion): Zero is used to mark empty slots.
+	if(Until <= 0){
+		return;
+	}
+
+	if(((Table->NumEntries + 1) * 2) > Table->Capacity){
+		// NOTE(fusion): Only active entries are carried over so expired ones
+		// don't keep the table growing.
+		int Now = GetUnixTime();
+		int NumActive = 0;
+		for(int i = 0; i < Table->Capacity; i += 1){
+			if(Table->Entries[i].Until > Now){
+				NumActive += 1;
+			}
+		}
+
+		int NewCapacity = 64;
+		while(NewCapacity < ((NumActive + 1) * 4)){
+			NewCapacity *= 2;
+		}
+
+		TBanTable NewTable = {};
+		NewTable.Capacity = NewCapacity;
+		NewTable.Entries = (TBanEntry*)calloc((usize)NewCapacity, sizeof(TBanEntry));
+		if(NewTable.Entries == NULL){
+			PANIC("Failed to allocate ban table with %d entries", NewCapacity);
+			return;
+		}
+
+		for(int i = 0; i < Table->Capacity; i += 1){
+			TBanEntry *Entry = &Table->Entries[i];
+			if(Entry->Until > Now){
+				LinkBanEntry(&NewTable, Entry->Key, Entry->Until);
+			}
+		}
+
+		ClearBanTable(Table);
+		*Table = NewTable;
+	}
+
+	LinkBanEntry(Table, Key, Until);
+}
+
+static TBanEntry *FindBanEntry(const TBanTable *Table, int Key){
+	if(Table->NumEntries == 0){
+		return NULL;
+	}
+
+	int Mask = Table->Capacity - 1;
+	int Index = (int)(HashBanKey(Key) & (uint32)Mask);
+	while(Table->Entries[Index].Until != 0){
+		TBanEntry *Entry = &Table->Entries[Index];
+		if(Entry->Key == Key){
+			return Entry;
+		}
+		Index = (Index + 1) & Mask;
+	}
+	return NULL;
+}
+
+static void RecordBanUndo(TBanTable *Table, int Key){
+	// NOTE(fusion): A negative count means the undo log overflowed or the
+	// tables were loaded since the last mark, in which case the whole cache
+	// is reloaded on rollback.
+	if(g_NumBanUndo < 0){
+		return;
+	}
+
+	if(g_NumBanUndo >= NARRAY(g_BanUndo)){
+		g_NumBanUndo = -1;
+		return;
+	}
+
+	// NOTE(fusion): Entries can't be unlinked with linear probing so entries
+	// that didn't exist are reverted to an already expired time instead. They
+	// are dropped whenever the table is rebuilt.
+	TBanEntry *Entry = FindBanEntry(Table, Key);
+	TBanUndoEntry *Undo = &g_BanUndo[g_NumBanUndo];
+	Undo->Table = Table;
+	Undo->Key = Key;
+	Undo->Until = (Entry != NULL ? Entry->Until : 1);
+	g_NumBanUndo += 1;
+}
+
+static bool IsBanEntryActive(const TBanTable *Table, int Key){
+	const TBanEntry *Entry = FindBanEntry(Table, Key);
+	return Entry != NULL && Entry->Until > GetUnixTime();
+}
+
+static bool LoadBanTable(TBanTable *Table,
+		bool (*GetBanishments)(DynamicArray<TActiveBanishment>*)){
+	DynamicArray<TActiveBanishment> Banishments;
+	if(!GetBanishments(&Banishments)){
+		return false;
+	}
+
+	ClearBanTable(Table);
+	for(int i = 0; i < Banishments.Length(); i += 1){
+		InsertBanEntry(Table, Banishments[i].Key,
+				BanExpireTime(Banishments[i].Issued, Banishments[i].Until));
+	}
+
+	// NOTE(fusion): The tables may be loaded in the middle of a transaction, in
+	// which case they could have picked up uncommitted banishments.
+	g_NumBanUndo = -1;
+	return true;
+}
+
+static bool CheckBanCache(void){
+	int DataVersion;
+	if(!GetDataVersion(&DataVersion)){
+		return g_BanCacheLoaded;
+	}
+
+	if(!g_BanCacheLoaded || DataVersion != g_BanCacheDataVersion){
+		if(!LoadBanTable(&g_AccountBans, GetActiveBanishments)
+				|| !LoadBanTable(&g_IPAddressBans, GetActiveIPBanishments)){
+			LOG_ERR("Failed to load ban cache");
+			g_BanCacheLoaded = false;
+			return false;
+		}
+
+		g_BanCacheDataVersion = DataVersion;
+		g_BanCacheLoaded = true;
+	}
+
+	return true;
+}
+
+bool InitBanCache(void){
+	if(!CheckBanCache()){
+		return false;
+	}
+
+	LOG("Active account banishments: %d", g_AccountBans.NumEntries);
+	LOG("Active IP address banishments: %d", g_IPAddressBans.NumEntries);
+	return true;
+}
+
+void ExitBanCache(void){
+	ClearBanTable(&g_AccountBans);
+	ClearBanTable(&g_IPAddressBans);
+	g_BanCacheLoaded = false;
+}
+
+void MarkBanCache(void){
+	g_NumBanUndo = 0;
+}
+
+void RollbackBanCache(void){
+	if(g_BanCacheLoaded){
+		if(g_NumBanUndo < 0){
+			g_BanCacheLoaded = false;
+		}else{
+			// NOTE(fusion): Entries are only ever linked, never moved, except
+			// when a table is rebuilt, which drops expired entries only, so an
+			// entry we inserted that can't be found was already expired.
+			for(int i = g_NumBanUndo - 1; i >= 0; i -= 1){
+				TBanUndoEntry *Undo = &g_BanUndo[i];
+				TBanEntry *Entry = FindBanEntry(Undo->Table, Undo->Key);
+				if(Entry != NULL){
+					Entry->Until = Undo->Until;
+				}
+			}
+		}
+	}
+	g_NumBanUndo = 0;
+}
+
+void InsertBanCacheAccount(int AccountID, int Issued, int Until){
+	if(g_BanCacheLoaded){
+		RecordBanUndo(&g_AccountBans, AccountID);
+		InsertBanEntry(&g_AccountBans, AccountID, BanExpireTime(Issued, Until));
+	}
+}
+
+void InsertBanCacheIPAddress(int IPAddress, int Issued, int Until){
+	if(g_BanCacheLoaded){
+		RecordBanUndo(&g_IPAddressBans, IPAddress);
+		InsertBanEntry(&g_IPAddressBans, IPAddress, BanExpireTime(Issued, Until));
+	}
+}
+
+bool IsAccountBanished(int AccountID){
+	return CheckBanCache() && IsBanEntryActive(&g_AccountBans, AccountID);
+}
+
+bool IsIPBanished(int IPAddress){
+	return CheckBanCache() && IsBanEntryActive(&g_IPAddressBans, IPAddress);
+}
@@ -8,19 +8,36 @@
 #	include <fcntl.h>
 #	include <netinet/in.h>
 #	include <poll.h>
+#	include <pthread.h>
+#	include <signal.h>
+#	include <sys/eventfd.h>
 #	include <sys/socket.h>
+#	include <sys/stat.h>
+#	include <sys/uio.h>
+#	include <sys/un.h>
 #	include <unistd.h>
 #	include <time.h>
 #else
 #	error "Operating system not currently supported."
 #endif
 
-static int g_Listener = -1;
+static int g_UnixListener = -1;
 static TConnection *g_Connections;
+static int g_NumShards;
+static TConnectionShard *g_Shards;
+
+// NOTE(fusion): Queries decoded by network threads are forwarded to the main
+// thread through this queue, which is the only thread allowed to touch the
+// database. Connections are linked through `QueueNext`.
+static pthread_mutex_t g_QueryMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_QueryCond;
+static TConnection *g_QueryHead;
+static TConnection *g_QueryTail;
+static std::atomic<bool> g_StopNetworkThreads;
 
 // Connection Handling
 //==============================================================================
-int ListenerBind(uint16 Port){
+int ListenerBind(uint16 Port, bool ReusePort){
 	int Socket = socket(AF_INET, SOCK_STREAM, 0);
 	if(Socket == -1){
 		LOG_ERR("Failed to create listener socket: (%d) %s", errno, strerrordesc_np(errno));
@@ -34,6 +51,17 @@ int ListenerBind(uint16 Port){
 		return -1;
 	}
 
+	// NOTE(fusion): Each network thread binds its own listener to the same port
+	// and the kernel will distribute incoming connections between them.
+	if(ReusePort){
+		int ReusePortValue = 1;
+		if(setsockopt(Socket, SOL_SOCKET, SO_REUSEPORT, &ReusePortValue, sizeof(ReusePortValue)) == -1){
+			LOG_ERR("Failed to set SO_REUSEPORT: (%d) %s", errno, strerrordesc_np(errno));
+			close(Socket);
+			return -1;
+		}
+	}
+
 	int Flags = fcntl(Socket, F_GETFL);
 	if(Flags == -1){
 		LOG_ERR("Failed to get socket flags: (%d) %s", errno, strerrordesc_np(errno));
@@ -118,6 +146,128 @@ int ListenerAccept(int Listener, uint32 *OutAddr, uint16 *OutPort){
 	}
 }
 
+int UnixListenerBind(const char *Path){
+	sockaddr_un Addr = {};
+	Addr.sun_family = AF_UNIX;
+	if(!StringCopy(Addr.sun_path, (int)sizeof(Addr.sun_path), Path)){
+		LOG_ERR("Unix socket path \"%s\" is too long (MaxLength: %d)",
+				Path, (int)sizeof(Addr.sun_path) - 1);
+		return -1;
+	}
+
+	// NOTE(fusion): A socket file left behind by a previous run (e.g. after a
+	// crash) would make `bind` fail. Only remove it if it's actually a socket
+	// so we don't accidentally delete some other file because of a bad config.
+	struct stat PathStat;
+	if(lstat(Path, &PathStat) == 0){
+		if(!S_ISSOCK(PathStat.st_mode)){
+			LOG_ERR("Unix socket path \"%s\" exists and is not a socket", Path);
+			return -1;
+		}
+
+		if(unlink(Path) == -1){
+			LOG_ERR("Failed to remove stale unix socket \"%s\": (%d) %s",
+					Path, errno, strerrordesc_np(errno));
+			return -1;
+		}
+	}
+
+	int Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(Socket == -1){
+		LOG_ERR("Failed to create unix listener socket: (%d) %s", errno, strerrordesc_np(errno));
+		return -1;
+	}
+
+	int Flags = fcntl(Socket, F_GETFL);
+	if(Flags == -1){
+		LOG_ERR("Failed to get socket flags: (%d) %s", errno, strerrordesc_np(errno));
+		close(Socket);
+		return -1;
+	}
+
+	if(fcntl(Socket, F_SETFL, Flags | O_NONBLOCK) == -1){
+		LOG_ERR("Failed to set socket flags: (%d) %s", errno, strerrordesc_np(errno));
+		close(Socket);
+		return -1;
+	}
+
+	if(bind(Socket, (sockaddr*)&Addr, sizeof(Addr)) == -1){
+		LOG_ERR("Failed to bind socket to \"%s\": (%d) %s", Path, errno, strerrordesc_np(errno));
+		close(Socket);
+		return -1;
+	}
+
+	// IMPORTANT(fusion): Connecting to a unix socket requires write permission
+	// on the socket file so access is restricted to our own user and group.
+	// Servers running under a different user should be added to our group.
+	if(chmod(Path, 0660) == -1){
+		LOG_ERR("Failed to set permissions on \"%s\": (%d) %s", Path, errno, strerrordesc_np(errno));
+		close(Socket);
+		unlink(Path);
+		return -1;
+	}
+
+	if(listen(Socket, 128) == -1){
+		LOG_ERR("Failed to listen to \"%s\": (%d) %s", Path, errno, strerrordesc_np(errno));
+		close(Socket);
+		unlink(Path);
+		return -1;
+	}
+
+	return Socket;
+}
+
+int UnixListenerAccept(int Listener, char *RemoteAddress, int RemoteAddressSize){
+	while(true){
+		int Socket = accept(Listener, NULL, NULL);
+		if(Socket == -1){
+			if(errno != EAGAIN){
+				LOG_ERR("Failed to accept connection: (%d) %s", errno, strerrordesc_np(errno));
+			}
+			return -1;
+		}
+
+		// IMPORTANT(fusion): File permissions should already prevent anyone
+		// outside our user and group from connecting but we double check with
+		// the credentials the kernel recorded when the peer called `connect`,
+		// which can't be spoofed.
+		ucred Cred = {};
+		socklen_t CredLen = sizeof(Cred);
+		if(getsockopt(Socket, SOL_SOCKET, SO_PEERCRED, &Cred, &CredLen) == -1){
+			LOG_ERR("Failed to get peer credentials: (%d) %s", errno, strerrordesc_np(errno));
+			close(Socket);
+			continue;
+		}
+
+		if(Cred.uid != geteuid() && Cred.gid != getegid() && Cred.uid != 0){
+			LOG_ERR("Rejecting unix connection from pid %d (uid: %d, gid: %d).",
+					(int)Cred.pid, (int)Cred.uid, (int)Cred.gid);
+			close(Socket);
+			continue;
+		}
+
+		int Flags = fcntl(Socket, F_GETFL);
+		if(Flags == -1){
+			LOG_ERR("Failed to get socket flags: (%d) %s", errno, strerrordesc_np(errno));
+			close(Socket);
+			continue;
+		}
+
+		if(fcntl(Socket, F_SETFL, Flags | O_NONBLOCK) == -1){
+			LOG_ERR("Failed to set socket flags: (%d) %s", errno, strerrordesc_np(errno));
+			close(Socket);
+			continue;
+		}
+
+		if(RemoteAddress != NULL && RemoteAddressSize > 0){
+			snprintf(RemoteAddress, RemoteAddressSize,
+					"unix:%d:%d", (int)Cred.pid, (int)Cred.uid);
+		}
+
+		return Socket;
+	}
+}
+
 void CloseConnection(TConnection *Connection){
 	if(Connection->Socket != -1){
 		close(Connection->Socket);
@@ -138,29 +288,121 @@ void DeleteConnectionBuffer(TConnection *Connection){
 	}
 }
 
-TConnection *AssignConnection(int Socket, uint32 Addr, uint16 Port){
-	int ConnectionIndex = -1;
-	for(int i = 0; i < g_MaxConnections; i += 1){
-		if(g_Connections[i].State == CONNECTION_FREE){
-			ConnectionIndex = i;
-			break;
+struct TConnectionShard{
+	int Index;
+	int Listener;
+	int WakeEvent;
+	int FirstConnection;
+	int NumConnections;
+	bool ThreadRunning;
+	pthread_t Thread;
+	TConnection *Completed;
+	TTimerWheel Wheel;
+
+	// NOTE(fusion): The `MaxConnectionIdleTime` idle timers were last scheduled
+	// with, so they can be rescheduled when it's changed by a config reload.
+	int IdleTime;
+
+	// NOTE(fusion): Free slots are linked through `TConnection::NextFree` while
+	// active slots are kept densely packed in `Active`, with each connection
+	// holding its own position in `TConnection::ActiveIndex`. Both hold global
+	// slot indices rather than pointers so they survive table reallocation.
+	int FreeHead;
+	int NumActive;
+	int *Active;
+
+	// NOTE(fusion): Scratch memory for `ProcessShard`, reset on every call.
+	TArena Scratch;
+};
+
+static TConnectionShard *GetConnectionShard(TConnection *Connection){
+	int ConnectionIndex = (int)(Connection - g_Connections);
+	for(int i = 0; i < g_NumShards; i += 1){
+		TConnectionShard *Shard = &g_Shards[i];
+		if(ConnectionIndex >= Shard->FirstConnection
+				&& ConnectionIndex < (Shard->FirstConnection + Shard->NumConnections)){
+			return Shard;
 		}
 	}
 
+	PANIC("Connection slot %d doesn't belong to any shard", ConnectionIndex);
+	return NULL;
+}
+
+static void ScheduleIdleTimer(TConnectionShard *Shard, TConnection *Connection){
+	if(g_MaxConnectionIdleTime > 0){
+		ScheduleTimer(&Shard->Wheel, &Connection->IdleTimer,
+				(int64)Connection->LastActive + g_MaxConnectionIdleTime);
+	}else{
+		CancelTimer(&Connection->IdleTimer);
+	}
+}
+
+static void ConnectionIdleTimeout(TTimer *Timer){
+	TConnection *Connection = (TConnection*)Timer->Data;
+	ASSERT(!Connection->Queued);
+	// NOTE(fusion): The timer may have been scheduled with a shorter idle time
+	// than the current one, in which case it's scheduled again for the rest.
+	int MaxIdleTime = g_MaxConnectionIdleTime;
+	if(MaxIdleTime > 0){
+		if((g_MonotonicTimeMS - Connection->LastActive) < MaxIdleTime){
+			ScheduleIdleTimer(GetConnectionShard(Connection), Connection);
+			return;
+		}
+
+		LOG_WARN("Dropping connection %s due to inactivity",
+				Connection->RemoteAddress);
+		ReleaseConnection(Connection);
+	}
+}
+
+static void TouchConnection(TConnection *Connection){
+	Connection->LastActive = g_MonotonicTimeMS;
+	ScheduleIdleTimer(GetConnectionShard(Connection), Connection);
+}
+
+static void RebuildConnectionLists(TConnectionShard *Shard){
+	Shard->Active = (int*)realloc(Shard->Active,
+			sizeof(int) * (usize)Shard->NumConnections);
+	Shard->NumActive = 0;
+	Shard->FreeHead = -1;
+	for(int i = Shard->NumConnections - 1; i >= 0; i -= 1){
+		int Index = Shard->FirstConnection + i;
+		if(g_Connections[Index].State == CONNECTION_FREE){
+			g_Connections[Index].NextFree = Shard->FreeHead;
+			Shard->FreeHead = Index;
+		}
+	}
+
+	for(int i = 0; i < Shard->NumConnections; i += 1){
+		int Index = Shard->FirstConnection + i;
+		if(g_Connections[Index].State != CONNECTION_FREE){
+			g_Connections[Index].ActiveIndex = Shard->NumActive;
+			Shard->Active[Shard->NumActive] = Index;
+			Shard->NumActive += 1;
+		}
+	}
+}
+
+TConnection *AssignConnection(TConnectionShard *Shard, int Socket, const char *RemoteAddress){
+	int ConnectionIndex = Shard->FreeHead;
 	TConnection *Connection = NULL;
 	if(ConnectionIndex != -1){
 		Connection = &g_Connections[ConnectionIndex];
+		ASSERT(Connection->State == CONNECTION_FREE);
+		Shard->FreeHead = Connection->NextFree;
+		Connection->NextFree = -1;
+		Connection->ActiveIndex = Shard->NumActive;
+		Shard->Active[Shard->NumActive] = ConnectionIndex;
+		Shard->NumActive += 1;
+
 		Connection->State = CONNECTION_READING;
 		Connection->Socket = Socket;
-		Connection->LastActive = g_MonotonicTimeMS;
-		snprintf(Connection->RemoteAddress,
+		StringCopy(Connection->RemoteAddress,
 				sizeof(Connection->RemoteAddress),
-				"%d.%d.%d.%d:%d",
-				((int)(Addr >> 24) & 0xFF),
-				((int)(Addr >> 16) & 0xFF),
-				((int)(Addr >>  8) & 0xFF),
-				((int)(Addr >>  0) & 0xFF),
-				(int)Port);
+				RemoteAddress);
+		InitTimer(&Connection->IdleTimer, ConnectionIdleTimeout, Connection);
+		TouchConnection(Connection);
 
 		LOG("Connection %s assigned to slot %d",
 				Connection->RemoteAddress, ConnectionIndex);
@@ -171,13 +413,162 @@ TConnection *AssignConnection(int Socket, uint32 Addr, uint16 Port){
 void ReleaseConnection(TConnection *Connection){
 	if(Connection->State != CONNECTION_FREE){
 		LOG("Connection %s released", Connection->RemoteAddress);
+		CancelTimer(&Connection->IdleTimer);
 		CloseConnection(Connection);
 		DeleteConnectionBuffer(Connection);
+		ArenaFree(&Connection->Arena);
+
+		// NOTE(fusion): Swap remove from the active list and push the slot into
+		// the free list.
+		TConnectionShard *Shard = GetConnectionShard(Connection);
+		int ConnectionIndex = (int)(Connection - g_Connections);
+		int ActiveIndex = Connection->ActiveIndex;
+		int LastIndex = Shard->Active[Shard->NumActive - 1];
+		ASSERT(Shard->Active[ActiveIndex] == ConnectionIndex);
+		Shard->Active[ActiveIndex] = LastIndex;
+		g_Connections[LastIndex].ActiveIndex = ActiveIndex;
+		Shard->NumActive -= 1;
+
 		memset(Connection, 0, sizeof(TConnection));
 		Connection->State = CONNECTION_FREE;
+		Connection->NextFree = Shard->FreeHead;
+		Shard->FreeHead = ConnectionIndex;
+	}
+}
+
+static void QueueConnectionQuery(TConnection *Connection){
+	Connection->QueueNext = NULL;
+	pthread_mutex_lock(&g_QueryMutex);
+	if(g_QueryTail != NULL){
+		g_QueryTail->QueueNext = Connection;
+	}else{
+		g_QueryHead = Connection;
+	}
+	g_QueryTail = Connection;
+	pthread_cond_signal(&g_QueryCond);
+	pthread_mutex_unlock(&g_QueryMutex);
+}
+
+static void DispatchConnectionQuery(TConnection *Connection){
+	if(g_NetworkThreads == 0){
+		// NOTE(fusion): Deferred queries are owned by the crypto pool until
+		// they're queued back, so they must not be polled in the meantime.
+		ProcessConnectionQuery(Connection);
+		if(Connection->PasswordCheckPending){
+			CancelTimer(&Connection->IdleTimer);
+			Connection->Queued = true;
+		}
+		return;
+	}
+
+	// IMPORTANT(fusion): The connection is owned by the main thread until the
+	// query is completed so the network thread MUST NOT touch anything other
+	// than `Queued` until then. A query in flight doesn't count as inactivity
+	// so the idle timer is only restarted once it's completed.
+	CancelTimer(&Connection->IdleTimer);
+	Connection->Queued = true;
+	QueueConnectionQuery(Connection);
+}
+
+static void CompleteConnectionQuery(TConnection *Connection){
+	if(g_NetworkThreads == 0){
+		// NOTE(fusion): This is only reached by deferred queries, which are
+		// completed outside the shard poll, so we try to write the response
+		// right away instead of waiting for the next update.
+		Connection->Queued = false;
+		if(Connection->Socket != -1){
+			TouchConnection(Connection);
+			CheckConnectionOutput(Connection, POLLOUT);
+		}
+		CheckConnection(Connection, 0);
+		return;
+	}
+
+	TConnectionShard *Shard = GetConnectionShard(Connection);
+	pthread_mutex_lock(&g_QueryMutex);
+	Connection->QueueNext = Shard->Completed;
+	Shard->Completed = Connection;
+	pthread_mutex_unlock(&g_QueryMutex);
+
+	uint64 Counter = 1;
+	if(write(Shard->WakeEvent, &Counter, sizeof(Counter)) == -1){
+		LOG_ERR("Failed to wake network thread %d: (%d) %s",
+				Shard->Index, errno, strerrordesc_np(errno));
 	}
 }
 
+static void ProcessQueuedQueries(TConnection *Queue){
+	while(Queue != NULL){
+		TConnection *Connection = Queue;
+		Queue = Queue->QueueNext;
+		ProcessConnectionQuery(Connection);
+		if(!Connection->PasswordCheckPending){
+			CompleteConnectionQuery(Connection);
+		}
+	}
+}
+
+static void PasswordCheckDone(TCryptoJob *Job){
+	// NOTE(fusion): Called from a crypto thread. The connection is still owned
+	// by the main thread so it's only queued back for processing, which also
+	// publishes the result.
+	QueueConnectionQuery((TConnection*)Job->Data);
+}
+
+static int CheckConnectionPassword(TConnection *Connection,
+		const TAccount *Account, const char *Password){
+	// NOTE(fusion): Returns 1 if the password matches, 0 if it doesn't, and -1
+	// if the check was handed to the crypto pool, in which case the query MUST
+	// be aborted without a response. It'll be processed again once the check is
+	// done and the result is only used if the request and account still match.
+	// `PasswordCheckPending` is only ever touched by the main thread.
+	// NOTE(fusion): Outdated authentication data is replaced when the password
+	// matches. It's done inside the caller's transaction so it may still be
+	// rolled back, in which case it'll be replaced on the next login instead.
+	TCryptoJob *Job = &Connection->PasswordJob;
+	if(!CryptoPoolEnabled()){
+		if(!TestPassword(Account->Auth, Account->AuthSize, Password)){
+			return 0;
+		}
+
+		if(AuthNeedsRehash(Account->Auth, Account->AuthSize)){
+			uint8 NewAuth[AUTH_SIZE];
+			if(GenerateAuth(Password, NewAuth, sizeof(NewAuth))){
+				UpdateAccountAuth(Account->AccountID, NewAuth, sizeof(NewAuth));
+			}
+		}
+
+		return 1;
+	}
+
+	if(Connection->PasswordCheckPending){
+		bool Match = Job->AuthSize == Account->AuthSize
+				&& memcmp(Job->Auth, Account->Auth, Account->AuthSize) == 0
+				&& StringEq(Job->Password, Password);
+		bool Result = Job->Result;
+		if(Match && Result && Job->Rehash){
+			UpdateAccountAuth(Account->AccountID, Job->NewAuth, sizeof(Job->NewAuth));
+		}
+
+		memset(Job, 0, sizeof(TCryptoJob));
+		Connection->PasswordCheckPending = false;
+		if(Match){
+			return Result ? 1 : 0;
+		}
+	}
+
+	memcpy(Job->Auth, Account->Auth, Account->AuthSize);
+	Job->AuthSize = Account->AuthSize;
+	StringCopy(Job->Password, sizeof(Job->Password), Password);
+	Job->Result = false;
+	Job->Rehash = AuthNeedsRehash(Account->Auth, Account->AuthSize);
+	Job->Callback = PasswordCheckDone;
+	Job->Data = Connection;
+	Connection->PasswordCheckPending = true;
+	SubmitCryptoJob(Job);
+	return -1;
+}
+
 void CheckConnectionInput(TConnection *Connection, int Events){
 	if((Events & POLLIN) == 0 || Connection->Socket == -1){
 		return;
@@ -194,12 +585,10 @@ void CheckConnectionInput(TConnection *Connection, int Events){
 	while(true){
 		int ReadSize = Connection->RWSize;
 		if(ReadSize == 0){
-			if(Connection->RWPosition < 2){
-				ReadSize = 2 - Connection->RWPosition;
-			}else{
-				ReadSize = 6 - Connection->RWPosition;
-			}
-			ASSERT(ReadSize > 0);
+			// NOTE(fusion): Read up to the end of the short or extended size
+			// header. `ReadSize` is an absolute position here, same as `RWSize`.
+			ReadSize = (Connection->RWPosition < 2 ? 2 : 6);
+			ASSERT(ReadSize > Connection->RWPosition);
 		}
 
 		int BytesRead = read(Connection->Socket,
@@ -221,7 +610,7 @@ void CheckConnectionInput(TConnection *Connection, int Events){
 		if(Connection->RWPosition >= ReadSize){
 			if(Connection->RWSize != 0){
 				Connection->State = CONNECTION_PROCESSING;
-				Connection->LastActive = g_MonotonicTimeMS;
+				TouchConnection(Connection);
 				break;
 			}else if(Connection->RWPosition == 2){
 				int PayloadSize = BufferRead16LE(Connection->Buffer);
@@ -251,11 +640,47 @@ void CheckConnectionInput(TConnection *Connection, int Events){
 	}
 
 	if(Connection->State == CONNECTION_PROCESSING){
-		ProcessConnectionQuery(Connection);
+		DispatchConnectionQuery(Connection);
+	}
+}
+
+static int WriteConnectionSegments(TConnection *Connection){
+	// NOTE(fusion): Responses with referenced data may have more segments than
+	// what `writev` accepts in a single call, in which case they're written in
+	// batches. Partially written segments are adjusted in place.
+	iovec Iov[256];
+	int NumIov = 0;
+	for(int i = Connection->WriteSegmentIndex;
+			i < Connection->NumWriteSegments && NumIov < NARRAY(Iov);
+			i += 1){
+		Iov[NumIov].iov_base = (void*)Connection->WriteSegments[i].Data;
+		Iov[NumIov].iov_len = (usize)Connection->WriteSegments[i].Length;
+		NumIov += 1;
+	}
+
+	int BytesWritten = (int)writev(Connection->Socket, Iov, NumIov);
+	if(BytesWritten > 0){
+		int Remainder = BytesWritten;
+		while(Remainder > 0){
+			TWriteSegment *Segment = &Connection->WriteSegments[Connection->WriteSegmentIndex];
+			if(Remainder >= Segment->Length){
+				Remainder -= Segment->Length;
+				Connection->WriteSegmentIndex += 1;
+			}else{
+				Segment->Data += Remainder;
+				Segment->Length -= Remainder;
+				Remainder = 0;
+			}
+		}
 	}
+	return BytesWritten;
 }
 
 void CheckConnectionOutput(TConnection *Connection, int Events){
+	if(Connection->Queued){
+		return;
+	}
+
 	if((Events & POLLOUT) == 0 || Connection->Socket == -1){
 		return;
 	}
@@ -265,9 +690,15 @@ void CheckConnectionOutput(TConnection *Connection, int Events){
 	}
 
 	while(true){
-		int BytesWritten = write(Connection->Socket,
-				(Connection->Buffer + Connection->RWPosition),
-				(Connection->RWSize - Connection->RWPosition));
+		int BytesWritten;
+		if(Connection->WriteSegments != NULL){
+			BytesWritten = WriteConnectionSegments(Connection);
+		}else{
+			BytesWritten = write(Connection->Socket,
+					(Connection->Buffer + Connection->RWPosition),
+					(Connection->RWSize - Connection->RWPosition));
+		}
+
 		if(BytesWritten == -1){
 			if(errno != EAGAIN){
 				CloseConnection(Connection);
@@ -277,9 +708,15 @@ void CheckConnectionOutput(TConnection *Connection, int Events){
 
 		Connection->RWPosition += BytesWritten;
 		if(Connection->RWPosition >= Connection->RWSize){
+			// NOTE(fusion): Anything referenced by the response is no longer
+			// needed once it's fully written.
 			Connection->State = CONNECTION_READING;
 			Connection->RWSize = 0;
 			Connection->RWPosition = 0;
+			Connection->WriteSegments = NULL;
+			Connection->NumWriteSegments = 0;
+			Connection->WriteSegmentIndex = 0;
+			ArenaReset(&Connection->Arena);
 			break;
 		}
 	}
@@ -288,17 +725,14 @@ void CheckConnectionOutput(TConnection *Connection, int Events){
 void CheckConnection(TConnection *Connection, int Events){
 	ASSERT((Events & POLLNVAL) == 0);
 
-	if((Events & (POLLERR | POLLHUP)) != 0){
-		CloseConnection(Connection);
+	// NOTE(fusion): Connections with a query in flight can't be closed from
+	// here. A hang up will show up again once the query is completed.
+	if(Connection->Queued){
+		return;
 	}
 
-	if(g_MaxConnectionIdleTime > 0){
-		int IdleTime = (g_MonotonicTimeMS - Connection->LastActive);
-		if(IdleTime >= g_MaxConnectionIdleTime){
-			LOG_WARN("Dropping connection %s due to inactivity",
-					Connection->RemoteAddress);
-			CloseConnection(Connection);
-		}
+	if((Events & (POLLERR | POLLHUP)) != 0){
+		CloseConnection(Connection);
 	}
 
 	if(Connection->Socket == -1){
@@ -306,47 +740,145 @@ void CheckConnection(TConnection *Connection, int Events){
 	}
 }
 
-void ProcessConnections(void){
-	// NOTE(fusion): Accept new connections.
+static void AcceptConnections(TConnectionShard *Shard){
 	while(true){
 		uint32 Addr;
 		uint16 Port;
-		int Socket = ListenerAccept(g_Listener, &Addr, &Port);
+		int Socket = ListenerAccept(Shard->Listener, &Addr, &Port);
 		if(Socket == -1){
 			break;
 		}
 
-		if(AssignConnection(Socket, Addr, Port) == NULL){
-			LOG_ERR("Rejecting connection %08X:%d due to max number of"
-					" connections being reached (%d)", Addr, Port, g_MaxConnections);
+		char RemoteAddress[30];
+		snprintf(RemoteAddress, sizeof(RemoteAddress),
+				"%d.%d.%d.%d:%d",
+				((int)(Addr >> 24) & 0xFF),
+				((int)(Addr >> 16) & 0xFF),
+				((int)(Addr >>  8) & 0xFF),
+				((int)(Addr >>  0) & 0xFF),
+				(int)Port);
+		if(AssignConnection(Shard, Socket, RemoteAddress) == NULL){
+			LOG_ERR("Rejecting connection %s due to max number of"
+					" connections being reached (%d)", RemoteAddress, Shard->NumConnections);
 			close(Socket);
 		}
 	}
 
-	// NOTE(fusion): Gather active connections.
+	// NOTE(fusion): Unix sockets don't support SO_REUSEPORT balancing so all
+	// shards share the same listener and whoever gets to it first accepts.
+	while(g_UnixListener != -1){
+		char RemoteAddress[30];
+		int Socket = UnixListenerAccept(g_UnixListener,
+				RemoteAddress, (int)sizeof(RemoteAddress));
+		if(Socket == -1){
+			break;
+		}
+
+		if(AssignConnection(Shard, Socket, RemoteAddress) == NULL){
+			LOG_ERR("Rejecting connection %s due to max number of"
+					" connections being reached (%d)", RemoteAddress, Shard->NumConnections);
+			close(Socket);
+		}
+	}
+}
+
+static void ProcessShard(TConnectionShard *Shard, int TimeoutMS){
+	// NOTE(fusion): Take back connections whose queries were completed by the
+	// main thread. Connections closed while processing the query won't be
+	// polled anymore so they need to be released here.
+	if(Shard->WakeEvent != -1){
+		uint64 Counter;
+		if(read(Shard->WakeEvent, &Counter, sizeof(Counter)) == -1 && errno != EAGAIN){
+			LOG_ERR("Failed to read wake event: (%d) %s", errno, strerrordesc_np(errno));
+		}
+
+		pthread_mutex_lock(&g_QueryMutex);
+		TConnection *Completed = Shard->Completed;
+		Shard->Completed = NULL;
+		pthread_mutex_unlock(&g_QueryMutex);
+
+		while(Completed != NULL){
+			TConnection *Connection = Completed;
+			Completed = Completed->QueueNext;
+			Connection->QueueNext = NULL;
+			Connection->Queued = false;
+			if(Connection->Socket == -1){
+				ReleaseConnection(Connection);
+			}else{
+				TouchConnection(Connection);
+			}
+		}
+	}
+
+	// NOTE(fusion): Accept new connections.
+	AcceptConnections(Shard);
+
+	// NOTE(fusion): Reschedule idle timers if `MaxConnectionIdleTime` was
+	// changed by a config reload. Queued connections don't have one running
+	// and are touched again when their query is completed.
+	int IdleTime = g_MaxConnectionIdleTime;
+	if(Shard->IdleTime != IdleTime){
+		for(int i = 0; i < Shard->NumActive; i += 1){
+			TConnection *Connection = &g_Connections[Shard->Active[i]];
+			if(!Connection->Queued){
+				ScheduleIdleTimer(Shard, Connection);
+			}
+		}
+		Shard->IdleTime = IdleTime;
+	}
+
+	// NOTE(fusion): Drop idle connections.
+	AdvanceTimerWheel(&Shard->Wheel, g_MonotonicTimeMS);
+
+	// NOTE(fusion): Gather active connections. When blocking, listeners and the
+	// wake event are also polled so we don't miss anything in the meantime.
+	ArenaReset(&Shard->Scratch);
 	int NumConnections = 0;
-	int *ConnectionIndices = (int*)alloca(g_MaxConnections * sizeof(int));
-	pollfd *ConnectionFds  = (pollfd*)alloca(g_MaxConnections * sizeof(pollfd));
-	for(int i = 0; i < g_MaxConnections; i += 1){
-		if(g_Connections[i].State == CONNECTION_FREE || g_Connections[i].Socket == -1){
+	int *ConnectionIndices = ArenaAllocArray<int>(&Shard->Scratch, Shard->NumActive);
+	pollfd *ConnectionFds  = ArenaAllocArray<pollfd>(&Shard->Scratch, Shard->NumActive + 3);
+	for(int i = 0; i < Shard->NumActive; i += 1){
+		int Index = Shard->Active[i];
+		if(g_Connections[Index].Queued
+				|| g_Connections[Index].Socket == -1){
 			continue;
 		}
 
-		ConnectionIndices[NumConnections] = i;
-		ConnectionFds[NumConnections].fd = g_Connections[i].Socket;
-		ConnectionFds[NumConnections].events = POLLIN | POLLOUT;
+		// NOTE(fusion): Sockets are almost always writable, so only ask for
+		// `POLLOUT` when there is a response to write, else `poll` returns right
+		// away and blocking network threads end up spinning.
+		ConnectionIndices[NumConnections] = Index;
+		ConnectionFds[NumConnections].fd = g_Connections[Index].Socket;
+		ConnectionFds[NumConnections].events = POLLIN;
+		if(g_Connections[Index].State == CONNECTION_WRITING){
+			ConnectionFds[NumConnections].events |= POLLOUT;
+		}
 		ConnectionFds[NumConnections].revents = 0;
 		NumConnections += 1;
 	}
 
-	if(NumConnections <= 0){
+	int NumFds = NumConnections;
+	if(TimeoutMS > 0){
+		int ExtraFds[3] = { Shard->Listener, g_UnixListener, Shard->WakeEvent };
+		for(int i = 0; i < NARRAY(ExtraFds); i += 1){
+			if(ExtraFds[i] != -1){
+				ConnectionFds[NumFds].fd = ExtraFds[i];
+				ConnectionFds[NumFds].events = POLLIN;
+				ConnectionFds[NumFds].revents = 0;
+				NumFds += 1;
+			}
+		}
+	}
+
+	if(NumFds <= 0){
 		return;
 	}
 
 	// NOTE(fusion): Poll connections.
-	int NumEvents = poll(ConnectionFds, NumConnections, 0);
+	int NumEvents = poll(ConnectionFds, NumFds, TimeoutMS);
 	if(NumEvents == -1){
-		LOG_ERR("Failed to poll connections: (%d) %s", errno, strerrordesc_np(errno));
+		if(errno != EINTR){
+			LOG_ERR("Failed to poll connections: (%d) %s", errno, strerrordesc_np(errno));
+		}
 		return;
 	}
 
@@ -360,34 +892,283 @@ void ProcessConnections(void){
 	}
 }
 
+static void *NetworkThread(void *Arg){
+	TConnectionShard *Shard = (TConnectionShard*)Arg;
+	while(!g_StopNetworkThreads){
+		// NOTE(fusion): Block until there is something to do but still wake up
+		// at the update rate to drop idle connections.
+		ProcessShard(Shard, (int)(1000 / g_UpdateRate));
+	}
+	return NULL;
+}
+
+void ProcessConnections(void){
+	if(g_NetworkThreads == 0){
+		ProcessShard(&g_Shards[0], 0);
+		if(!CryptoPoolEnabled()){
+			return;
+		}
+	}
+
+	pthread_mutex_lock(&g_QueryMutex);
+	TConnection *Queue = g_QueryHead;
+	g_QueryHead = NULL;
+	g_QueryTail = NULL;
+	pthread_mutex_unlock(&g_QueryMutex);
+	ProcessQueuedQueries(Queue);
+}
+
+void WaitConnections(int64 DurationMS){
+	if(g_NetworkThreads == 0 && !CryptoPoolEnabled()){
+		SleepMS(DurationMS);
+		return;
+	}
+
+	// NOTE(fusion): Process queries as soon as they're forwarded by network
+	// threads or handed back by crypto threads instead of waiting for the next
+	// update.
+	timespec Deadline;
+	clock_gettime(CLOCK_MONOTONIC, &Deadline);
+	Deadline.tv_sec += (time_t)(DurationMS / 1000);
+	Deadline.tv_nsec += (long)(DurationMS % 1000) * 1000000;
+	if(Deadline.tv_nsec >= 1000000000){
+		Deadline.tv_sec += 1;
+		Deadline.tv_nsec -= 1000000000;
+	}
+
+	while(true){
+		int Result = 0;
+		pthread_mutex_lock(&g_QueryMutex);
+		while(g_QueryHead == NULL && Result != ETIMEDOUT){
+			Result = pthread_cond_timedwait(&g_QueryCond, &g_QueryMutex, &Deadline);
+		}
+		TConnection *Queue = g_QueryHead;
+		g_QueryHead = NULL;
+		g_QueryTail = NULL;
+		pthread_mutex_unlock(&g_QueryMutex);
+
+		if(Queue == NULL){
+			break;
+		}
+
+		ProcessQueuedQueries(Queue);
+	}
+}
+
+void ResizeConnections(int NewMaxConnections){
+	ASSERT(g_Connections != NULL && NewMaxConnections > 0);
+	ASSERT(g_NetworkThreads == 0 && g_NumShards == 1);
+
+	// NOTE(fusion): Move active connections to the lowest slots so shrinking
+	// the table will only drop the ones that don't fit. Connections are only
+	// referenced by index during a single `ProcessConnections` call so it is
+	// safe to move them around between updates, as long as idle timers are
+	// unlinked first and re-linked afterwards.
+	int NumActive = 0;
+	for(int i = 0; i < g_MaxConnections; i += 1){
+		if(g_Connections[i].State == CONNECTION_FREE){
+			continue;
+		}
+
+		CancelTimer(&g_Connections[i].IdleTimer);
+		if(NumActive != i){
+			g_Connections[NumActive] = g_Connections[i];
+			memset(&g_Connections[i], 0, sizeof(TConnection));
+			g_Connections[i].State = CONNECTION_FREE;
+		}
+
+		NumActive += 1;
+	}
+
+	RebuildConnectionLists(&g_Shards[0]);
+	for(int i = NewMaxConnections; i < NumActive; i += 1){
+		LOG_WARN("Dropping connection %s due to max number of connections"
+				" being reduced to %d", g_Connections[i].RemoteAddress,
+				NewMaxConnections);
+		ReleaseConnection(&g_Connections[i]);
+	}
+
+	TConnection *NewConnections = (TConnection*)realloc(g_Connections,
+			sizeof(TConnection) * (usize)NewMaxConnections);
+	if(NewConnections == NULL){
+		PANIC("Failed to resize connection table from %d to %d",
+				g_MaxConnections, NewMaxConnections);
+		return;
+	}
+
+	for(int i = g_MaxConnections; i < NewMaxConnections; i += 1){
+		memset(&NewConnections[i], 0, sizeof(TConnection));
+		NewConnections[i].State = CONNECTION_FREE;
+	}
+
+	g_Connections = NewConnections;
+	g_MaxConnections = NewMaxConnections;
+	g_Shards[0].NumConnections = NewMaxConnections;
+	RebuildConnectionLists(&g_Shards[0]);
+
+	for(int i = 0; i < NumActive && i < NewMaxConnections; i += 1){
+		TConnection *Connection = &g_Connections[i];
+		InitTimer(&Connection->IdleTimer, ConnectionIdleTimeout, Connection);
+		ScheduleIdleTimer(&g_Shards[0], Connection);
+	}
+}
+
+static bool StartNetworkThreads(void){
+	// NOTE(fusion): Signals should be handled by the main thread so we block
+	// them while creating network threads, which inherit the signal mask.
+	sigset_t SignalMask, OldSignalMask;
+	sigfillset(&SignalMask);
+	pthread_sigmask(SIG_BLOCK, &SignalMask, &OldSignalMask);
+
+	bool Result = true;
+	g_StopNetworkThreads = false;
+	for(int i = 0; i < g_NumShards; i += 1){
+		TConnectionShard *Shard = &g_Shards[i];
+		Shard->WakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(Shard->WakeEvent == -1){
+			LOG_ERR("Failed to create wake event: (%d) %s", errno, strerrordesc_np(errno));
+			Result = false;
+			break;
+		}
+
+		int ErrCode = pthread_create(&Shard->Thread, NULL, NetworkThread, Shard);
+		if(ErrCode != 0){
+			LOG_ERR("Failed to create network thread %d: (%d) %s",
+					i, ErrCode, strerrordesc_np(ErrCode));
+			Result = false;
+			break;
+		}
+
+		Shard->ThreadRunning = true;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &OldSignalMask, NULL);
+	return Result;
+}
+
+static void StopNetworkThreads(void){
+	g_StopNetworkThreads = true;
+	for(int i = 0; i < g_NumShards; i += 1){
+		TConnectionShard *Shard = &g_Shards[i];
+		if(Shard->ThreadRunning){
+			uint64 Counter = 1;
+			if(write(Shard->WakeEvent, &Counter, sizeof(Counter)) == -1){
+				LOG_ERR("Failed to wake network thread %d: (%d) %s",
+						i, errno, strerrordesc_np(errno));
+			}
+
+			pthread_join(Shard->Thread, NULL);
+			Shard->ThreadRunning = false;
+		}
+	}
+}
+
 bool InitConnections(void){
-	ASSERT(g_Listener == -1);
+	ASSERT(g_UnixListener == -1);
 	ASSERT(g_Connections == NULL);
+	ASSERT(g_Shards == NULL);
 
 	LOG("Query manager port: %d", g_QueryManagerPort);
+	if(!StringEmpty(g_QueryManagerUnixPath)){
+		LOG("Query manager unix path: \"%s\"", g_QueryManagerUnixPath);
+	}
+	LOG("Network threads: %d", g_NetworkThreads);
 	LOG("Max connections: %d", g_MaxConnections);
 	LOG("Max connection idle time: %dms", g_MaxConnectionIdleTime);
 	LOG("Max connection packet size: %d", g_MaxConnectionPacketSize);
 
-	g_Listener = ListenerBind((uint16)g_QueryManagerPort);
-	if(g_Listener == -1){
-		LOG_ERR("Failed to bind listener");
+	if(g_NetworkThreads < 0){
+		LOG_ERR("Invalid number of network threads %d", g_NetworkThreads);
 		return false;
 	}
 
+	// NOTE(fusion): Without network threads, the main thread handles a single
+	// shard spanning the whole connection table.
+	g_NumShards = (g_NetworkThreads > 0 ? g_NetworkThreads : 1);
+	if(g_MaxConnections < g_NumShards){
+		LOG_ERR("Max connections (%d) must be at least the number of"
+				" network threads (%d)", g_MaxConnections, g_NetworkThreads);
+		return false;
+	}
+
+	g_Shards = (TConnectionShard*)calloc(
+			g_NumShards, sizeof(TConnectionShard));
+	for(int i = 0; i < g_NumShards; i += 1){
+		TConnectionShard *Shard = &g_Shards[i];
+		int FirstConnection = (i * g_MaxConnections) / g_NumShards;
+		int EndConnection = ((i + 1) * g_MaxConnections) / g_NumShards;
+		Shard->Index = i;
+		Shard->Listener = -1;
+		Shard->WakeEvent = -1;
+		Shard->FirstConnection = FirstConnection;
+		Shard->NumConnections = EndConnection - FirstConnection;
+		InitTimerWheel(&Shard->Wheel, g_MonotonicTimeMS);
+		Shard->IdleTime = g_MaxConnectionIdleTime;
+	}
+
+	for(int i = 0; i < g_NumShards; i += 1){
+		g_Shards[i].Listener = ListenerBind((uint16)g_QueryManagerPort, g_NetworkThreads > 0);
+		if(g_Shards[i].Listener == -1){
+			LOG_ERR("Failed to bind listener");
+			return false;
+		}
+	}
+
+	if(!StringEmpty(g_QueryManagerUnixPath)){
+		g_UnixListener = UnixListenerBind(g_QueryManagerUnixPath);
+		if(g_UnixListener == -1){
+			LOG_ERR("Failed to bind unix listener");
+			return false;
+		}
+	}
+
 	g_Connections = (TConnection*)calloc(
 			g_MaxConnections, sizeof(TConnection));
 	for(int i = 0; i < g_MaxConnections; i += 1){
 		g_Connections[i].State = CONNECTION_FREE;
 	}
 
+	for(int i = 0; i < g_NumShards; i += 1){
+		RebuildConnectionLists(&g_Shards[i]);
+	}
+
+	// NOTE(fusion): The query queue is also used by the crypto pool to hand
+	// back deferred queries, even without network threads.
+	pthread_condattr_t CondAttr;
+	pthread_condattr_init(&CondAttr);
+	pthread_condattr_setclock(&CondAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&g_QueryCond, &CondAttr);
+	pthread_condattr_destroy(&CondAttr);
+
+	if(g_NetworkThreads > 0 && !StartNetworkThreads()){
+		LOG_ERR("Failed to start network threads");
+		return false;
+	}
+
 	return true;
 }
 
 void ExitConnections(void){
-	if(g_Listener != -1){
-		close(g_Listener);
-		g_Listener = -1;
+	if(g_Shards != NULL){
+		StopNetworkThreads();
+		for(int i = 0; i < g_NumShards; i += 1){
+			TConnectionShard *Shard = &g_Shards[i];
+			if(Shard->Listener != -1){
+				close(Shard->Listener);
+				Shard->Listener = -1;
+			}
+
+			if(Shard->WakeEvent != -1){
+				close(Shard->WakeEvent);
+				Shard->WakeEvent = -1;
+			}
+		}
+	}
+
+	if(g_UnixListener != -1){
+		close(g_UnixListener);
+		unlink(g_QueryManagerUnixPath);
+		g_UnixListener = -1;
 	}
 
 	if(g_Connections != NULL){
@@ -398,6 +1179,17 @@ void ExitConnections(void){
 		free(g_Connections);
 		g_Connections = NULL;
 	}
+
+	if(g_Shards != NULL){
+		for(int i = 0; i < g_NumShards; i += 1){
+			free(g_Shards[i].Active);
+			ArenaFree(&g_Shards[i].Scratch);
+		}
+
+		free(g_Shards);
+		g_Shards = NULL;
+		g_NumShards = 0;
+	}
 }
 
 // Connection Queries
@@ -426,7 +1218,8 @@ TWriteBuffer PrepareResponse(TConnection *Connection, int Status){
 		return TWriteBuffer(NULL, 0);
 	}
 
-	TWriteBuffer WriteBuffer(Connection->Buffer, g_MaxConnectionPacketSize);
+	TWriteBuffer WriteBuffer(Connection->Buffer,
+			g_MaxConnectionPacketSize, &Connection->Arena);
 	WriteBuffer.Write16(0);
 	WriteBuffer.Write8((uint8)Status);
 	return WriteBuffer;
@@ -445,7 +1238,7 @@ void SendResponse(TConnection *Connection, TWriteBuffer *WriteBuffer){
 		&& WriteBuffer->Size == g_MaxConnectionPacketSize
 		&& WriteBuffer->Position > 2);
 
-	int PayloadSize = WriteBuffer->Position - 2;
+	int PayloadSize = WriteBuffer->TotalSize() - 2;
 	if(PayloadSize < 0xFFFF){
 		WriteBuffer->Rewrite16(0, (uint16)PayloadSize);
 	}else{
@@ -455,8 +1248,43 @@ void SendResponse(TConnection *Connection, TWriteBuffer *WriteBuffer){
 
 	if(!WriteBuffer->Overflowed()){
 		Connection->State = CONNECTION_WRITING;
-		Connection->RWSize = WriteBuffer->Position;
+		Connection->RWSize = WriteBuffer->TotalSize();
 		Connection->RWPosition = 0;
+		Connection->WriteSegments = NULL;
+		Connection->NumWriteSegments = 0;
+		Connection->WriteSegmentIndex = 0;
+
+		// NOTE(fusion): Interleave buffer data with referenced data. Responses
+		// without references are written straight from the buffer.
+		if(WriteBuffer->NumRefs > 0){
+			int MaxSegments = WriteBuffer->NumRefs * 2 + 1;
+			TWriteSegment *Segments = ArenaAllocArray<TWriteSegment>(
+					&Connection->Arena, MaxSegments);
+			int NumSegments = 0;
+			int BufferPosition = 0;
+			for(int i = 0; i < WriteBuffer->NumRefs; i += 1){
+				const TWriteRef *Ref = &WriteBuffer->Refs[i];
+				if(Ref->Offset > BufferPosition){
+					Segments[NumSegments].Data = WriteBuffer->Buffer + BufferPosition;
+					Segments[NumSegments].Length = Ref->Offset - BufferPosition;
+					NumSegments += 1;
+					BufferPosition = Ref->Offset;
+				}
+
+				Segments[NumSegments].Data = Ref->Data;
+				Segments[NumSegments].Length = Ref->Length;
+				NumSegments += 1;
+			}
+
+			if(WriteBuffer->Position > BufferPosition){
+				Segments[NumSegments].Data = WriteBuffer->Buffer + BufferPosition;
+				Segments[NumSegments].Length = WriteBuffer->Position - BufferPosition;
+				NumSegments += 1;
+			}
+
+			Connection->WriteSegments = Segments;
+			Connection->NumWriteSegments = NumSegments;
+		}
 	}else{
 		LOG_ERR("Write buffer overflowed when writing response to %s",
 				Connection->RemoteAddress);
@@ -525,7 +1353,8 @@ void ProcessLoginQuery(TConnection *Connection, TReadBuffer *Buffer){
 	SendQueryStatusOk(Connection);
 }
 
-static int CheckAccountPasswordTransaction(int AccountID, const char *Password, int IPAddress){
+static int CheckAccountPasswordTransaction(TConnection *Connection,
+		int AccountID, const char *Password, int IPAddress){
 	TransactionScope Tx("CheckAccountPassword");
 	if(!Tx.Begin()){
 		return -1;
@@ -540,7 +1369,10 @@ static int CheckAccountPasswordTransaction(int AccountID, const char *Password,
 		return 1;
 	}
 
-	if(!TestPassword(Account.Auth, sizeof(Account.Auth), Password)){
+	int PasswordResult = CheckConnectionPassword(Connection, &Account, Password);
+	if(PasswordResult == -1){
+		return -2;
+	}else if(PasswordResult == 0){
 		return 2;
 	}
 
@@ -573,7 +1405,11 @@ void ProcessCheckAccountPasswordQuery(TConnection *Connection, TReadBuffer *Buff
 	}
 
 	// NOTE(fusion): Similar to `ProcessLoginAccountQuery`.
-	int Result = CheckAccountPasswordTransaction(AccountID, Password, IPAddress);
+	int Result = CheckAccountPasswordTransaction(Connection, AccountID, Password, IPAddress);
+	if(Result == -2){
+		return;
+	}
+
 	InsertLoginAttempt(AccountID, IPAddress, (Result != 0));
 	if(Result == -1){
 		SendQueryStatusFailed(Connection);
@@ -584,7 +1420,8 @@ void ProcessCheckAccountPasswordQuery(TConnection *Connection, TReadBuffer *Buff
 	}
 }
 
-int LoginAccountTransaction(int AccountID, const char *Password, int IPAddress,
+int LoginAccountTransaction(TConnection *Connection, int AccountID,
+		const char *Password, int IPAddress,
 		DynamicArray<TCharacterEndpoint> *Characters, int *PremiumDays){
 	TransactionScope Tx("LoginAccount");
 	if(!Tx.Begin()){
@@ -600,7 +1437,10 @@ int LoginAccountTransaction(int AccountID, const char *Password, int IPAddress,
 		return 1;
 	}
 
-	if(!TestPassword(Account.Auth, sizeof(Account.Auth), Password)){
+	int PasswordResult = CheckConnectionPassword(Connection, &Account, Password);
+	if(PasswordResult == -1){
+		return -2;
+	}else if(PasswordResult == 0){
 		return 2;
 	}
 
@@ -646,9 +1486,12 @@ void ProcessLoginAccountQuery(TConnection *Connection, TReadBuffer *Buffer){
 	}
 
 	int PremiumDays = 0;
-	DynamicArray<TCharacterEndpoint> Characters;
-	int Result = LoginAccountTransaction(AccountID, Password,
+	DynamicArray<TCharacterEndpoint> Characters(&Connection->Arena);
+	int Result = LoginAccountTransaction(Connection, AccountID, Password,
 			IPAddress, &Characters, &PremiumDays);
+	if(Result == -2){
+		return;
+	}
 
 	// NOTE(fusion): Similar to `ProcessLoginGameQuery` except we don't modify
 	// any tables inside the login transaction.
@@ -687,10 +1530,11 @@ void ProcessLoginAdminQuery(TConnection *Connection, TReadBuffer *Buffer){
 	SendQueryStatusFailed(Connection);
 }
 
-static int LoginGameTransaction(int WorldID, int AccountID, const char *CharacterName,
-		const char *Password, int IPAddress, bool PrivateWorld, bool GamemasterRequired,
+static int LoginGameTransaction(TConnection *Connection, int WorldID,
+		int AccountID, const char *CharacterName, const char *Password,
+		int IPAddress, bool PrivateWorld, bool GamemasterRequired,
 		TCharacterLoginData *Character, DynamicArray<TAccountBuddy> *Buddies,
-		DynamicArray<TCharacterRight> *Rights, bool *PremiumAccountActivated){
+		DynamicArray<const char*> *Rights, bool *PremiumAccountActivated){
 	TransactionScope Tx("LoginGame");
 	if(!Tx.Begin()){
 		return -1;
@@ -732,7 +1576,10 @@ static int LoginGameTransaction(int WorldID, int AccountID, const char *Characte
 		return 8;
 	}
 
-	if(!TestPassword(Account.Auth, sizeof(Account.Auth), Password)){
+	int PasswordResult = CheckConnectionPassword(Connection, &Account, Password);
+	if(PasswordResult == -1){
+		return -2;
+	}else if(PasswordResult == 0){
 		return 6;
 	}
 
@@ -757,14 +1604,14 @@ static int LoginGameTransaction(int WorldID, int AccountID, const char *Characte
 	}
 
 	// TODO(fusion): Probably merge these into a single operation?
-	if(!GetCharacterRight(Character->CharacterID, "ALLOW_MULTICLIENT")
+	if(!CheckCharacterRight(Character->CharacterID, RIGHT_ALLOW_MULTICLIENT)
 			&& GetAccountOnlineCharacters(Account.AccountID) > 0
 			&& !IsCharacterOnline(Character->CharacterID)){
 		return 13;
 	}
 
 	if(GamemasterRequired){
-		if(!GetCharacterRight(Character->CharacterID, "GAMEMASTER_OUTFIT")){
+		if(!CheckCharacterRight(Character->CharacterID, RIGHT_GAMEMASTER_OUTFIT)){
 			return 14;
 		}
 	}
@@ -773,7 +1620,7 @@ static int LoginGameTransaction(int WorldID, int AccountID, const char *Characte
 		return -1;
 	}
 
-	if(!GetCharacterRights(Character->CharacterID, Rights)){
+	if(!GetCharacterRightNames(Character->CharacterID, &Connection->Arena, Rights)){
 		return -1;
 	}
 
@@ -788,7 +1635,7 @@ static int LoginGameTransaction(int WorldID, int AccountID, const char *Characte
 	}
 
 	if(Account.PremiumDays > 0){
-		Rights->Push(TCharacterRight{"PREMIUM_ACCOUNT"});
+		Rights->Push("PREMIUM_ACCOUNT");
 	}
 
 	if(!IncrementIsOnline(WorldID, Character->CharacterID)){
@@ -826,13 +1673,18 @@ void ProcessLoginGameQuery(TConnection *Connection, TReadBuffer *Buffer){
 	}
 
 	TCharacterLoginData Character;
-	DynamicArray<TAccountBuddy> Buddies;
-	DynamicArray<TCharacterRight> Rights;
+	DynamicArray<TAccountBuddy> Buddies(&Connection->Arena);
+	DynamicArray<const char*> Rights(&Connection->Arena);
 	bool PremiumAccountActivated = false;
-	int Result = LoginGameTransaction(Connection->WorldID, AccountID,
+	int Result = LoginGameTransaction(Connection, Connection->WorldID, AccountID,
 			CharacterName, Password, IPAddress, PrivateWorld,
 			GamemasterRequired, &Character, &Buddies, &Rights,
 			&PremiumAccountActivated);
+	if(Result == -2){
+		// NOTE(fusion): The password check was deferred and the whole query
+		// will be processed again once it's done.
+		return;
+	}
 
 	// IMPORTANT(fusion): We need to insert login attempts outside the login game
 	// transaction or we could end up not having it recorded at all due to rollbacks.
@@ -869,7 +1721,7 @@ void ProcessLoginGameQuery(TConnection *Connection, TReadBuffer *Buffer){
 	int NumRights = std::min<int>(Rights.Length(), UINT8_MAX);
 	WriteBuffer.Write8((uint8)NumRights);
 	for(int i = 0; i < NumRights; i += 1){
-		WriteBuffer.WriteString(Rights[i].Name);
+		WriteBuffer.WriteString(Rights[i]);
 	}
 
 	WriteBuffer.WriteFlag(PremiumAccountActivated);
@@ -936,7 +1788,7 @@ void ProcessSetNamelockQuery(TConnection *Connection, TReadBuffer *Buffer){
 	}
 
 	// TODO(fusion): Might be `NO_BANISHMENT`.
-	if(GetCharacterRight(CharacterID, "NAMELOCK")){
+	if(CheckCharacterRight(CharacterID, RIGHT_NAMELOCK)){
 		SendQueryStatusError(Connection, 2);
 		return;
 	}
@@ -996,7 +1848,7 @@ void ProcessBanishAccountQuery(TConnection *Connection, TReadBuffer *Buffer){
 	}
 
 	// TODO(fusion): Might be `NO_BANISHMENT`.
-	if(GetCharacterRight(CharacterID, "BANISHMENT")){
+	if(CheckCharacterRight(CharacterID, RIGHT_BANISHMENT)){
 		SendQueryStatusError(Connection, 2);
 		return;
 	}
@@ -1063,7 +1915,7 @@ void ProcessSetNotationQuery(TConnection *Connection, TReadBuffer *Buffer){
 	}
 
 	// TODO(fusion): Might be `NO_BANISHMENT`.
-	if(!GetCharacterRight(CharacterID, "NOTATION")){
+	if(!CheckCharacterRight(CharacterID, RIGHT_NOTATION)){
 		SendQueryStatusError(Connection, 2);
 		return;
 	}
@@ -1126,7 +1978,7 @@ void ProcessReportStatementQuery(TConnection *Connection, TReadBuffer *Buffer){
 	}
 
 	TStatement *ReportedStatement = NULL;
-	TStatement *Statements = (TStatement*)alloca(NumStatements * sizeof(TStatement));
+	TStatement *Statements = ArenaAllocArray<TStatement>(&Connection->Arena, NumStatements);
 	for(int i = 0; i < NumStatements; i += 1){
 		Statements[i].StatementID = (int)Buffer->Read32();
 		Statements[i].Timestamp = (int)Buffer->Read32();
@@ -1225,7 +2077,7 @@ void ProcessBanishIPAddressQuery(TConnection *Connection, TReadBuffer *Buffer){
 	}
 
 	// TODO(fusion): Might be `NO_BANISHMENT`.
-	if(!GetCharacterRight(CharacterID, "IP_BANISHMENT")){
+	if(!CheckCharacterRight(CharacterID, RIGHT_IP_BANISHMENT)){
 		SendQueryStatusError(Connection, 2);
 		return;
 	}
@@ -1323,7 +2175,7 @@ void ProcessFinishAuctionsQuery(TConnection *Connection, TReadBuffer *Buffer){
 		return;
 	}
 
-	DynamicArray<THouseAuction> Auctions;
+	DynamicArray<THouseAuction> Auctions(&Connection->Arena);
 	if(!FinishHouseAuctions(Connection->WorldID, &Auctions)){
 		SendQueryStatusFailed(Connection);
 		return;
@@ -1347,7 +2199,7 @@ void ProcessTransferHousesQuery(TConnection *Connection, TReadBuffer *Buffer){
 		return;
 	}
 
-	DynamicArray<THouseTransfer> Transfers;
+	DynamicArray<THouseTransfer> Transfers(&Connection->Arena);
 	if(!FinishHouseTransfers(Connection->WorldID, &Transfers)){
 		SendQueryStatusFailed(Connection);
 		return;
@@ -1371,7 +2223,7 @@ void ProcessEvictFreeAccountsQuery(TConnection *Connection, TReadBuffer *Buffer)
 		return;
 	}
 
-	DynamicArray<THouseEviction> Evictions;
+	DynamicArray<THouseEviction> Evictions(&Connection->Arena);
 	if(!GetFreeAccountEvictions(Connection->WorldID, &Evictions)){
 		SendQueryStatusFailed(Connection);
 		return;
@@ -1393,7 +2245,7 @@ void ProcessEvictDeletedCharactersQuery(TConnection *Connection, TReadBuffer *Bu
 		return;
 	}
 
-	DynamicArray<THouseEviction> Evictions;
+	DynamicArray<THouseEviction> Evictions(&Connection->Arena);
 	if(!GetDeletedCharacterEvictions(Connection->WorldID, &Evictions)){
 		SendQueryStatusFailed(Connection);
 		return;
@@ -1419,21 +2271,24 @@ void ProcessEvictExGuildleadersQuery(TConnection *Connection, TReadBuffer *Buffe
 	// send a list of guild houses with their owners and we're supposed to check
 	// whether the owner is still a guild leader. I don't think we should check
 	// any other information as the server is authoritative on house information.
-	DynamicArray<int> Evictions;
 	int NumGuildHouses = Buffer->Read16();
+	THouseEviction *GuildHouses = ArenaAllocArray<THouseEviction>(&Connection->Arena, NumGuildHouses);
 	for(int i = 0; i < NumGuildHouses; i += 1){
-		int HouseID = Buffer->Read16();
-		int OwnerID = (int)Buffer->Read32();
-		if(!GetGuildLeaderStatus(Connection->WorldID, OwnerID)){
-			Evictions.Push(HouseID);
-		}
+		GuildHouses[i].HouseID = Buffer->Read16();
+		GuildHouses[i].OwnerID = (int)Buffer->Read32();
+	}
+
+	DynamicArray<THouseEviction> Evictions(&Connection->Arena);
+	if(!GetExGuildLeaderEvictions(Connection->WorldID, NumGuildHouses, GuildHouses, &Evictions)){
+		SendQueryStatusFailed(Connection);
+		return;
 	}
 
 	TWriteBuffer WriteBuffer = PrepareResponse(Connection, QUERY_STATUS_OK);
 	int NumEvictions = std::min<int>(Evictions.Length(), UINT16_MAX);
 	WriteBuffer.Write16((uint16)NumEvictions);
 	for(int i = 0; i < NumEvictions; i += 1){
-		WriteBuffer.Write16((uint16)Evictions[i]);
+		WriteBuffer.Write16((uint16)Evictions[i].HouseID);
 	}
 	SendResponse(Connection, &WriteBuffer);
 }
@@ -1493,8 +2348,8 @@ void ProcessGetHouseOwnersQuery(TConnection *Connection, TReadBuffer *Buffer){
 		return;
 	}
 
-	DynamicArray<THouseOwner> Owners;
-	if(!GetHouseOwners(Connection->WorldID, &Owners)){
+	DynamicArray<THouseOwner> Owners(&Connection->Arena);
+	if(!GetHouseOwners(Connection->WorldID, &Connection->Arena, &Owners)){
 		SendQueryStatusFailed(Connection);
 		return;
 	}
@@ -1505,7 +2360,7 @@ void ProcessGetHouseOwnersQuery(TConnection *Connection, TReadBuffer *Buffer){
 	for(int i = 0; i < NumOwners; i += 1){
 		WriteBuffer.Write16((uint16)Owners[i].HouseID);
 		WriteBuffer.Write32((uint32)Owners[i].OwnerID);
-		WriteBuffer.WriteString(Owners[i].OwnerName);
+		WriteBuffer.WriteStringRef(Owners[i].OwnerName);
 		WriteBuffer.Write32((uint32)Owners[i].PaidUntil);
 	}
 	SendResponse(Connection, &WriteBuffer);
@@ -1517,7 +2372,7 @@ void ProcessGetAuctionsQuery(TConnection *Connection, TReadBuffer *Buffer){
 		return;
 	}
 
-	DynamicArray<int> Auctions;
+	DynamicArray<int> Auctions(&Connection->Arena);
 	if(!GetHouseAuctions(Connection->WorldID, &Auctions)){
 		SendQueryStatusFailed(Connection);
 		return;
@@ -1566,7 +2421,7 @@ void ProcessInsertHousesQuery(TConnection *Connection, TReadBuffer *Buffer){
 
 	int NumHouses = Buffer->Read16();
 	if(NumHouses > 0){
-		THouse *Houses = (THouse*)alloca(NumHouses * sizeof(THouse));
+		THouse *Houses = ArenaAllocArray<THouse>(&Connection->Arena, NumHouses);
 		for(int i = 0; i < NumHouses; i += 1){
 			Houses[i].HouseID = Buffer->Read16();
 			Buffer->ReadString(Houses[i].Name, sizeof(Houses[i].Name));
@@ -1617,43 +2472,41 @@ void ProcessCreatePlayerlistQuery(TConnection *Connection, TReadBuffer *Buffer){
 		return;
 	}
 
-	TransactionScope Tx("OnlineList");
-	if(!Tx.Begin()){
-		SendQueryStatusFailed(Connection);
-		return;
-	}
-
-	if(!DeleteOnlineCharacters(Connection->WorldID)){
-		SendQueryStatusFailed(Connection);
-		return;
-	}
-
 	// TODO(fusion): I think `NumCharacters` may be used to signal that the
 	// server is going OFFLINE, in which case we'd have to add an `Online`
 	// column to `Worlds` and update it here.
 
-	bool NewRecord = false;
+	// NOTE(fusion): The list is parsed straight into its final storage, which
+	// is then handed over to the in-memory online list. The database is only
+	// touched to check the online record.
+	TOnlineListEntry *Characters = NULL;
 	int NumCharacters = Buffer->Read16();
 	if(NumCharacters != 0xFFFF && NumCharacters > 0){
-		TOnlineCharacter *Characters = (TOnlineCharacter*)alloca(NumCharacters * sizeof(TOnlineCharacter));
+		Characters = (TOnlineListEntry*)malloc(sizeof(TOnlineListEntry) * (usize)NumCharacters);
+		if(Characters == NULL){
+			PANIC("Failed to allocate online list with %d characters", NumCharacters);
+			return;
+		}
+
 		for(int i = 0; i < NumCharacters; i += 1){
 			Buffer->ReadString(Characters[i].Name, sizeof(Characters[i].Name));
 			Characters[i].Level = Buffer->Read16();
 			Buffer->ReadString(Characters[i].Profession, sizeof(Characters[i].Profession));
 		}
+	}else{
+		NumCharacters = 0;
+	}
 
-		if(!InsertOnlineCharacters(Connection->WorldID, NumCharacters, Characters)){
-			SendQueryStatusFailed(Connection);
-			return;
-		}
-
-		if(!CheckOnlineRecord(Connection->WorldID, NumCharacters, &NewRecord)){
-			SendQueryStatusFailed(Connection);
-			return;
-		}
+	// NOTE(fusion): Don't replace the online list with a truncated one.
+	if(Buffer->Overflowed()){
+		free(Characters);
+		SendQueryStatusFailed(Connection);
+		return;
 	}
 
-	if(!Tx.Commit()){
+	bool NewRecord = false;
+	NumCharacters = ReplaceOnlineCharacters(Connection->WorldID, 0, NumCharacters, Characters);
+	if(NumCharacters > 0 && !CheckOnlineRecord(Connection->WorldID, NumCharacters, &NewRecord)){
 		SendQueryStatusFailed(Connection);
 		return;
 	}
@@ -1670,29 +2523,16 @@ void ProcessLogKilledCreaturesQuery(TConnection *Connection, TReadBuffer *Buffer
 	}
 
 	int NumStats = Buffer->Read16();
-	TKillStatistics *Stats = (TKillStatistics*)alloca(NumStats * sizeof(TKillStatistics));
+	TKillStatistics *Stats = ArenaAllocArray<TKillStatistics>(&Connection->Arena, NumStats);
 	for(int i = 0; i < NumStats; i += 1){
 		Buffer->ReadString(Stats[i].RaceName, sizeof(Stats[i].RaceName));
 		Stats[i].PlayersKilled = (int)Buffer->Read32();
 		Stats[i].TimesKilled = (int)Buffer->Read32();
 	}
 
-	if(NumStats > 0){
-		TransactionScope Tx("LogKilledCreatures");
-		if(!Tx.Begin()){
-			SendQueryStatusFailed(Connection);
-			return;
-		}
-
-		if(!MergeKillStatistics(Connection->WorldID, NumStats, Stats)){
-			SendQueryStatusFailed(Connection);
-			return;
-		}
-
-		if(!Tx.Commit()){
-			SendQueryStatusFailed(Connection);
-			return;
-		}
+	if(!LogKillStatistics(Connection->WorldID, NumStats, Stats)){
+		SendQueryStatusFailed(Connection);
+		return;
 	}
 
 	SendQueryStatusOk(Connection);
@@ -1707,10 +2547,12 @@ void ProcessLoadPlayersQuery(TConnection *Connection, TReadBuffer *Buffer){
 	// IMPORTANT(fusion): The server expect 10K entries at most. It is probably
 	// some shared hard coded constant.
 	int NumEntries;
-	TCharacterIndexEntry Entries[10000];
+	int MaxEntries = 10000;
+	TCharacterIndexEntry *Entries = ArenaAllocArray<TCharacterIndexEntry>(
+			&Connection->Arena, MaxEntries);
 	int MinimumCharacterID = (int)Buffer->Read32();
-	if(!GetCharacterIndexEntries(Connection->WorldID,
-			MinimumCharacterID, NARRAY(Entries), &NumEntries, Entries)){
+	if(!GetCharacterIndexEntries(Connection->WorldID, MinimumCharacterID,
+			&Connection->Arena, MaxEntries, &NumEntries, Entries)){
 		SendQueryStatusFailed(Connection);
 		return;
 	}
@@ -1718,7 +2560,7 @@ void ProcessLoadPlayersQuery(TConnection *Connection, TReadBuffer *Buffer){
 	TWriteBuffer WriteBuffer = PrepareResponse(Connection, QUERY_STATUS_OK);
 	WriteBuffer.Write32((uint32)NumEntries);
 	for(int i = 0; i < NumEntries; i += 1){
-		WriteBuffer.WriteString(Entries[i].Name);
+		WriteBuffer.WriteStringRef(Entries[i].Name);
 		WriteBuffer.Write32((uint32)Entries[i].CharacterID);
 	}
 	SendResponse(Connection, &WriteBuffer);
@@ -1803,6 +2645,77 @@ void ProcessLoadWorldConfigQuery(TConnection *Connection, TReadBuffer *Buffer){
 	SendResponse(Connection, &WriteBuffer);
 }
 
+void ProcessUpdatePlayerlistQuery(TConnection *Connection, TReadBuffer *Buffer){
+	if(Connection->ApplicationType != APPLICATION_TYPE_GAME){
+		SendQueryStatusFailed(Connection);
+		return;
+	}
+
+	// NOTE(fusion): Same as `ProcessCreatePlayerlistQuery` except the game server
+	// may only send what changed since the list with `BaseSequence`. A full list
+	// has no removed characters and replaces the current one, while a delta that
+	// doesn't match the current list fails with error 1 so the game server can
+	// fall back to sending the full list.
+	bool Full = Buffer->ReadFlag();
+	uint32 BaseSequence = Buffer->Read32();
+	uint32 Sequence = Buffer->Read32();
+
+	int NumRemoved = Buffer->Read16();
+	TOnlineListEntry *Removed = ArenaAllocArray<TOnlineListEntry>(&Connection->Arena, NumRemoved);
+	for(int i = 0; i < NumRemoved; i += 1){
+		Buffer->ReadString(Removed[i].Name, sizeof(Removed[i].Name));
+	}
+
+	int NumUpdated = Buffer->Read16();
+	TOnlineListEntry *Updated;
+	if(Full){
+		Updated = (TOnlineListEntry*)malloc(sizeof(TOnlineListEntry) * (usize)std::max<int>(NumUpdated, 1));
+		if(Updated == NULL){
+			PANIC("Failed to allocate online list with %d characters", NumUpdated);
+			return;
+		}
+	}else{
+		Updated = ArenaAllocArray<TOnlineListEntry>(&Connection->Arena, NumUpdated);
+	}
+
+	for(int i = 0; i < NumUpdated; i += 1){
+		Buffer->ReadString(Updated[i].Name, sizeof(Updated[i].Name));
+		Updated[i].Level = Buffer->Read16();
+		Buffer->ReadString(Updated[i].Profession, sizeof(Updated[i].Profession));
+	}
+
+	if(Sequence == 0 || Buffer->Overflowed()){
+		if(Full){
+			free(Updated);
+		}
+		SendQueryStatusFailed(Connection);
+		return;
+	}
+
+	int NumCharacters;
+	if(Full){
+		NumCharacters = ReplaceOnlineCharacters(Connection->WorldID,
+				Sequence, NumUpdated, Updated);
+	}else{
+		NumCharacters = UpdateOnlineCharacters(Connection->WorldID,
+				BaseSequence, Sequence, NumRemoved, Removed, NumUpdated, Updated);
+		if(NumCharacters == -1){
+			SendQueryStatusError(Connection, 1);
+			return;
+		}
+	}
+
+	bool NewRecord = false;
+	if(NumCharacters > 0 && !CheckOnlineRecord(Connection->WorldID, NumCharacters, &NewRecord)){
+		SendQueryStatusFailed(Connection);
+		return;
+	}
+
+	TWriteBuffer WriteBuffer = PrepareResponse(Connection, QUERY_STATUS_OK);
+	WriteBuffer.WriteFlag(NewRecord);
+	SendResponse(Connection, &WriteBuffer);
+}
+
 void ProcessCreateAccountQuery(TConnection *Connection, TReadBuffer *Buffer){
 	// TODO(fusion): We'd ideally want to automatically generate an account number
 	// and return it in case of success but that would also require a more robust
@@ -1819,7 +2732,7 @@ void ProcessCreateAccountQuery(TConnection *Connection, TReadBuffer *Buffer){
 		return;
 	}
 
-	uint8 Auth[64];
+	uint8 Auth[AUTH_SIZE];
 	if(!GenerateAuth(Password, Auth, sizeof(Auth))){
 		SendQueryStatusFailed(Connection);
 		return;
@@ -1924,7 +2837,7 @@ void ProcessGetAccountSummaryQuery(TConnection *Connection, TReadBuffer *Buffer)
 		return;
 	}
 
-	DynamicArray<TCharacterSummary> Characters;
+	DynamicArray<TCharacterSummary> Characters(&Connection->Arena);
 	if(!GetCharacterSummaries(AccountID, &Characters)){
 		SendQueryStatusFailed(Connection);
 		return;
@@ -1986,23 +2899,15 @@ void ProcessGetCharacterProfileQuery(TConnection *Connection, TReadBuffer *Buffe
 }
 
 void ProcessGetWorldsQuery(TConnection *Connection, TReadBuffer *Buffer){
-	DynamicArray<TWorld> Worlds;
-	if(!GetWorlds(&Worlds)){
+	const uint8 *Response;
+	int ResponseLength;
+	if(!GetWorldsResponse(&Response, &ResponseLength)){
 		SendQueryStatusFailed(Connection);
 		return;
 	}
 
 	TWriteBuffer WriteBuffer = PrepareResponse(Connection, QUERY_STATUS_OK);
-	int NumWorlds = std::min<int>(Worlds.Length(), UINT8_MAX);
-	WriteBuffer.Write8((uint8)NumWorlds);
-	for(int i = 0; i < NumWorlds; i += 1){
-		WriteBuffer.WriteString(Worlds[i].Name);
-		WriteBuffer.Write8((uint8)Worlds[i].Type);
-		WriteBuffer.Write16((uint16)Worlds[i].NumPlayers);
-		WriteBuffer.Write16((uint16)Worlds[i].MaxPlayers);
-		WriteBuffer.Write16((uint16)Worlds[i].OnlineRecord);
-		WriteBuffer.Write32((uint32)Worlds[i].OnlineRecordTimestamp);
-	}
+	WriteBuffer.WriteBytes(Response, ResponseLength);
 	SendResponse(Connection, &WriteBuffer);
 }
 
@@ -2016,20 +2921,15 @@ void ProcessGetOnlineCharactersQuery(TConnection *Connection, TReadBuffer *Buffe
 		return;
 	}
 
-	DynamicArray<TOnlineCharacter> Characters;
-	if(!GetOnlineCharacters(WorldID, &Characters)){
+	const uint8 *Response;
+	int ResponseLength;
+	if(!GetOnlineCharactersResponse(WorldID, &Response, &ResponseLength)){
 		SendQueryStatusFailed(Connection);
 		return;
 	}
 
 	TWriteBuffer WriteBuffer = PrepareResponse(Connection, QUERY_STATUS_OK);
-	int NumCharacters = std::min<int>(Characters.Length(), UINT16_MAX);
-	WriteBuffer.Write16((uint16)NumCharacters);
-	for(int i = 0; i < NumCharacters; i += 1){
-		WriteBuffer.WriteString(Characters[i].Name);
-		WriteBuffer.Write16((uint16)Characters[i].Level);
-		WriteBuffer.WriteString(Characters[i].Profession);
-	}
+	WriteBuffer.WriteBytes(Response, ResponseLength);
 	SendResponse(Connection, &WriteBuffer);
 }
 
@@ -2043,8 +2943,32 @@ void ProcessGetKillStatisticsQuery(TConnection *Connection, TReadBuffer *Buffer)
 		return;
 	}
 
-	DynamicArray<TKillStatistics> Stats;
-	if(!GetKillStatistics(WorldID, &Stats)){
+	const uint8 *Response;
+	int ResponseLength;
+	if(!GetKillStatisticsResponse(WorldID, &Response, &ResponseLength)){
+		SendQueryStatusFailed(Connection);
+		return;
+	}
+
+	TWriteBuffer WriteBuffer = PrepareResponse(Connection, QUERY_STATUS_OK);
+	WriteBuffer.WriteBytes(Response, ResponseLength);
+	SendResponse(Connection, &WriteBuffer);
+}
+
+void ProcessGetKillStatisticsHistoryQuery(TConnection *Connection, TReadBuffer *Buffer){
+	char WorldName[30];
+	Buffer->ReadString(WorldName, sizeof(WorldName));
+	int From = (int)Buffer->Read32();
+	int To = (int)Buffer->Read32();
+
+	int WorldID = GetWorldID(WorldName);
+	if(WorldID == 0 || From >= To){
+		SendQueryStatusFailed(Connection);
+		return;
+	}
+
+	DynamicArray<TKillStatistics> Stats(&Connection->Arena);
+	if(!GetKillStatisticsWindow(WorldID, From, To, &Stats)){
 		SendQueryStatusFailed(Connection);
 		return;
 	}
@@ -2060,12 +2984,45 @@ void ProcessGetKillStatisticsQuery(TConnection *Connection, TReadBuffer *Buffer)
 	SendResponse(Connection, &WriteBuffer);
 }
 
+void ProcessGetHighscoresQuery(TConnection *Connection, TReadBuffer *Buffer){
+	char WorldName[30];
+	char CharacterName[30];
+	Buffer->ReadString(WorldName, sizeof(WorldName));
+	int FirstRank = (int)Buffer->Read32();
+	int MaxEntries = std::min<int>(Buffer->Read16(), HIGHSCORES_MAX_PAGE_SIZE);
+	Buffer->ReadString(CharacterName, sizeof(CharacterName));
+
+	int WorldID = GetWorldID(WorldName);
+	if(WorldID == 0 || FirstRank < 1){
+		SendQueryStatusFailed(Connection);
+		return;
+	}
+
+	int NumEntries, CharacterRank;
+	DynamicArray<THighscoreEntry> Entries(&Connection->Arena);
+	if(!GetHighscores(WorldID, FirstRank, MaxEntries, CharacterName,
+			&NumEntries, &CharacterRank, &Entries)){
+		SendQueryStatusFailed(Connection);
+		return;
+	}
+
+	TWriteBuffer WriteBuffer = PrepareResponse(Connection, QUERY_STATUS_OK);
+	WriteBuffer.Write32((uint32)NumEntries);
+	WriteBuffer.Write32((uint32)CharacterRank);
+	WriteBuffer.Write16((uint16)Entries.Length());
+	for(int i = 0; i < Entries.Length(); i += 1){
+		WriteBuffer.Write32((uint32)Entries[i].Rank);
+		WriteBuffer.WriteString(Entries[i].Name);
+		WriteBuffer.Write16((uint16)Entries[i].Level);
+		WriteBuffer.WriteString(Entries[i].Profession);
+	}
+	SendResponse(Connection, &WriteBuffer);
+}
+
 void ProcessConnectionQuery(TConnection *Connection){
-	// TODO(fusion): Ideally we'd create a new query and dispatch it to the
-	// database thread for processing. Realistically, it wouldn't make a big
-	// difference since we're already handling connections asynchronously and
-	// the only blocking system calls are done by SQLite when interacting with
-	// the disk.
+	// NOTE(fusion): This is always called from the main thread, either directly
+	// while polling connections or when processing queries forwarded by network
+	// threads. Database access is NOT thread safe so it MUST stay that way.
 
 	TReadBuffer Buffer(Connection->Buffer, Connection->RWSize);
 	uint8 Query = Buffer.Read8();
@@ -2113,6 +3070,7 @@ void ProcessConnectionQuery(TConnection *Connection){
 		case QUERY_EXCLUDE_FROM_AUCTIONS:		ProcessExcludeFromAuctionsQuery(Connection, &Buffer); break;
 		case QUERY_CANCEL_HOUSE_TRANSFER:		ProcessCancelHouseTransferQuery(Connection, &Buffer); break;
 		case QUERY_LOAD_WORLD_CONFIG:			ProcessLoadWorldConfigQuery(Connection, &Buffer); break;
+		case QUERY_UPDATE_PLAYERLIST:			ProcessUpdatePlayerlistQuery(Connection, &Buffer); break;
 		case QUERY_CREATE_ACCOUNT:				ProcessCreateAccountQuery(Connection, &Buffer); break;
 		case QUERY_CREATE_CHARACTER:			ProcessCreateCharacterQuery(Connection, &Buffer); break;
 		case QUERY_GET_ACCOUNT_SUMMARY:			ProcessGetAccountSummaryQuery(Connection, &Buffer); break;
@@ -2120,6 +3078,8 @@ void ProcessConnectionQuery(TConnection *Connection){
 		case QUERY_GET_WORLDS:					ProcessGetWorldsQuery(Connection, &Buffer); break;
 		case QUERY_GET_ONLINE_CHARACTERS:		ProcessGetOnlineCharactersQuery(Connection, &Buffer); break;
 		case QUERY_GET_KILL_STATISTICS:			ProcessGetKillStatisticsQuery(Connection, &Buffer); break;
+		case QUERY_GET_KILL_STATISTICS_HISTORY:	ProcessGetKillStatisticsHistoryQuery(Connection, &Buffer); break;
+		case QUERY_GET_HIGHSCORES:				ProcessGetHighscoresQuery(Connection, &Buffer); break;
 		default:{
 			LOG_ERR("Unknown query %d from %s", Query, Connection->RemoteAddress);
 			SendQueryStatusFailed(Connection);
@@ -0,0 +1,154 @@
+#include "querymanager.hh"
+
+#if OS_LINUX
+#	include <pthread.h>
+#	include <signal.h>
+#else
+#	error "Operating system not currently supported."
+#endif
+
+// NOTE(fusion): Password checks are the most expensive part of login queries
+// and don't need the database, so they may be handed to a small pool of worker
+// threads instead of running on the main thread. Workers take whatever jobs are
+// queued, up to `CRYPTO_BATCH_SIZE` at a time, so concurrent logins are hashed
+// together with `TestPasswordBatch`. Results are handed back through each job's
+// callback, which is called from the worker thread.
+#define CRYPTO_BATCH_SIZE 8
+
+static pthread_mutex_t g_CryptoMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_CryptoCond = PTHREAD_COND_INITIALIZER;
+static TCryptoJob *g_CryptoHead;
+static TCryptoJob *g_CryptoTail;
+static bool g_StopCryptoThreads;
+static int g_NumCryptoThreads;
+static pthread_t *g_CryptoThreadHandles;
+
+static void *CryptoThread(void *Arg){
+	(void)Arg;
+	while(true){
+		TCryptoJob *Batch[CRYPTO_BATCH_SIZE];
+		int BatchSize = 0;
+
+		pthread_mutex_lock(&g_CryptoMutex);
+		while(g_CryptoHead == NULL && !g_StopCryptoThreads){
+			pthread_cond_wait(&g_CryptoCond, &g_CryptoMutex);
+		}
+
+		if(g_StopCryptoThreads){
+			pthread_mutex_unlock(&g_CryptoMutex);
+			break;
+		}
+
+		while(g_CryptoHead != NULL && BatchSize < CRYPTO_BATCH_SIZE){
+			Batch[BatchSize] = g_CryptoHead;
+			g_CryptoHead = g_CryptoHead->Next;
+			Batch[BatchSize]->Next = NULL;
+			BatchSize += 1;
+		}
+
+		if(g_CryptoHead == NULL){
+			g_CryptoTail = NULL;
+		}
+		pthread_mutex_unlock(&g_CryptoMutex);
+
+		const uint8 *Auths[CRYPTO_BATCH_SIZE];
+		int AuthSizes[CRYPTO_BATCH_SIZE];
+		const char *Passwords[CRYPTO_BATCH_SIZE];
+		bool Results[CRYPTO_BATCH_SIZE];
+		for(int i = 0; i < BatchSize; i += 1){
+			Auths[i] = Batch[i]->Auth;
+			AuthSizes[i] = Batch[i]->AuthSize;
+			Passwords[i] = Batch[i]->Password;
+		}
+
+		TestPasswordBatch(BatchSize, Auths, AuthSizes, Passwords, Results);
+		for(int i = 0; i < BatchSize; i += 1){
+			TCryptoJob *Job = Batch[i];
+			Job->Result = Results[i];
+			if(Job->Rehash){
+				Job->Rehash = Job->Result && GenerateAuth(Job->Password,
+						Job->NewAuth, sizeof(Job->NewAuth));
+			}
+			Job->Callback(Job);
+		}
+	}
+
+	return NULL;
+}
+
+bool CryptoPoolEnabled(void){
+	return g_NumCryptoThreads > 0;
+}
+
+void SubmitCryptoJob(TCryptoJob *Job){
+	ASSERT(Job != NULL && Job->Callback != NULL);
+	ASSERT(CryptoPoolEnabled());
+	Job->Next = NULL;
+	pthread_mutex_lock(&g_CryptoMutex);
+	if(g_CryptoTail != NULL){
+		g_CryptoTail->Next = Job;
+	}else{
+		g_CryptoHead = Job;
+	}
+	g_CryptoTail = Job;
+	pthread_cond_signal(&g_CryptoCond);
+	pthread_mutex_unlock(&g_CryptoMutex);
+}
+
+bool InitCryptoPool(void){
+	ASSERT(g_CryptoThreadHandles == NULL);
+	LOG("Crypto threads: %d", g_CryptoThreads);
+	if(g_CryptoThreads < 0){
+		LOG_ERR("Invalid number of crypto threads %d", g_CryptoThreads);
+		return false;
+	}
+
+	if(g_CryptoThreads == 0){
+		return true;
+	}
+
+	// NOTE(fusion): Signals should be handled by the main thread so we block
+	// them while creating crypto threads, which inherit the signal mask.
+	sigset_t SignalMask, OldSignalMask;
+	sigfillset(&SignalMask);
+	pthread_sigmask(SIG_BLOCK, &SignalMask, &OldSignalMask);
+
+	bool Result = true;
+	g_StopCryptoThreads = false;
+	g_CryptoThreadHandles = (pthread_t*)calloc(g_CryptoThreads, sizeof(pthread_t));
+	for(int i = 0; i < g_CryptoThreads; i += 1){
+		int ErrCode = pthread_create(&g_CryptoThreadHandles[i], NULL, CryptoThread, NULL);
+		if(ErrCode != 0){
+			LOG_ERR("Failed to create crypto thread %d: (%d) %s",
+					i, ErrCode, strerrordesc_np(ErrCode));
+			Result = false;
+			break;
+		}
+
+		g_NumCryptoThreads += 1;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &OldSignalMask, NULL);
+	return Result;
+}
+
+void ExitCryptoPool(void){
+	if(g_CryptoThreadHandles != NULL){
+		pthread_mutex_lock(&g_CryptoMutex);
+		g_StopCryptoThreads = true;
+		pthread_cond_broadcast(&g_CryptoCond);
+		pthread_mutex_unlock(&g_CryptoMutex);
+
+		for(int i = 0; i < g_NumCryptoThreads; i += 1){
+			pthread_join(g_CryptoThreadHandles[i], NULL);
+		}
+
+		// NOTE(fusion): Jobs still queued are dropped. Their connections are
+		// closed on exit anyway.
+		free(g_CryptoThreadHandles);
+		g_CryptoThreadHandles = NULL;
+		g_NumCryptoThreads = 0;
+		g_CryptoHead = NULL;
+		g_CryptoTail = NULL;
+	}
+}
@@ -110,6 +110,39 @@ bool InitStatementCache(void){
 	return true;
 }
 
+void ResizeStatementCache(int NewMaxCachedStatements){
+	ASSERT(g_CachedStatements != NULL && NewMaxCachedStatements > 0);
+
+	// NOTE(fusion): Keep the most recently used statements when shrinking.
+	if(NewMaxCachedStatements < g_MaxCachedStatements){
+		std::sort(g_CachedStatements, g_CachedStatements + g_MaxCachedStatements,
+				[](const TCachedStatement &A, const TCachedStatement &B){
+					return A.LastUsed > B.LastUsed;
+				});
+
+		for(int i = NewMaxCachedStatements; i < g_MaxCachedStatements; i += 1){
+			if(g_CachedStatements[i].Stmt != NULL){
+				sqlite3_finalize(g_CachedStatements[i].Stmt);
+			}
+		}
+	}
+
+	TCachedStatement *NewCachedStatements = (TCachedStatement*)realloc(
+			g_CachedStatements, sizeof(TCachedStatement) * (usize)NewMaxCachedStatements);
+	if(NewCachedStatements == NULL){
+		PANIC("Failed to resize statement cache from %d to %d",
+				g_MaxCachedStatements, NewMaxCachedStatements);
+		return;
+	}
+
+	for(int i = g_MaxCachedStatements; i < NewMaxCachedStatements; i += 1){
+		memset(&NewCachedStatements[i], 0, sizeof(TCachedStatement));
+	}
+
+	g_CachedStatements = NewCachedStatements;
+	g_MaxCachedStatements = NewMaxCachedStatements;
+}
+
 void ExitStatementCache(void){
 	if(g_CachedStatements != NULL){
 		for(int i = 0; i < g_MaxCachedStatements; i += 1){
@@ -128,6 +161,62 @@ void ExitStatementCache(void){
 	}
 }
 
+// Bulk Queries
+//==============================================================================
+// NOTE(fusion): Inserting rows one at a time means a full `bind -> step -> reset`
+// round trip through the VDBE for each row. Multi-row statements amortize that
+// over `BULK_QUERY_ROWS` rows at a time, with any remainder split into power of
+// two batches so there are only a handful of different statements per query,
+// all of which go through the statement cache. Parameters are numbered by row,
+// so row R, column C (both zero based) is bound to `R * NumColumns + C + 1`.
+//	The same `VALUES` list also works as a table expression (e.g. inside a CTE)
+// for lookups that take a list of keys, so they can be answered with a single
+// join instead of one query per key.
+#define BULK_QUERY_ROWS 64
+
+static int BulkBatchRows(int RemainingRows){
+	ASSERT(RemainingRows > 0);
+	if(RemainingRows >= BULK_QUERY_ROWS){
+		return BULK_QUERY_ROWS;
+	}
+
+	int BatchRows = 1;
+	while((BatchRows * 2) <= RemainingRows){
+		BatchRows *= 2;
+	}
+	return BatchRows;
+}
+
+static sqlite3_stmt *PrepareBulkQuery(const char *Head, int NumColumns, const char *Tail, int NumRows){
+	ASSERT(Head != NULL && Tail != NULL);
+	ASSERT(NumColumns > 0 && NumRows > 0 && NumRows <= BULK_QUERY_ROWS);
+	char Text[16384];
+	int Length = snprintf(Text, sizeof(Text), "%s VALUES ", Head);
+	for(int Row = 0; Row < NumRows; Row += 1){
+		for(int Column = 0; Column < NumColumns; Column += 1){
+			if((usize)Length >= sizeof(Text)){
+				break;
+			}
+
+			Length += snprintf(Text + Length, sizeof(Text) - (usize)Length, "%s?%d%s",
+					(Column == 0 ? (Row == 0 ? "(" : ", (") : ", "),
+					(Row * NumColumns + Column + 1),
+					(Column == (NumColumns - 1) ? ")" : ""));
+		}
+	}
+
+	if((usize)Length < sizeof(Text)){
+		Length += snprintf(Text + Length, sizeof(Text) - (usize)Length, "%s", Tail);
+	}
+
+	if((usize)Length >= sizeof(Text)){
+		LOG_ERR("Bulk query too long (%d rows of %d columns)", NumRows, NumColumns);
+		return NULL;
+	}
+
+	return PrepareQuery(Text);
+}
+
 // TransactionScope
 //==============================================================================
 TransactionScope::TransactionScope(const char *Context){
@@ -136,8 +225,21 @@ TransactionScope::TransactionScope(const char *Context){
 }
 
 TransactionScope::~TransactionScope(void){
-	if(m_Running && !ExecInternal("ROLLBACK")){
-		LOG_ERR("Failed to rollback transaction (%s)", m_Context);
+	if(m_Running){
+		if(!ExecInternal("ROLLBACK")){
+			LOG_ERR("Failed to rollback transaction (%s)", m_Context);
+		}
+
+		// NOTE(fusion): Banishments, characters, and levels are added to the
+		// ban cache, name index, and highscores as soon as they're written, so
+		// they need to be undone if they're rolled back. Same for the record
+		// cache, which may have picked up rows written by the transaction, and
+		// for online records in the world cache.
+		RollbackBanCache();
+		RollbackRecordCache();
+		RollbackWorldCache();
+		RollbackHighscores();
+		RollbackNameIndex();
 	}
 }
 
@@ -152,6 +254,11 @@ bool TransactionScope::Begin(void){
 		return false;
 	}
 
+	MarkBanCache();
+	MarkRecordCache();
+	MarkWorldCache();
+	MarkHighscores();
+	MarkNameIndex();
 	m_Running = true;
 	return true;
 }
@@ -171,42 +278,72 @@ bool TransactionScope::Commit(void){
 	return true;
 }
 
-// Primary tables
+// Row Estimates
 //==============================================================================
-int GetWorldID(const char *WorldName){
-	ASSERT(WorldName != NULL);
+// NOTE(fusion): Average number of rows matching a single value of an index's
+// leftmost column, taken from the statistics gathered by `ANALYZE`, which is
+// run by `PRAGMA optimize` when needed. They're only used as capacity hints
+// for result arrays so it's fine if they're stale or missing.
+struct TRowEstimate{
+	char Index[64];
+	int RowsPerKey;
+};
+
+static TRowEstimate g_RowEstimates[64];
+static int g_NumRowEstimates = 0;
+
+void LoadRowEstimates(void){
+	g_NumRowEstimates = 0;
+
+	// NOTE(fusion): `sqlite_stat1` is only created by the first `ANALYZE`.
+	if(sqlite3_table_column_metadata(g_Database, NULL, "sqlite_stat1",
+			"stat", NULL, NULL, NULL, NULL, NULL) != SQLITE_OK){
+		return;
+	}
+
 	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT WorldID FROM Worlds WHERE Name = ?1");
+			"SELECT idx, stat FROM sqlite_stat1 WHERE idx IS NOT NULL");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
-		return false;
+		return;
 	}
 
 	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_text(Stmt, 1, WorldName, -1, NULL) != SQLITE_OK){
-		LOG_ERR("Failed to bind WorldName: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
+	while(sqlite3_step(Stmt) == SQLITE_ROW
+			&& g_NumRowEstimates < NARRAY(g_RowEstimates)){
+		const char *Stat = (const char*)sqlite3_column_text(Stmt, 1);
+		int Rows, RowsPerKey;
+		if(Stat == NULL || sscanf(Stat, "%d %d", &Rows, &RowsPerKey) != 2){
+			continue;
+		}
 
-	int ErrorCode = sqlite3_step(Stmt);
-	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
-		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
-		return 0;
+		TRowEstimate *Estimate = &g_RowEstimates[g_NumRowEstimates];
+		if(StringCopy(Estimate->Index, sizeof(Estimate->Index),
+				(const char*)sqlite3_column_text(Stmt, 0))){
+			Estimate->RowsPerKey = std::min<int>(std::max<int>(RowsPerKey, 0), 4096);
+			g_NumRowEstimates += 1;
+		}
 	}
+}
 
-	return (ErrorCode == SQLITE_ROW ? sqlite3_column_int(Stmt, 0) : 0);
+int EstimateRowsPerKey(const char *Index){
+	for(int i = 0; i < g_NumRowEstimates; i += 1){
+		if(StringEq(g_RowEstimates[i].Index, Index)){
+			return g_RowEstimates[i].RowsPerKey;
+		}
+	}
+	return 0;
 }
 
-bool GetWorlds(DynamicArray<TWorld> *Worlds){
+// Primary tables
+//==============================================================================
+bool GetWorldRecords(DynamicArray<TWorldRecord> *Worlds){
 	ASSERT(Worlds != NULL);
 	sqlite3_stmt *Stmt = PrepareQuery(
-			"WITH N (WorldID, NumPlayers) AS ("
-				"SELECT WorldID, COUNT(*) FROM OnlineCharacters GROUP BY WorldID"
-			")"
-			" SELECT W.Name, W.Type, COALESCE(N.NumPlayers, 0), W.MaxPlayers,"
-				" W.OnlineRecord, W.OnlineRecordTimestamp"
-			" FROM Worlds AS W"
-			" LEFT JOIN N ON W.WorldID = N.WorldID");
+			"SELECT WorldID, Name, Type, RebootTime, Host, Port, MaxPlayers,"
+				" PremiumPlayerBuffer, MaxNewbies, PremiumNewbieBuffer,"
+				" OnlineRecord, OnlineRecordTimestamp"
+			" FROM Worlds");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
@@ -214,14 +351,23 @@ bool GetWorlds(DynamicArray<TWorld> *Worlds){
 
 	AutoStmtReset StmtReset(Stmt);
 	while(sqlite3_step(Stmt) == SQLITE_ROW){
-		TWorld World = {};
+		TWorldRecord World = {};
+		World.WorldID = sqlite3_column_int(Stmt, 0);
 		StringCopy(World.Name, sizeof(World.Name),
-				(const char*)sqlite3_column_text(Stmt, 0));
-		World.Type = sqlite3_column_int(Stmt, 1);
-		World.NumPlayers = sqlite3_column_int(Stmt, 2);
-		World.MaxPlayers = sqlite3_column_int(Stmt, 3);
-		World.OnlineRecord = sqlite3_column_int(Stmt, 4);
-		World.OnlineRecordTimestamp = sqlite3_column_int(Stmt, 5);
+				(const char*)sqlite3_column_text(Stmt, 1));
+		World.Type = sqlite3_column_int(Stmt, 2);
+		World.RebootTime = sqlite3_column_int(Stmt, 3);
+		if(!StringCopy(World.Host, sizeof(World.Host),
+				(const char*)sqlite3_column_text(Stmt, 4))){
+			LOG_WARN("World \"%s\" host name is too long", World.Name);
+		}
+		World.Port = sqlite3_column_int(Stmt, 5);
+		World.MaxPlayers = sqlite3_column_int(Stmt, 6);
+		World.PremiumPlayerBuffer = sqlite3_column_int(Stmt, 7);
+		World.MaxNewbies = sqlite3_column_int(Stmt, 8);
+		World.PremiumNewbieBuffer = sqlite3_column_int(Stmt, 9);
+		World.OnlineRecord = sqlite3_column_int(Stmt, 10);
+		World.OnlineRecordTimestamp = sqlite3_column_int(Stmt, 11);
 		Worlds->Push(World);
 	}
 
@@ -233,46 +379,6 @@ bool GetWorlds(DynamicArray<TWorld> *Worlds){
 	return true;
 }
 
-bool GetWorldConfig(int WorldID, TWorldConfig *WorldConfig){
-	ASSERT(WorldConfig != NULL);
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT Type, RebootTime, Host, Port, MaxPlayers,"
-				" PremiumPlayerBuffer, MaxNewbies, PremiumNewbieBuffer"
-			" FROM Worlds WHERE WorldID = ?1");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
-		return false;
-	}
-
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK){
-		LOG_ERR("Failed to bind WorldID: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	if(sqlite3_step(Stmt) != SQLITE_ROW){
-		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	int IPAddress;
-	const char *HostName = (const char*)sqlite3_column_text(Stmt, 2);
-	if(HostName == NULL || !ResolveHostName(HostName, &IPAddress)){
-		LOG_ERR("Failed to resolve world %d host name \"%s\"", WorldID, HostName);
-		return false;
-	}
-
-	WorldConfig->Type					= sqlite3_column_int(Stmt, 0);
-	WorldConfig->RebootTime				= sqlite3_column_int(Stmt, 1);
-	WorldConfig->IPAddress				= IPAddress;
-	WorldConfig->Port					= sqlite3_column_int(Stmt, 3);
-	WorldConfig->MaxPlayers				= sqlite3_column_int(Stmt, 4);
-	WorldConfig->PremiumPlayerBuffer	= sqlite3_column_int(Stmt, 5);
-	WorldConfig->MaxNewbies				= sqlite3_column_int(Stmt, 6);
-	WorldConfig->PremiumNewbieBuffer	= sqlite3_column_int(Stmt, 7);
-	return true;
-}
-
 bool AccountExists(int AccountID, const char *Email){
 	ASSERT(Email != NULL);
 	sqlite3_stmt *Stmt = PrepareQuery(
@@ -369,14 +475,44 @@ bool CreateAccount(int AccountID, const char *Email, const uint8 *Auth, int Auth
 		return false;
 	}
 
-	return (ErrCode == SQLITE_DONE);
+	if(ErrCode != SQLITE_DONE){
+		return false;
+	}
+
+	// NOTE(fusion): Same as with new characters in `CreateCharacter`.
+	DropCachedAccount(AccountID);
+	return true;
 }
 
-bool GetAccountData(int AccountID, TAccount *Account){
-	ASSERT(Account != NULL);
+bool UpdateAccountAuth(int AccountID, const uint8 *Auth, int AuthSize){
+	ASSERT(Auth != NULL && AuthSize > 0);
 	sqlite3_stmt *Stmt = PrepareQuery(
-		"SELECT AccountID, Email, Auth,"
-			" MAX(PremiumEnd - UNIXEPOCH(), 0),"
+			"UPDATE Accounts SET Auth = ?2 WHERE AccountID = ?1");
+	if(Stmt == NULL){
+		LOG_ERR("Failed to prepare query");
+		return false;
+	}
+
+	AutoStmtReset StmtReset(Stmt);
+	if(sqlite3_bind_int(Stmt, 1, AccountID)             != SQLITE_OK
+	|| sqlite3_bind_blob(Stmt, 2, Auth, AuthSize, NULL) != SQLITE_OK){
+		LOG_ERR("Failed to bind parameters: %s", sqlite3_errmsg(g_Database));
+		return false;
+	}
+
+	if(sqlite3_step(Stmt) != SQLITE_DONE){
+		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+		return false;
+	}
+
+	DropCachedAccount(AccountID);
+	return true;
+}
+
+static bool LoadAccountRecord(int AccountID, TAccountRecord *Account, bool *Found){
+	ASSERT(Account != NULL && Found != NULL);
+	sqlite3_stmt *Stmt = PrepareQuery(
+		"SELECT AccountID, Email, Auth, PremiumEnd,"
 			" PendingPremiumDays, Deleted"
 		" FROM Accounts WHERE AccountID = ?1");
 	if(Stmt == NULL){
@@ -396,15 +532,18 @@ bool GetAccountData(int AccountID, TAccount *Account){
 		return false;
 	}
 
-	memset(Account, 0, sizeof(TAccount));
+	memset(Account, 0, sizeof(TAccountRecord));
+	*Found = (ErrorCode == SQLITE_ROW);
 	if(ErrorCode == SQLITE_ROW){
 		Account->AccountID = sqlite3_column_int(Stmt, 0);
 		StringCopy(Account->Email, sizeof(Account->Email),
 				(const char*)sqlite3_column_text(Stmt, 1));
-		if(sqlite3_column_bytes(Stmt, 2) == sizeof(Account->Auth)){
-			memcpy(Account->Auth, sqlite3_column_blob(Stmt, 2), sizeof(Account->Auth));
+		int AuthSize = sqlite3_column_bytes(Stmt, 2);
+		if(AuthSize > 0 && AuthSize <= (int)sizeof(Account->Auth)){
+			memcpy(Account->Auth, sqlite3_column_blob(Stmt, 2), AuthSize);
+			Account->AuthSize = AuthSize;
 		}
-		Account->PremiumDays = RoundSecondsToDays(sqlite3_column_int(Stmt, 3));
+		Account->PremiumEnd = sqlite3_column_int(Stmt, 3);
 		Account->PendingPremiumDays = sqlite3_column_int(Stmt, 4);
 		Account->Deleted = (sqlite3_column_int(Stmt, 5) != 0);
 	}
@@ -412,6 +551,53 @@ bool GetAccountData(int AccountID, TAccount *Account){
 	return true;
 }
 
+static bool GetAccountRecord(int AccountID, TAccountRecord *Account, bool *Found){
+	ASSERT(Account != NULL && Found != NULL);
+	if(FindCachedAccount(AccountID, Account)){
+		*Found = true;
+		return true;
+	}
+
+	// NOTE(fusion): Accounts that don't exist aren't cached, since they're
+	// usually about to be created.
+	if(!LoadAccountRecord(AccountID, Account, Found)){
+		return false;
+	}
+
+	if(*Found){
+		CacheAccount(Account);
+	}
+
+	return true;
+}
+
+static int GetPremiumSeconds(int PremiumEnd){
+	// NOTE(fusion): Same as `MAX(PremiumEnd - UNIXEPOCH(), 0)`.
+	return std::max<int>(PremiumEnd - (int)time(NULL), 0);
+}
+
+bool GetAccountData(int AccountID, TAccount *Account){
+	ASSERT(Account != NULL);
+	bool Found;
+	TAccountRecord Record;
+	if(!GetAccountRecord(AccountID, &Record, &Found)){
+		return false;
+	}
+
+	memset(Account, 0, sizeof(TAccount));
+	if(Found){
+		Account->AccountID = Record.AccountID;
+		memcpy(Account->Email, Record.Email, sizeof(Account->Email));
+		memcpy(Account->Auth, Record.Auth, sizeof(Account->Auth));
+		Account->AuthSize = Record.AuthSize;
+		Account->PremiumDays = RoundSecondsToDays(GetPremiumSeconds(Record.PremiumEnd));
+		Account->PendingPremiumDays = Record.PendingPremiumDays;
+		Account->Deleted = Record.Deleted;
+	}
+
+	return true;
+}
+
 int GetAccountOnlineCharacters(int AccountID){
 	sqlite3_stmt *Stmt = PrepareQuery(
 		"SELECT COUNT(*) FROM Characters"
@@ -485,59 +671,104 @@ bool ActivatePendingPremiumDays(int AccountID){
 		return false;
 	}
 
+	DropCachedAccount(AccountID);
 	return true;
 }
 
-bool GetCharacterEndpoints(int AccountID, DynamicArray<TCharacterEndpoint> *Characters){
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT C.Name, W.Name, W.Host, W.Port"
-			" FROM Characters AS C"
-			" INNER JOIN Worlds AS W ON W.WorldID = C.WorldID"
-			" WHERE C.AccountID = ?1");
+// NOTE(fusion): Characters are always loaded as whole rows, along with their
+// world, so they can be cached and used for any of the character getters.
+#define CHARACTER_RECORD_QUERY											\
+	"SELECT C.CharacterID, C.WorldID, C.AccountID, C.Name, C.Sex,"		\
+		" C.Guild, C.Rank, C.Title, C.Level, C.Profession, C.Residence,"	\
+		" C.LastLoginTime, C.IsOnline, C.Deleted, W.WorldID, W.Name"		\
+	" FROM Characters AS C"												\
+	" LEFT JOIN Worlds AS W ON W.WorldID = C.WorldID"
+
+static void ReadCharacterRecord(sqlite3_stmt *Stmt, TCharacterRecord *Character){
+	ASSERT(Stmt != NULL && Character != NULL);
+	memset(Character, 0, sizeof(TCharacterRecord));
+	Character->CharacterID = sqlite3_column_int(Stmt, 0);
+	Character->WorldID = sqlite3_column_int(Stmt, 1);
+	Character->AccountID = sqlite3_column_int(Stmt, 2);
+	StringCopy(Character->Name, sizeof(Character->Name),
+			(const char*)sqlite3_column_text(Stmt, 3));
+	Character->Sex = sqlite3_column_int(Stmt, 4);
+	StringCopy(Character->Guild, sizeof(Character->Guild),
+			(const char*)sqlite3_column_text(Stmt, 5));
+	StringCopy(Character->Rank, sizeof(Character->Rank),
+			(const char*)sqlite3_column_text(Stmt, 6));
+	StringCopy(Character->Title, sizeof(Character->Title),
+			(const char*)sqlite3_column_text(Stmt, 7));
+	Character->Level = sqlite3_column_int(Stmt, 8);
+	StringCopy(Character->Profession, sizeof(Character->Profession),
+			(const char*)sqlite3_column_text(Stmt, 9));
+	StringCopy(Character->Residence, sizeof(Character->Residence),
+			(const char*)sqlite3_column_text(Stmt, 10));
+	Character->LastLoginTime = sqlite3_column_int(Stmt, 11);
+	Character->IsOnline = sqlite3_column_int(Stmt, 12);
+	Character->Deleted = (sqlite3_column_int(Stmt, 13) != 0);
+	Character->HasWorld = (sqlite3_column_type(Stmt, 14) != SQLITE_NULL);
+	StringCopy(Character->WorldName, sizeof(Character->WorldName),
+			(const char*)sqlite3_column_text(Stmt, 15));
+}
+
+static bool GetCharacterRecord(const char *CharacterName, TCharacterRecord *Character, bool *Found){
+	ASSERT(CharacterName != NULL && Character != NULL && Found != NULL);
+	if(FindCachedCharacter(CharacterName, Character)){
+		*Found = true;
+		return true;
+	}
+
+	// NOTE(fusion): Names that don't exist are answered by the name index.
+	if(FindCharacterName(CharacterName, Found, NULL, NULL) && !*Found){
+		memset(Character, 0, sizeof(TCharacterRecord));
+		return true;
+	}
+
+	sqlite3_stmt *Stmt = PrepareQuery(CHARACTER_RECORD_QUERY " WHERE C.Name = ?1");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
 	}
 
 	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, AccountID) != SQLITE_OK){
-		LOG_ERR("Failed to bind AccountID: %s", sqlite3_errmsg(g_Database));
+	if(sqlite3_bind_text(Stmt, 1, CharacterName, -1, NULL) != SQLITE_OK){
+		LOG_ERR("Failed to bind CharacterName: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
-	while(sqlite3_step(Stmt) == SQLITE_ROW){
-		int WorldAddress;
-		const char *CharacterName = (const char*)sqlite3_column_text(Stmt, 0);
-		const char *WorldName = (const char*)sqlite3_column_text(Stmt, 1);
-		const char *HostName = (const char*)sqlite3_column_text(Stmt, 2);
-		if(HostName == NULL || !ResolveHostName(HostName, &WorldAddress)){
-			LOG_ERR("Failed to resolve world \"%s\" host name \"%s\" for character \"%s\"",
-					WorldName, HostName, CharacterName);
-			continue;
-		}
-
-		TCharacterEndpoint Character = {};
-		StringCopy(Character.Name, sizeof(Character.Name), CharacterName);
-		StringCopy(Character.WorldName, sizeof(Character.WorldName), WorldName);
-		Character.WorldAddress = WorldAddress;
-		Character.WorldPort = sqlite3_column_int(Stmt, 3);
-		Characters->Push(Character);
-	}
-
-	if(sqlite3_errcode(g_Database) != SQLITE_DONE){
+	int ErrorCode = sqlite3_step(Stmt);
+	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
 		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
+	memset(Character, 0, sizeof(TCharacterRecord));
+	*Found = (ErrorCode == SQLITE_ROW);
+	if(ErrorCode == SQLITE_ROW){
+		ReadCharacterRecord(Stmt, Character);
+		CacheCharacter(Character);
+	}
+
 	return true;
 }
 
-bool GetCharacterSummaries(int AccountID, DynamicArray<TCharacterSummary> *Characters){
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT C.Name, W.Name, C.Level, C.Profession, C.IsOnline, C.Deleted"
-			" FROM Characters AS C"
-			" LEFT JOIN Worlds AS W ON W.WorldID = C.WorldID"
-			" WHERE C.AccountID = ?1");
+static bool GetAccountCharacterRecords(int AccountID, DynamicArray<TCharacterRecord> *Characters){
+	ASSERT(Characters != NULL);
+	if(FindCachedAccountCharacters(AccountID, Characters)){
+		return true;
+	}
+
+	// NOTE(fusion): Make sure the account is cached so it can hold on to the
+	// character list.
+	bool Found;
+	TAccountRecord Account;
+	if(!GetAccountRecord(AccountID, &Account, &Found)){
+		return false;
+	}
+
+	sqlite3_stmt *Stmt = PrepareQuery(CHARACTER_RECORD_QUERY
+			" WHERE C.AccountID = ?1 ORDER BY C.CharacterID");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
@@ -549,17 +780,11 @@ bool GetCharacterSummaries(int AccountID, DynamicArray<TCharacterSummary> *Chara
 		return false;
 	}
 
+	int First = Characters->Length();
+	Characters->Reserve(First + EstimateRowsPerKey("CharactersAccountIndex"));
 	while(sqlite3_step(Stmt) == SQLITE_ROW){
-		TCharacterSummary Character = {};
-		StringCopy(Character.Name, sizeof(Character.Name),
-				(const char*)sqlite3_column_text(Stmt, 0));
-		StringCopy(Character.World, sizeof(Character.World),
-				(const char*)sqlite3_column_text(Stmt, 1));
-		Character.Level = sqlite3_column_int(Stmt, 2);
-		StringCopy(Character.Profession, sizeof(Character.Profession),
-				(const char*)sqlite3_column_text(Stmt, 3));
-		Character.Online = (sqlite3_column_int(Stmt, 4) != 0);
-		Character.Deleted = (sqlite3_column_int(Stmt, 5) != 0);
+		TCharacterRecord Character;
+		ReadCharacterRecord(Stmt, &Character);
 		Characters->Push(Character);
 	}
 
@@ -568,11 +793,73 @@ bool GetCharacterSummaries(int AccountID, DynamicArray<TCharacterSummary> *Chara
 		return false;
 	}
 
+	CacheAccountCharacters(AccountID, Characters->Length() - First,
+			Characters->begin() + First);
+	return true;
+}
+
+bool GetCharacterEndpoints(int AccountID, DynamicArray<TCharacterEndpoint> *Characters){
+	ASSERT(Characters != NULL);
+	DynamicArray<TCharacterRecord> Records;
+	if(!GetAccountCharacterRecords(AccountID, &Records)){
+		return false;
+	}
+
+	Characters->Reserve(Characters->Length() + Records.Length());
+	for(int i = 0; i < Records.Length(); i += 1){
+		const TCharacterRecord *Record = &Records[i];
+		if(!Record->HasWorld){
+			continue;
+		}
+
+		int WorldAddress, WorldPort;
+		if(!GetWorldEndpoint(Record->WorldID, &WorldAddress, &WorldPort)){
+			LOG_ERR("Failed to get world \"%s\" endpoint for character \"%s\"",
+					Record->WorldName, Record->Name);
+			continue;
+		}
+
+		TCharacterEndpoint Character = {};
+		memcpy(Character.Name, Record->Name, sizeof(Character.Name));
+		memcpy(Character.WorldName, Record->WorldName, sizeof(Character.WorldName));
+		Character.WorldAddress = WorldAddress;
+		Character.WorldPort = WorldPort;
+		Characters->Push(Character);
+	}
+
+	return true;
+}
+
+bool GetCharacterSummaries(int AccountID, DynamicArray<TCharacterSummary> *Characters){
+	ASSERT(Characters != NULL);
+	DynamicArray<TCharacterRecord> Records;
+	if(!GetAccountCharacterRecords(AccountID, &Records)){
+		return false;
+	}
+
+	Characters->Reserve(Characters->Length() + Records.Length());
+	for(int i = 0; i < Records.Length(); i += 1){
+		const TCharacterRecord *Record = &Records[i];
+		TCharacterSummary Character = {};
+		memcpy(Character.Name, Record->Name, sizeof(Character.Name));
+		memcpy(Character.World, Record->WorldName, sizeof(Character.World));
+		Character.Level = Record->Level;
+		memcpy(Character.Profession, Record->Profession, sizeof(Character.Profession));
+		Character.Online = (Record->IsOnline != 0);
+		Character.Deleted = Record->Deleted;
+		Characters->Push(Character);
+	}
+
 	return true;
 }
 
 bool CharacterNameExists(const char *Name){
 	ASSERT(Name != NULL);
+	bool Found;
+	if(FindCharacterName(Name, &Found, NULL, NULL)){
+		return Found;
+	}
+
 	sqlite3_stmt *Stmt = PrepareQuery(
 			"SELECT 1 FROM Characters WHERE Name = ?1");
 	if(Stmt == NULL){
@@ -620,11 +907,29 @@ bool CreateCharacter(int WorldID, int AccountID, const char *Name, int Sex){
 		return false;
 	}
 
-	return (ErrCode == SQLITE_DONE);
+	if(ErrCode != SQLITE_DONE){
+		return false;
+	}
+
+	// NOTE(fusion): The new character can't be cached yet but dropping it makes
+	// sure it's dropped again if the transaction is rolled back after it was
+	// loaded.
+	int CharacterID = (int)sqlite3_last_insert_rowid(g_Database);
+	DropCachedCharacter(CharacterID);
+	DropCachedAccountCharacters(AccountID);
+	InsertCharacterName(CharacterID, WorldID, Name);
+	InsertHighscore(WorldID, CharacterID, Name, 0, "");
+	return true;
 }
 
 int GetCharacterID(int WorldID, const char *CharacterName){
 	ASSERT(CharacterName != NULL);
+	bool Found;
+	int CharacterID, CharacterWorldID;
+	if(FindCharacterName(CharacterName, &Found, &CharacterID, &CharacterWorldID)){
+		return (Found && CharacterWorldID == WorldID ? CharacterID : 0);
+	}
+
 	sqlite3_stmt *Stmt = PrepareQuery(
 			"SELECT CharacterID FROM Characters"
 			" WHERE WorldID = ?1 AND Name = ?2");
@@ -651,42 +956,23 @@ int GetCharacterID(int WorldID, const char *CharacterName){
 
 bool GetCharacterLoginData(const char *CharacterName, TCharacterLoginData *Character){
 	ASSERT(CharacterName != NULL && Character != NULL);
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT WorldID, CharacterID, AccountID, Name,"
-				" Sex, Guild, Rank, Title, Deleted"
-			" FROM Characters WHERE Name = ?1");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
-		return 0;
-	}
-
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_text(Stmt, 1, CharacterName, -1, NULL) != SQLITE_OK){
-		LOG_ERR("Failed to bind CharacterName: %s", sqlite3_errmsg(g_Database));
-		return 0;
-	}
-
-	int ErrorCode = sqlite3_step(Stmt);
-	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
-		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
-		return 0;
+	bool Found;
+	TCharacterRecord Record;
+	if(!GetCharacterRecord(CharacterName, &Record, &Found)){
+		return false;
 	}
 
 	memset(Character, 0, sizeof(TCharacterLoginData));
-	if(ErrorCode == SQLITE_ROW){
-		Character->WorldID = sqlite3_column_int(Stmt, 0);
-		Character->CharacterID = sqlite3_column_int(Stmt, 1);
-		Character->AccountID = sqlite3_column_int(Stmt, 2);
-		StringCopy(Character->Name, sizeof(Character->Name),
-				(const char*)sqlite3_column_text(Stmt, 3));
-		Character->Sex = sqlite3_column_int(Stmt, 4);
-		StringCopy(Character->Guild, sizeof(Character->Guild),
-				(const char*)sqlite3_column_text(Stmt, 5));
-		StringCopy(Character->Rank, sizeof(Character->Rank),
-				(const char*)sqlite3_column_text(Stmt, 6));
-		StringCopy(Character->Title, sizeof(Character->Title),
-				(const char*)sqlite3_column_text(Stmt, 7));
-		Character->Deleted = (sqlite3_column_int(Stmt, 8) != 0);
+	if(Found){
+		Character->WorldID = Record.WorldID;
+		Character->CharacterID = Record.CharacterID;
+		Character->AccountID = Record.AccountID;
+		memcpy(Character->Name, Record.Name, sizeof(Character->Name));
+		Character->Sex = Record.Sex;
+		memcpy(Character->Guild, Record.Guild, sizeof(Character->Guild));
+		memcpy(Character->Rank, Record.Rank, sizeof(Character->Rank));
+		memcpy(Character->Title, Record.Title, sizeof(Character->Title));
+		Character->Deleted = Record.Deleted;
 	}
 
 	return true;
@@ -694,85 +980,41 @@ bool GetCharacterLoginData(const char *CharacterName, TCharacterLoginData *Chara
 
 bool GetCharacterProfile(const char *CharacterName, TCharacterProfile *Character){
 	ASSERT(CharacterName != NULL && Character != NULL);
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT C.Name, W.Name, C.Sex, C.Guild, C.Rank, C.Title, C.Level,"
-				" C.Profession, C.Residence, C.LastLoginTime, C.IsOnline,"
-				" C.Deleted, MAX(A.PremiumEnd - UNIXEPOCH(), 0)"
-			" FROM Characters AS C"
-			" LEFT JOIN Worlds AS W ON W.WorldID = C.WorldID"
-			" LEFT JOIN Accounts AS A ON A.AccountID = C.AccountID"
-			" LEFT JOIN CharacterRights AS R"
-				" ON R.CharacterID = C.CharacterID"
-				" AND R.Right = 'NO_STATISTICS'"
-			" WHERE C.Name = ?1 AND R.Right IS NULL");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
-		return false;
-	}
-
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_text(Stmt, 1, CharacterName, -1, NULL) != SQLITE_OK){
-		LOG_ERR("Failed to bind CharacterName: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	int ErrorCode = sqlite3_step(Stmt);
-	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
-		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+	bool Found;
+	TCharacterRecord Record;
+	if(!GetCharacterRecord(CharacterName, &Record, &Found)){
 		return false;
 	}
 
+	// NOTE(fusion): Characters with `NO_STATISTICS` don't have a profile.
 	memset(Character, 0, sizeof(TCharacterProfile));
-	if(ErrorCode == SQLITE_ROW){
-		StringCopy(Character->Name, sizeof(Character->Name),
-				(const char*)sqlite3_column_text(Stmt, 0));
-		StringCopy(Character->World, sizeof(Character->World),
-				(const char*)sqlite3_column_text(Stmt, 1));
-		Character->Sex = sqlite3_column_int(Stmt, 2);
-		StringCopy(Character->Guild, sizeof(Character->Guild),
-				(const char*)sqlite3_column_text(Stmt, 3));
-		StringCopy(Character->Rank, sizeof(Character->Rank),
-				(const char*)sqlite3_column_text(Stmt, 4));
-		StringCopy(Character->Title, sizeof(Character->Title),
-				(const char*)sqlite3_column_text(Stmt, 5));
-		Character->Level = sqlite3_column_int(Stmt, 6);
-		StringCopy(Character->Profession, sizeof(Character->Profession),
-				(const char*)sqlite3_column_text(Stmt, 7));
-		StringCopy(Character->Residence, sizeof(Character->Residence),
-				(const char*)sqlite3_column_text(Stmt, 8));
-		Character->LastLogin = sqlite3_column_int(Stmt, 9);
-		Character->Online = (sqlite3_column_int(Stmt, 10) != 0);
-		Character->Deleted = (sqlite3_column_int(Stmt, 11) != 0);
-		Character->PremiumDays = RoundSecondsToDays(sqlite3_column_int(Stmt, 12));
+	if(!Found || CheckCharacterRight(Record.CharacterID, RIGHT_NO_STATISTICS)){
+		return true;
 	}
 
-	return true;
-}
-
-bool GetCharacterRight(int CharacterID, const char *Right){
-	ASSERT(Right != NULL);
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT 1 FROM CharacterRights"
-			" WHERE CharacterID = ?1 AND Right = ?2");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
+	bool AccountFound;
+	TAccountRecord Account;
+	if(!GetAccountRecord(Record.AccountID, &Account, &AccountFound)){
 		return false;
 	}
 
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, CharacterID)      != SQLITE_OK
-	|| sqlite3_bind_text(Stmt, 2, Right, -1, NULL) != SQLITE_OK){
-		LOG_ERR("Failed to bind parameters: %s", sqlite3_errmsg(g_Database));
-		return false;
+	memcpy(Character->Name, Record.Name, sizeof(Character->Name));
+	memcpy(Character->World, Record.WorldName, sizeof(Character->World));
+	Character->Sex = Record.Sex;
+	memcpy(Character->Guild, Record.Guild, sizeof(Character->Guild));
+	memcpy(Character->Rank, Record.Rank, sizeof(Character->Rank));
+	memcpy(Character->Title, Record.Title, sizeof(Character->Title));
+	Character->Level = Record.Level;
+	memcpy(Character->Profession, Record.Profession, sizeof(Character->Profession));
+	memcpy(Character->Residence, Record.Residence, sizeof(Character->Residence));
+	Character->LastLogin = Record.LastLoginTime;
+	Character->Online = (Record.IsOnline != 0);
+	Character->Deleted = Record.Deleted;
+	if(AccountFound){
+		Character->PremiumDays = RoundSecondsToDays(GetPremiumSeconds(Account.PremiumEnd));
 	}
 
-	int ErrorCode = sqlite3_step(Stmt);
-	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
-		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	return (ErrorCode == SQLITE_ROW);
+	return true;
 }
 
 bool GetCharacterRights(int CharacterID, DynamicArray<TCharacterRight> *Rights){
@@ -801,42 +1043,8 @@ bool GetCharacterRights(int CharacterID, DynamicArray<TCharacterRight> *Rights){
 		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
-
-	return true;
-}
-
-bool GetGuildLeaderStatus(int WorldID, int CharacterID){
-	// NOTE(fusion): Same as `DecrementIsOnline`.
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT Guild, Rank FROM Characters"
-			" WHERE WorldID = ?1 AND CharacterID = ?2");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
-		return false;
-	}
-
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK
-	|| sqlite3_bind_int(Stmt, 2, CharacterID) != SQLITE_OK){
-		LOG_ERR("Failed to bind parameters: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	int ErrorCode = sqlite3_step(Stmt);
-	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
-		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	bool Result = false;
-	if(ErrorCode == SQLITE_ROW){
-		const char *Guild = (const char*)sqlite3_column_text(Stmt, 0);
-		const char *Rank = (const char*)sqlite3_column_text(Stmt, 1);
-		if(Guild != NULL && !StringEmpty(Guild) && Rank != NULL && StringEqCI(Rank, "Leader")){
-			Result = true;
-		}
-	}
-	return Result;
+
+	return true;
 }
 
 bool IncrementIsOnline(int WorldID, int CharacterID){
@@ -861,6 +1069,7 @@ bool IncrementIsOnline(int WorldID, int CharacterID){
 		return false;
 	}
 
+	DropCachedCharacter(CharacterID);
 	return sqlite3_changes(g_Database) > 0;
 }
 
@@ -888,6 +1097,7 @@ bool DecrementIsOnline(int WorldID, int CharacterID){
 		return false;
 	}
 
+	DropCachedCharacter(CharacterID);
 	return sqlite3_changes(g_Database) > 0;
 }
 
@@ -912,6 +1122,7 @@ bool ClearIsOnline(int WorldID, int *NumAffectedCharacters){
 		return false;
 	}
 
+	DropCachedWorldCharacters(WorldID);
 	*NumAffectedCharacters = sqlite3_changes(g_Database);
 	return true;
 }
@@ -951,12 +1162,17 @@ bool LogoutCharacter(int WorldID, int CharacterID, int Level,
 		return false;
 	}
 
-	return sqlite3_changes(g_Database) > 0;
+	bool Updated = (sqlite3_changes(g_Database) > 0);
+	DropCachedCharacter(CharacterID);
+	if(Updated){
+		UpdateHighscore(WorldID, CharacterID, Level, Profession);
+	}
+	return Updated;
 }
 
 bool GetCharacterIndexEntries(int WorldID, int MinimumCharacterID,
-		int MaxEntries, int *NumEntries, TCharacterIndexEntry *Entries){
-	ASSERT(MaxEntries > 0 && NumEntries != NULL && Entries != NULL);
+		TArena *Arena, int MaxEntries, int *NumEntries, TCharacterIndexEntry *Entries){
+	ASSERT(Arena != NULL && MaxEntries > 0 && NumEntries != NULL && Entries != NULL);
 	sqlite3_stmt *Stmt = PrepareQuery(
 			"SELECT CharacterID, Name FROM Characters"
 			" WHERE WorldID = ?1 AND CharacterID >= ?2"
@@ -979,8 +1195,7 @@ bool GetCharacterIndexEntries(int WorldID, int MinimumCharacterID,
 	int EntryIndex = 0;
 	while(sqlite3_step(Stmt) == SQLITE_ROW && EntryIndex < MaxEntries){
 		Entries[EntryIndex].CharacterID = sqlite3_column_int(Stmt, 0);
-		StringCopy(Entries[EntryIndex].Name,
-				sizeof(Entries[EntryIndex].Name),
+		Entries[EntryIndex].Name = ArenaStringCopy(Arena,
 				(const char*)sqlite3_column_text(Stmt, 1));
 		EntryIndex += 1;
 	}
@@ -994,6 +1209,69 @@ bool GetCharacterIndexEntries(int WorldID, int MinimumCharacterID,
 	return true;
 }
 
+bool GetCharacterNames(DynamicArray<TCharacterName> *Names){
+	ASSERT(Names != NULL);
+	sqlite3_stmt *Stmt = PrepareQuery(
+			"SELECT CharacterID, WorldID, Name FROM Characters");
+	if(Stmt == NULL){
+		LOG_ERR("Failed to prepare query");
+		return false;
+	}
+
+	AutoStmtReset StmtReset(Stmt);
+	while(sqlite3_step(Stmt) == SQLITE_ROW){
+		TCharacterName Name = {};
+		Name.CharacterID = sqlite3_column_int(Stmt, 0);
+		Name.WorldID = sqlite3_column_int(Stmt, 1);
+		StringCopy(Name.Name, sizeof(Name.Name),
+				(const char*)sqlite3_column_text(Stmt, 2));
+		Names->Push(Name);
+	}
+
+	if(sqlite3_errcode(g_Database) != SQLITE_DONE){
+		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+		return false;
+	}
+
+	return true;
+}
+
+bool GetCharacterHighscores(DynamicArray<TCharacterHighscore> *Characters){
+	ASSERT(Characters != NULL);
+	// NOTE(fusion): Rows come out in rank order from `CharactersHighscoreIndex`,
+	// without touching the table itself.
+	sqlite3_stmt *Stmt = PrepareQuery(
+			"SELECT WorldID, CharacterID, Level, Name, Profession FROM Characters"
+			" WHERE Deleted = 0 AND NOT EXISTS (SELECT 1 FROM CharacterRights"
+				" WHERE CharacterRights.CharacterID = Characters.CharacterID"
+					" AND CharacterRights.Right = 'NO_STATISTICS')"
+			" ORDER BY WorldID ASC, Level DESC, Name ASC");
+	if(Stmt == NULL){
+		LOG_ERR("Failed to prepare query");
+		return false;
+	}
+
+	AutoStmtReset StmtReset(Stmt);
+	while(sqlite3_step(Stmt) == SQLITE_ROW){
+		TCharacterHighscore Character = {};
+		Character.WorldID = sqlite3_column_int(Stmt, 0);
+		Character.CharacterID = sqlite3_column_int(Stmt, 1);
+		Character.Level = sqlite3_column_int(Stmt, 2);
+		StringCopy(Character.Name, sizeof(Character.Name),
+				(const char*)sqlite3_column_text(Stmt, 3));
+		StringCopy(Character.Profession, sizeof(Character.Profession),
+				(const char*)sqlite3_column_text(Stmt, 4));
+		Characters->Push(Character);
+	}
+
+	if(sqlite3_errcode(g_Database) != SQLITE_DONE){
+		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+		return false;
+	}
+
+	return true;
+}
+
 bool InsertCharacterDeath(int WorldID, int CharacterID, int Level,
 		int OffenderID, const char *Remark, bool Unjustified, int Timestamp){
 	ASSERT(Remark != NULL);
@@ -1218,6 +1496,32 @@ int GetIPAddressFailedLoginAttempts(int IPAddress, int TimeWindow){
 	return sqlite3_column_int(Stmt, 0);
 }
 
+bool PruneLoginAttempts(int MaxAge, int *NumDeleted){
+	sqlite3_stmt *Stmt = PrepareQuery(
+		"DELETE FROM LoginAttempts WHERE Timestamp < (UNIXEPOCH() - ?1)");
+	if(Stmt == NULL){
+		LOG_ERR("Failed to prepare query");
+		return false;
+	}
+
+	AutoStmtReset StmtReset(Stmt);
+	if(sqlite3_bind_int(Stmt, 1, MaxAge) != SQLITE_OK){
+		LOG_ERR("Failed to bind parameters: %s", sqlite3_errmsg(g_Database));
+		return false;
+	}
+
+	if(sqlite3_step(Stmt) != SQLITE_DONE){
+		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+		return false;
+	}
+
+	if(NumDeleted){
+		*NumDeleted = sqlite3_changes(g_Database);
+	}
+
+	return true;
+}
+
 // House tables
 //==============================================================================
 bool FinishHouseAuctions(int WorldID, DynamicArray<THouseAuction> *Auctions){
@@ -1366,6 +1670,58 @@ bool GetDeletedCharacterEvictions(int WorldID, DynamicArray<THouseEviction> *Evi
 	return true;
 }
 
+bool GetExGuildLeaderEvictions(int WorldID, int NumGuildHouses,
+		THouseEviction *GuildHouses, DynamicArray<THouseEviction> *Evictions){
+	// NOTE(fusion): Guild houses whose owner doesn't exist or isn't the leader
+	// of a guild anymore, checked in batches instead of one query per house.
+	ASSERT(NumGuildHouses >= 0 && Evictions != NULL);
+	int Done = 0;
+	while(Done < NumGuildHouses){
+		int BatchRows = BulkBatchRows(NumGuildHouses - Done);
+		sqlite3_stmt *Stmt = PrepareBulkQuery(
+				"WITH GuildHouses (WorldID, HouseID, OwnerID) AS (", 3,
+				") SELECT H.HouseID, H.OwnerID"
+				" FROM GuildHouses AS H"
+				" LEFT JOIN Characters AS C"
+					" ON C.CharacterID = H.OwnerID AND C.WorldID = H.WorldID"
+				" WHERE C.CharacterID IS NULL OR C.Guild = '' OR C.Rank != 'Leader'",
+				BatchRows);
+		if(Stmt == NULL){
+			LOG_ERR("Failed to prepare query");
+			return false;
+		}
+
+		AutoStmtReset StmtReset(Stmt);
+		for(int i = 0; i < BatchRows; i += 1){
+			THouseEviction *GuildHouse = &GuildHouses[Done + i];
+			int Param = i * 3;
+			if(sqlite3_bind_int(Stmt, Param + 1, WorldID)             != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 2, GuildHouse->HouseID) != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 3, GuildHouse->OwnerID) != SQLITE_OK){
+				LOG_ERR("Failed to bind parameters for house %d: %s",
+						GuildHouse->HouseID, sqlite3_errmsg(g_Database));
+				return false;
+			}
+		}
+
+		while(sqlite3_step(Stmt) == SQLITE_ROW){
+			THouseEviction Eviction = {};
+			Eviction.HouseID = sqlite3_column_int(Stmt, 0);
+			Eviction.OwnerID = sqlite3_column_int(Stmt, 1);
+			Evictions->Push(Eviction);
+		}
+
+		if(sqlite3_errcode(g_Database) != SQLITE_DONE){
+			LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+			return false;
+		}
+
+		Done += BatchRows;
+	}
+
+	return true;
+}
+
 bool InsertHouseOwner(int WorldID, int HouseID, int OwnerID, int PaidUntil){
 	sqlite3_stmt *Stmt = PrepareQuery(
 			"INSERT INTO HouseOwners (WorldID, HouseID, OwnerID, PaidUntil)"
@@ -1442,8 +1798,8 @@ bool DeleteHouseOwner(int WorldID, int HouseID){
 	return sqlite3_changes(g_Database) > 0;
 }
 
-bool GetHouseOwners(int WorldID, DynamicArray<THouseOwner> *Owners){
-	ASSERT(Owners != NULL);
+bool GetHouseOwners(int WorldID, TArena *Arena, DynamicArray<THouseOwner> *Owners){
+	ASSERT(Arena != NULL && Owners != NULL);
 	sqlite3_stmt *Stmt = PrepareQuery(
 			"SELECT O.HouseID, O.OwnerID, C.Name, O.PaidUntil"
 			" FROM HouseOwners AS O"
@@ -1460,11 +1816,12 @@ bool GetHouseOwners(int WorldID, DynamicArray<THouseOwner> *Owners){
 		return false;
 	}
 
+	Owners->Reserve(Owners->Length() + EstimateRowsPerKey("sqlite_autoindex_HouseOwners_1"));
 	while(sqlite3_step(Stmt) == SQLITE_ROW){
 		THouseOwner Owner = {};
 		Owner.HouseID = sqlite3_column_int(Stmt, 0);
 		Owner.OwnerID = sqlite3_column_int(Stmt, 1);
-		StringCopy(Owner.OwnerName, sizeof(Owner.OwnerName),
+		Owner.OwnerName = ArenaStringCopy(Arena,
 				(const char*)sqlite3_column_text(Stmt, 2));
 		Owner.PaidUntil = sqlite3_column_int(Stmt, 3);
 		Owners->Push(Owner);
@@ -1552,44 +1909,47 @@ bool DeleteHouses(int WorldID){
 
 bool InsertHouses(int WorldID, int NumHouses, THouse *Houses){
 	ASSERT(NumHouses > 0 && Houses != NULL);
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"INSERT INTO Houses (WorldID, HouseID, Name, Rent, Description,"
-				" Size, PositionX, PositionY, PositionZ, Town, GuildHouse)"
-			" VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11)");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
-		return false;
-	}
-
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK){
-		LOG_ERR("Failed to bind WorldID: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	for(int i = 0; i < NumHouses; i += 1){
-		if(sqlite3_bind_int(Stmt, 2, Houses[i].HouseID)                != SQLITE_OK
-		|| sqlite3_bind_text(Stmt, 3, Houses[i].Name, -1, NULL)        != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 4, Houses[i].Rent)                   != SQLITE_OK
-		|| sqlite3_bind_text(Stmt, 5, Houses[i].Description, -1, NULL) != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 6, Houses[i].Size)                   != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 7, Houses[i].PositionX)              != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 8, Houses[i].PositionY)              != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 9, Houses[i].PositionZ)              != SQLITE_OK
-		|| sqlite3_bind_text(Stmt, 10, Houses[i].Town, -1, NULL)       != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 11, Houses[i].GuildHouse ? 1: 0)     != SQLITE_OK){
-			LOG_ERR("Failed to bind parameters for house %d: %s",
-					Houses[i].HouseID, sqlite3_errmsg(g_Database));
+	int Done = 0;
+	while(Done < NumHouses){
+		int BatchRows = BulkBatchRows(NumHouses - Done);
+		sqlite3_stmt *Stmt = PrepareBulkQuery(
+				"INSERT INTO Houses (WorldID, HouseID, Name, Rent, Description,"
+					" Size, PositionX, PositionY, PositionZ, Town, GuildHouse)",
+				11, "", BatchRows);
+		if(Stmt == NULL){
+			LOG_ERR("Failed to prepare query");
 			return false;
 		}
 
+		AutoStmtReset StmtReset(Stmt);
+		for(int i = 0; i < BatchRows; i += 1){
+			THouse *House = &Houses[Done + i];
+			int Param = i * 11;
+			if(sqlite3_bind_int(Stmt, Param + 1, WorldID)                       != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 2, House->HouseID)                != SQLITE_OK
+			|| sqlite3_bind_text(Stmt, Param + 3, House->Name, -1, NULL)        != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 4, House->Rent)                   != SQLITE_OK
+			|| sqlite3_bind_text(Stmt, Param + 5, House->Description, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 6, House->Size)                   != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 7, House->PositionX)              != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 8, House->PositionY)              != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 9, House->PositionZ)              != SQLITE_OK
+			|| sqlite3_bind_text(Stmt, Param + 10, House->Town, -1, NULL)       != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 11, House->GuildHouse ? 1 : 0)    != SQLITE_OK){
+				LOG_ERR("Failed to bind parameters for house %d: %s",
+						House->HouseID, sqlite3_errmsg(g_Database));
+				return false;
+			}
+		}
+
 		if(sqlite3_step(Stmt) != SQLITE_DONE){
-			LOG_ERR("Failed to insert house %d: %s",
-					Houses[i].HouseID, sqlite3_errmsg(g_Database));
+			LOG_ERR("Failed to insert houses %d to %d: %s",
+					Houses[Done].HouseID, Houses[Done + BatchRows - 1].HouseID,
+					sqlite3_errmsg(g_Database));
 			return false;
 		}
 
-		sqlite3_reset(Stmt);
+		Done += BatchRows;
 	}
 
 	return true;
@@ -1687,29 +2047,31 @@ bool InsertNamelock(int CharacterID, int IPAddress, int GamemasterID,
 	return true;
 }
 
-bool IsAccountBanished(int AccountID){
+bool GetActiveBanishments(DynamicArray<TActiveBanishment> *Banishments){
+	ASSERT(Banishments != NULL);
 	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT 1 FROM Banishments"
-			" WHERE AccountID = ?1"
-				" AND (Until = Issued OR Until > UNIXEPOCH())");
+			"SELECT AccountID, Issued, Until FROM Banishments"
+			" WHERE Until = Issued OR Until > UNIXEPOCH()");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
 	}
 
 	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, AccountID) != SQLITE_OK){
-		LOG_ERR("Failed to bind AccountID: %s", sqlite3_errmsg(g_Database));
-		return false;
+	while(sqlite3_step(Stmt) == SQLITE_ROW){
+		TActiveBanishment Banishment = {};
+		Banishment.Key = sqlite3_column_int(Stmt, 0);
+		Banishment.Issued = sqlite3_column_int(Stmt, 1);
+		Banishment.Until = sqlite3_column_int(Stmt, 2);
+		Banishments->Push(Banishment);
 	}
 
-	int ErrorCode = sqlite3_step(Stmt);
-	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
+	if(sqlite3_errcode(g_Database) != SQLITE_DONE){
 		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
-	return (ErrorCode == SQLITE_ROW);
+	return true;
 }
 
 TBanishmentStatus GetBanishmentStatus(int CharacterID){
@@ -1759,7 +2121,7 @@ bool InsertBanishment(int CharacterID, int IPAddress, int GamemasterID,
 				" Reason, Comment, FinalWarning, Issued, Until)"
 			" SELECT AccountID, ?2, ?3, ?4, ?5, ?6, UNIXEPOCH(), UNIXEPOCH() + ?7"
 				" FROM Characters WHERE CharacterID = ?1"
-			" RETURNING BanishmentID");
+			" RETURNING BanishmentID, AccountID, Issued, Until");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
@@ -1783,6 +2145,8 @@ bool InsertBanishment(int CharacterID, int IPAddress, int GamemasterID,
 	}
 
 	*BanishmentID = sqlite3_column_int(Stmt, 0);
+	InsertBanCacheAccount(sqlite3_column_int(Stmt, 1),
+			sqlite3_column_int(Stmt, 2), sqlite3_column_int(Stmt, 3));
 	return true;
 }
 
@@ -1838,29 +2202,31 @@ bool InsertNotation(int CharacterID, int IPAddress, int GamemasterID,
 	return true;
 }
 
-bool IsIPBanished(int IPAddress){
+bool GetActiveIPBanishments(DynamicArray<TActiveBanishment> *Banishments){
+	ASSERT(Banishments != NULL);
 	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT 1 FROM IPBanishments"
-			" WHERE IPAddress = ?1"
-				" AND (Until = Issued OR Until > UNIXEPOCH())");
+			"SELECT IPAddress, Issued, Until FROM IPBanishments"
+			" WHERE Until = Issued OR Until > UNIXEPOCH()");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
 	}
 
 	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, IPAddress) != SQLITE_OK){
-		LOG_ERR("Failed to bind IPAddress: %s", sqlite3_errmsg(g_Database));
-		return false;
+	while(sqlite3_step(Stmt) == SQLITE_ROW){
+		TActiveBanishment Banishment = {};
+		Banishment.Key = sqlite3_column_int(Stmt, 0);
+		Banishment.Issued = sqlite3_column_int(Stmt, 1);
+		Banishment.Until = sqlite3_column_int(Stmt, 2);
+		Banishments->Push(Banishment);
 	}
 
-	int ErrorCode = sqlite3_step(Stmt);
-	if(ErrorCode != SQLITE_ROW && ErrorCode != SQLITE_DONE){
+	if(sqlite3_errcode(g_Database) != SQLITE_DONE){
 		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
-	return (ErrorCode == SQLITE_ROW);
+	return true;
 }
 
 bool InsertIPBanishment(int CharacterID, int IPAddress, int GamemasterID,
@@ -1869,7 +2235,8 @@ bool InsertIPBanishment(int CharacterID, int IPAddress, int GamemasterID,
 	sqlite3_stmt *Stmt = PrepareQuery(
 			"INSERT INTO IPBanishments (CharacterID, IPAddress,"
 				" GamemasterID, Reason, Comment, Issued, Until)"
-			" VALUES (?1, ?2, ?3, ?4, ?5, UNIXEPOCH(), UNIXEPOCH() + ?6)");
+			" VALUES (?1, ?2, ?3, ?4, ?5, UNIXEPOCH(), UNIXEPOCH() + ?6)"
+			" RETURNING Issued, Until");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
@@ -1886,11 +2253,13 @@ bool InsertIPBanishment(int CharacterID, int IPAddress, int GamemasterID,
 		return false;
 	}
 
-	if(sqlite3_step(Stmt) != SQLITE_DONE){
+	if(sqlite3_step(Stmt) != SQLITE_ROW){
 		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
+	InsertBanCacheIPAddress(IPAddress,
+			sqlite3_column_int(Stmt, 0), sqlite3_column_int(Stmt, 1));
 	return true;
 }
 
@@ -1926,44 +2295,56 @@ bool InsertStatements(int WorldID, int NumStatements, TStatement *Statements){
 	// reports may include the same statements for context and I assume it's
 	// not uncommon to see overlaps.
 	ASSERT(NumStatements > 0 && Statements != NULL);
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"INSERT OR IGNORE INTO Statements (WorldID, Timestamp,"
-				" StatementID, CharacterID, Channel, Text)"
-			" VALUES (?1, ?2, ?3, ?4, ?5, ?6)");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
-		return false;
-	}
-
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK){
-		LOG_ERR("Failed to bind WorldID: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
+	int Remaining = 0;
 	for(int i = 0; i < NumStatements; i += 1){
-		if(Statements[i].StatementID == 0){
+		if(Statements[i].StatementID != 0){
+			Remaining += 1;
+		}else{
 			LOG_WARN("Skipping statement without id");
-			continue;
 		}
+	}
 
-		if(sqlite3_bind_int(Stmt, 2, Statements[i].Timestamp)          != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 3, Statements[i].StatementID)        != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 4, Statements[i].CharacterID)        != SQLITE_OK
-		|| sqlite3_bind_text(Stmt, 5, Statements[i].Channel, -1, NULL) != SQLITE_OK
-		|| sqlite3_bind_text(Stmt, 6, Statements[i].Text, -1, NULL)    != SQLITE_OK){
-			LOG_ERR("Failed to bind parameters for statement %d: %s",
-					Statements[i].StatementID, sqlite3_errmsg(g_Database));
+	int Next = 0;
+	while(Remaining > 0){
+		int BatchRows = BulkBatchRows(Remaining);
+		sqlite3_stmt *Stmt = PrepareBulkQuery(
+				"INSERT OR IGNORE INTO Statements (WorldID, Timestamp,"
+					" StatementID, CharacterID, Channel, Text)",
+				6, "", BatchRows);
+		if(Stmt == NULL){
+			LOG_ERR("Failed to prepare query");
 			return false;
 		}
 
+		AutoStmtReset StmtReset(Stmt);
+		for(int i = 0; i < BatchRows; i += 1){
+			while(Statements[Next].StatementID == 0){
+				Next += 1;
+			}
+
+			TStatement *Statement = &Statements[Next];
+			int Param = i * 6;
+			if(sqlite3_bind_int(Stmt, Param + 1, WorldID)                       != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 2, Statement->Timestamp)          != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 3, Statement->StatementID)        != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 4, Statement->CharacterID)        != SQLITE_OK
+			|| sqlite3_bind_text(Stmt, Param + 5, Statement->Channel, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_text(Stmt, Param + 6, Statement->Text, -1, NULL)    != SQLITE_OK){
+				LOG_ERR("Failed to bind parameters for statement %d: %s",
+						Statement->StatementID, sqlite3_errmsg(g_Database));
+				return false;
+			}
+
+			Next += 1;
+		}
+
 		if(sqlite3_step(Stmt) != SQLITE_DONE){
-			LOG_ERR("Failed to insert statement %d: %s",
-					Statements[i].StatementID, sqlite3_errmsg(g_Database));
+			LOG_ERR("Failed to insert %d statements: %s",
+					BatchRows, sqlite3_errmsg(g_Database));
 			return false;
 		}
 
-		sqlite3_reset(Stmt);
+		Remaining -= BatchRows;
 	}
 
 	return true;
@@ -2021,6 +2402,7 @@ bool GetKillStatistics(int WorldID, DynamicArray<TKillStatistics> *Stats){
 		return false;
 	}
 
+	Stats->Reserve(Stats->Length() + EstimateRowsPerKey("sqlite_autoindex_KillStatistics_1"));
 	while(sqlite3_step(Stmt) == SQLITE_ROW){
 		TKillStatistics Entry = {};
 		StringCopy(Entry.RaceName, sizeof(Entry.RaceName),
@@ -2039,67 +2421,80 @@ bool GetKillStatistics(int WorldID, DynamicArray<TKillStatistics> *Stats){
 }
 
 bool MergeKillStatistics(int WorldID, int NumStats, TKillStatistics *Stats){
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"INSERT INTO KillStatistics (WorldID, RaceName, TimesKilled, PlayersKilled)"
-			" VALUES (?1, ?2, ?3, ?4)"
-			" ON CONFLICT DO UPDATE SET TimesKilled = TimesKilled + Excluded.TimesKilled,"
-									" PlayersKilled = PlayersKilled + Excluded.PlayersKilled");
-	if(Stmt == NULL){
-		LOG_ERR("Failed to prepare query");
-		return false;
-	}
-
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK){
-		LOG_ERR("failed to bind WorldID: %s", sqlite3_errmsg(g_Database));
-		return false;
-	}
-
-	for(int i = 0; i < NumStats; i += 1){
-		if(sqlite3_bind_text(Stmt, 2, Stats[i].RaceName, -1, NULL) != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 3, Stats[i].TimesKilled)         != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 4, Stats[i].PlayersKilled)       != SQLITE_OK){
-			LOG_ERR("Failed to bind parameters for \"%s\" stats: %s",
-					Stats[i].RaceName, sqlite3_errmsg(g_Database));
+	// NOTE(fusion): Rows within the same statement are inserted in order, so
+	// repeated races are still added together.
+	InvalidateKillStatisticsResponse(WorldID);
+	int Done = 0;
+	while(Done < NumStats){
+		int BatchRows = BulkBatchRows(NumStats - Done);
+		sqlite3_stmt *Stmt = PrepareBulkQuery(
+				"INSERT INTO KillStatistics (WorldID, RaceName, TimesKilled, PlayersKilled)",
+				4,
+				" ON CONFLICT DO UPDATE SET TimesKilled = TimesKilled + Excluded.TimesKilled,"
+										" PlayersKilled = PlayersKilled + Excluded.PlayersKilled",
+				BatchRows);
+		if(Stmt == NULL){
+			LOG_ERR("Failed to prepare query");
 			return false;
 		}
 
+		AutoStmtReset StmtReset(Stmt);
+		for(int i = 0; i < BatchRows; i += 1){
+			TKillStatistics *Entry = &Stats[Done + i];
+			int Param = i * 4;
+			if(sqlite3_bind_int(Stmt, Param + 1, WorldID)                    != SQLITE_OK
+			|| sqlite3_bind_text(Stmt, Param + 2, Entry->RaceName, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 3, Entry->TimesKilled)         != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 4, Entry->PlayersKilled)       != SQLITE_OK){
+				LOG_ERR("Failed to bind parameters for \"%s\" stats: %s",
+						Entry->RaceName, sqlite3_errmsg(g_Database));
+				return false;
+			}
+		}
+
 		if(sqlite3_step(Stmt) != SQLITE_DONE){
-			LOG_ERR("Failed to insert \"%s\" stats: %s",
-					Stats[i].RaceName, sqlite3_errmsg(g_Database));
+			LOG_ERR("Failed to insert %d kill statistics: %s",
+					BatchRows, sqlite3_errmsg(g_Database));
 			return false;
 		}
 
-		sqlite3_reset(Stmt);
+		Done += BatchRows;
 	}
 
 	return true;
 }
 
-bool GetOnlineCharacters(int WorldID, DynamicArray<TOnlineCharacter> *Characters){
-	ASSERT(Characters != NULL);
+bool GetKillStatisticsHistory(int WorldID, int From, int To, DynamicArray<TKillStatistics> *Stats){
+	ASSERT(Stats != NULL);
+	// NOTE(fusion): Buckets are selected by their start time, so coarser buckets
+	// that start inside the window are counted whole. The `IN` makes it a range
+	// scan over each period of the primary key instead of the whole world.
 	sqlite3_stmt *Stmt = PrepareQuery(
-			"SELECT Name, Level, Profession"
-			" FROM OnlineCharacters WHERE WorldID = ?1");
+			"SELECT RaceName, SUM(TimesKilled), SUM(PlayersKilled)"
+			" FROM KillStatisticsHistory"
+			" WHERE WorldID = ?1 AND Period IN (0, 1, 2)"
+				" AND PeriodStart >= ?2 AND PeriodStart < ?3"
+			" GROUP BY RaceName");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
 	}
 
 	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK){
-		LOG_ERR("Failed to bind WorldID: %s", sqlite3_errmsg(g_Database));
+	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK
+	|| sqlite3_bind_int(Stmt, 2, From)    != SQLITE_OK
+	|| sqlite3_bind_int(Stmt, 3, To)      != SQLITE_OK){
+		LOG_ERR("Failed to bind parameters: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
 	while(sqlite3_step(Stmt) == SQLITE_ROW){
-		TOnlineCharacter Character = {};
-		StringCopy(Character.Name, sizeof(Character.Name),
+		TKillStatistics Entry = {};
+		StringCopy(Entry.RaceName, sizeof(Entry.RaceName),
 				(const char*)sqlite3_column_text(Stmt, 0));
-		Character.Level = sqlite3_column_int(Stmt, 1);
-		StringCopy(Character.Profession, sizeof(Character.Profession),
-				(const char*)sqlite3_column_text(Stmt, 2));
-		Characters->Push(Character);
+		Entry.TimesKilled = sqlite3_column_int(Stmt, 1);
+		Entry.PlayersKilled = sqlite3_column_int(Stmt, 2);
+		Stats->Push(Entry);
 	}
 
 	if(sqlite3_errcode(g_Database) != SQLITE_DONE){
@@ -2110,17 +2505,79 @@ bool GetOnlineCharacters(int WorldID, DynamicArray<TOnlineCharacter> *Characters
 	return true;
 }
 
-bool DeleteOnlineCharacters(int WorldID){
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"DELETE FROM OnlineCharacters WHERE WorldID = ?1");
+bool MergeKillStatisticsHistory(int WorldID, int PeriodStart, int NumStats, TKillStatistics *Stats){
+	// NOTE(fusion): New statistics always go into hourly buckets, which are
+	// only rolled up into coarser ones by `RollupKillStatisticsHistory`.
+	int Done = 0;
+	while(Done < NumStats){
+		int BatchRows = BulkBatchRows(NumStats - Done);
+		sqlite3_stmt *Stmt = PrepareBulkQuery(
+				"INSERT INTO KillStatisticsHistory (WorldID, Period, PeriodStart,"
+					" RaceName, TimesKilled, PlayersKilled)",
+				6,
+				" ON CONFLICT DO UPDATE SET TimesKilled = TimesKilled + Excluded.TimesKilled,"
+										" PlayersKilled = PlayersKilled + Excluded.PlayersKilled",
+				BatchRows);
+		if(Stmt == NULL){
+			LOG_ERR("Failed to prepare query");
+			return false;
+		}
+
+		AutoStmtReset StmtReset(Stmt);
+		for(int i = 0; i < BatchRows; i += 1){
+			TKillStatistics *Entry = &Stats[Done + i];
+			int Param = i * 6;
+			if(sqlite3_bind_int(Stmt, Param + 1, WorldID)                    != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 2, KILL_PERIOD_HOUR)           != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 3, PeriodStart)                != SQLITE_OK
+			|| sqlite3_bind_text(Stmt, Param + 4, Entry->RaceName, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 5, Entry->TimesKilled)         != SQLITE_OK
+			|| sqlite3_bind_int(Stmt, Param + 6, Entry->PlayersKilled)       != SQLITE_OK){
+				LOG_ERR("Failed to bind parameters for \"%s\" history: %s",
+						Entry->RaceName, sqlite3_errmsg(g_Database));
+				return false;
+			}
+		}
+
+		if(sqlite3_step(Stmt) != SQLITE_DONE){
+			LOG_ERR("Failed to insert %d kill statistics history rows: %s",
+					BatchRows, sqlite3_errmsg(g_Database));
+			return false;
+		}
+
+		Done += BatchRows;
+	}
+
+	return true;
+}
+
+bool RollupKillStatisticsHistory(int Period, int NewPeriod, int Before, int *NumRolledUp){
+	ASSERT(Period < NewPeriod);
+	// NOTE(fusion): Rows are added to whatever is already in the new bucket so
+	// rolling up a partial bucket is fine, it just makes windows that end in the
+	// middle of it less precise.
+	sqlite3_stmt *Stmt = PrepareQuery(
+			"INSERT INTO KillStatisticsHistory (WorldID, Period, PeriodStart,"
+				" RaceName, TimesKilled, PlayersKilled)"
+			" SELECT WorldID, ?2,"
+				" CASE ?2 WHEN 1 THEN PeriodStart - (PeriodStart % 86400)"
+					" ELSE UNIXEPOCH(PeriodStart, 'unixepoch', 'start of month') END AS NewPeriodStart,"
+				" RaceName, SUM(TimesKilled), SUM(PlayersKilled)"
+			" FROM KillStatisticsHistory"
+			" WHERE Period = ?1 AND PeriodStart < ?3"
+			" GROUP BY WorldID, NewPeriodStart, RaceName"
+			" ON CONFLICT DO UPDATE SET TimesKilled = TimesKilled + Excluded.TimesKilled,"
+									" PlayersKilled = PlayersKilled + Excluded.PlayersKilled");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
 	}
 
 	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK){
-		LOG_ERR("Failed to bind WorldID: %s", sqlite3_errmsg(g_Database));
+	if(sqlite3_bind_int(Stmt, 1, Period)    != SQLITE_OK
+	|| sqlite3_bind_int(Stmt, 2, NewPeriod) != SQLITE_OK
+	|| sqlite3_bind_int(Stmt, 3, Before)    != SQLITE_OK){
+		LOG_ERR("Failed to bind parameters: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
@@ -2129,40 +2586,28 @@ bool DeleteOnlineCharacters(int WorldID){
 		return false;
 	}
 
-	return true;
-}
-
-bool InsertOnlineCharacters(int WorldID, int NumCharacters, TOnlineCharacter *Characters){
-	sqlite3_stmt *Stmt = PrepareQuery(
-			"INSERT INTO OnlineCharacters (WorldID, Name, Level, Profession)"
-			" VALUES (?1, ?2, ?3, ?4)");
+	Stmt = PrepareQuery(
+			"DELETE FROM KillStatisticsHistory"
+			" WHERE Period = ?1 AND PeriodStart < ?2");
 	if(Stmt == NULL){
 		LOG_ERR("Failed to prepare query");
 		return false;
 	}
 
-	AutoStmtReset StmtReset(Stmt);
-	if(sqlite3_bind_int(Stmt, 1, WorldID) != SQLITE_OK){
-		LOG_ERR("Failed to bind WorldID: %s", sqlite3_errmsg(g_Database));
+	AutoStmtReset DeleteStmtReset(Stmt);
+	if(sqlite3_bind_int(Stmt, 1, Period) != SQLITE_OK
+	|| sqlite3_bind_int(Stmt, 2, Before) != SQLITE_OK){
+		LOG_ERR("Failed to bind parameters: %s", sqlite3_errmsg(g_Database));
 		return false;
 	}
 
-	for(int i = 0; i < NumCharacters; i += 1){
-		if(sqlite3_bind_text(Stmt, 2, Characters[i].Name, -1, NULL)       != SQLITE_OK
-		|| sqlite3_bind_int(Stmt, 3, Characters[i].Level)                 != SQLITE_OK
-		|| sqlite3_bind_text(Stmt, 4, Characters[i].Profession, -1, NULL) != SQLITE_OK){
-			LOG_ERR("Failed to bind parameters for character \"%s\": %s",
-					Characters[i].Name, sqlite3_errmsg(g_Database));
-			return false;
-		}
-
-		if(sqlite3_step(Stmt) != SQLITE_DONE){
-			LOG_ERR("Failed to insert character \"%s\": %s",
-					Characters[i].Name, sqlite3_errmsg(g_Database));
-			return false;
-		}
+	if(sqlite3_step(Stmt) != SQLITE_DONE){
+		LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+		return false;
+	}
 
-		sqlite3_reset(Stmt);
+	if(NumRolledUp){
+		*NumRolledUp = sqlite3_changes(g_Database);
 	}
 
 	return true;
@@ -2170,6 +2615,13 @@ bool InsertOnlineCharacters(int WorldID, int NumCharacters, TOnlineCharacter *Ch
 
 bool CheckOnlineRecord(int WorldID, int NumCharacters, bool *NewRecord){
 	ASSERT(NewRecord != NULL);
+	// NOTE(fusion): Records are rarely broken so the world cache is checked
+	// first, which is reloaded whenever one is.
+	if(NumCharacters <= GetWorldOnlineRecord(WorldID)){
+		*NewRecord = false;
+		return true;
+	}
+
 	sqlite3_stmt *Stmt = PrepareQuery(
 			"UPDATE Worlds SET OnlineRecord = ?2,"
 				" OnlineRecordTimestamp = UNIXEPOCH()"
@@ -2192,9 +2644,201 @@ bool CheckOnlineRecord(int WorldID, int NumCharacters, bool *NewRecord){
 	}
 
 	*NewRecord = sqlite3_changes(g_Database) > 0;
+	if(*NewRecord){
+		InvalidateWorldOnlineRecord();
+	}
+
 	return true;
 }
 
+// Database Maintenance
+//==============================================================================
+// NOTE(fusion): Maintenance jobs run on the main timer wheel, between queries.
+// Each job re-schedules itself using the current config value so changes made
+// by a config reload take effect after the next run, unless the job was or is
+// being disabled, in which case `ScheduleDatabaseMaintenance` takes care of it.
+static TTimer g_PruneLoginAttemptsTimer;
+static TTimer g_CheckpointTimer;
+static TTimer g_OptimizeTimer;
+static TTimer g_KillHistoryRollupTimer;
+static TTimer g_IndexAdvisorTimer;
+
+static void ScheduleMaintenanceJob(TTimer *Timer, int Interval){
+	if(Interval > 0){
+		ScheduleTimer(&g_TimerWheel, Timer, (int64)g_MonotonicTimeMS + Interval);
+	}else{
+		CancelTimer(Timer);
+	}
+}
+
+static void PruneLoginAttemptsJob(TTimer *Timer){
+	// NOTE(fusion): Login throttling looks at the last 30 minutes of attempts
+	// so we can't prune anything more recent than that.
+	int MaxAge = std::max<int>(g_LoginAttemptsMaxAge, 30 * 60 * 1000) / 1000;
+	int NumDeleted = 0;
+	if(!PruneLoginAttempts(MaxAge, &NumDeleted)){
+		LOG_ERR("Failed to prune login attempts");
+	}else if(NumDeleted > 0){
+		LOG("Pruned %d login attempts", NumDeleted);
+	}
+	ScheduleMaintenanceJob(Timer, g_PruneLoginAttemptsInterval);
+}
+
+static void CheckpointJob(TTimer *Timer){
+	// NOTE(fusion): This is a no-op unless the database is in WAL mode.
+	int LogFrames = 0, CheckpointedFrames = 0;
+	if(sqlite3_wal_checkpoint_v2(g_Database, NULL, SQLITE_CHECKPOINT_PASSIVE,
+			&LogFrames, &CheckpointedFrames) != SQLITE_OK){
+		LOG_ERR("Failed to checkpoint database: %s", sqlite3_errmsg(g_Database));
+	}
+	ScheduleMaintenanceJob(Timer, g_CheckpointInterval);
+}
+
+static void OptimizeJob(TTimer *Timer){
+	if(!ExecInternal("PRAGMA optimize")){
+		LOG_ERR("Failed to optimize database");
+	}
+	LoadRowEstimates();
+	ScheduleMaintenanceJob(Timer, g_OptimizeInterval);
+}
+
+static int GetMonthStart(int Timestamp){
+	time_t Time = (time_t)Timestamp;
+	struct tm UTC;
+	gmtime_r(&Time, &UTC);
+	UTC.tm_mday = 1;
+	UTC.tm_hour = 0;
+	UTC.tm_min = 0;
+	UTC.tm_sec = 0;
+	return (int)timegm(&UTC);
+}
+
+static void KillHistoryRollupJob(TTimer *Timer){
+	// NOTE(fusion): Hourly buckets are kept for the last `KillHistoryHourlyDays`
+	// full days and daily buckets for the last `KillHistoryDailyMonths` full
+	// months, so the website can still have "last day" and "last month" with
+	// the right granularity.
+	int Now = (int)time(NULL);
+	int DayBefore = (Now - g_KillHistoryHourlyDays * 86400);
+	DayBefore -= (DayBefore % 86400);
+	int MonthBefore = GetMonthStart(Now);
+	for(int i = 0; i < g_KillHistoryDailyMonths; i += 1){
+		MonthBefore = GetMonthStart(MonthBefore - 1);
+	}
+
+	TransactionScope Tx("KillHistoryRollup");
+	int NumDays = 0, NumMonths = 0;
+	if(!Tx.Begin()
+			|| !RollupKillStatisticsHistory(KILL_PERIOD_HOUR, KILL_PERIOD_DAY, DayBefore, &NumDays)
+			|| !RollupKillStatisticsHistory(KILL_PERIOD_DAY, KILL_PERIOD_MONTH, MonthBefore, &NumMonths)
+			|| !Tx.Commit()){
+		LOG_ERR("Failed to roll up kill statistics history");
+	}else if(NumDays > 0 || NumMonths > 0){
+		LOG("Rolled up %d hourly and %d daily kill statistics", NumDays, NumMonths);
+	}
+	ScheduleMaintenanceJob(Timer, g_KillHistoryRollupInterval);
+}
+
+static void LogQueryPlan(sqlite3_stmt *Stmt){
+	// NOTE(fusion): Only scans, temporary b-trees, and automatic indexes are
+	// logged. Parameters are left unbound which shouldn't change the plan.
+	const char *Text = sqlite3_sql(Stmt);
+	usize ExplainSize = strlen(Text) + 32;
+	char *Explain = (char*)malloc(ExplainSize);
+	if(Explain == NULL){
+		PANIC("Failed to allocate %d bytes for query plan", (int)ExplainSize);
+		return;
+	}
+
+	snprintf(Explain, ExplainSize, "EXPLAIN QUERY PLAN %s", Text);
+	sqlite3_stmt *PlanStmt = NULL;
+	if(sqlite3_prepare_v2(g_Database, Explain, -1, &PlanStmt, NULL) != SQLITE_OK){
+		LOG_ERR("Failed to prepare query plan: %s", sqlite3_errmsg(g_Database));
+		free(Explain);
+		return;
+	}
+
+	while(sqlite3_step(PlanStmt) == SQLITE_ROW){
+		const char *Detail = (const char*)sqlite3_column_text(PlanStmt, 3);
+		if(Detail != NULL && (strncmp(Detail, "SCAN", 4) == 0
+				|| strstr(Detail, "TEMP B-TREE") != NULL
+				|| strstr(Detail, "AUTOMATIC") != NULL)){
+			LOG_WARN("  %s", Detail);
+		}
+	}
+
+	sqlite3_finalize(PlanStmt);
+	free(Explain);
+}
+
+static void IndexAdvisorJob(TTimer *Timer){
+	// NOTE(fusion): Reports cached statements that stepped through full scans,
+	// sorted rows with a temporary b-tree, or built automatic indexes since the
+	// last run, along with the offending parts of their query plan. Counters are
+	// reset on every run so each report only covers its own interval, and they're
+	// lost for statements evicted from the statement cache in between.
+	//	Some statements are expected to show up, like the bulk loads of the name
+	// index and highscores, or maintenance queries, but anything that runs for
+	// each query should be looked at.
+	int NumReported = 0;
+	for(int i = 0; i < g_MaxCachedStatements; i += 1){
+		sqlite3_stmt *Stmt = g_CachedStatements[i].Stmt;
+		if(Stmt == NULL){
+			continue;
+		}
+
+		int Runs = sqlite3_stmt_status(Stmt, SQLITE_STMTSTATUS_RUN, 1);
+		int FullScanSteps = sqlite3_stmt_status(Stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+		int Sorts = sqlite3_stmt_status(Stmt, SQLITE_STMTSTATUS_SORT, 1);
+		int AutoIndexes = sqlite3_stmt_status(Stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+		if(FullScanSteps > 0 || Sorts > 0 || AutoIndexes > 0){
+			const char *Text = sqlite3_sql(Stmt);
+			LOG_WARN("Statement \"%.60s%s\": %d runs, %d full scan steps,"
+					" %d sorts, %d automatic index rows",
+					Text, (strlen(Text) > 60 ? "..." : ""),
+					Runs, FullScanSteps, Sorts, AutoIndexes);
+			LogQueryPlan(Stmt);
+			NumReported += 1;
+		}
+	}
+
+	if(NumReported > 0){
+		LOG("Index advisor reported %d statements", NumReported);
+	}
+	ScheduleMaintenanceJob(Timer, g_IndexAdvisorInterval);
+}
+
+static void InitDatabaseMaintenance(void){
+	// IMPORTANT(fusion): This MUST only be called once, before any job is
+	// scheduled. Re-initializing a timer that is still linked into the wheel
+	// would corrupt it.
+	InitTimer(&g_PruneLoginAttemptsTimer, PruneLoginAttemptsJob, NULL);
+	InitTimer(&g_CheckpointTimer, CheckpointJob, NULL);
+	InitTimer(&g_OptimizeTimer, OptimizeJob, NULL);
+	InitTimer(&g_KillHistoryRollupTimer, KillHistoryRollupJob, NULL);
+	InitTimer(&g_IndexAdvisorTimer, IndexAdvisorJob, NULL);
+}
+
+void ScheduleDatabaseMaintenance(void){
+	if(g_Database == NULL){
+		return;
+	}
+
+	ScheduleMaintenanceJob(&g_PruneLoginAttemptsTimer, g_PruneLoginAttemptsInterval);
+	ScheduleMaintenanceJob(&g_CheckpointTimer, g_CheckpointInterval);
+	ScheduleMaintenanceJob(&g_OptimizeTimer, g_OptimizeInterval);
+	ScheduleMaintenanceJob(&g_KillHistoryRollupTimer, g_KillHistoryRollupInterval);
+	ScheduleMaintenanceJob(&g_IndexAdvisorTimer, g_IndexAdvisorInterval);
+}
+
+void CancelDatabaseMaintenance(void){
+	CancelTimer(&g_PruneLoginAttemptsTimer);
+	CancelTimer(&g_CheckpointTimer);
+	CancelTimer(&g_OptimizeTimer);
+	CancelTimer(&g_KillHistoryRollupTimer);
+	CancelTimer(&g_IndexAdvisorTimer);
+}
+
 // Database Initialization
 //==============================================================================
 // NOTE(fusion): From `https://www.sqlite.org/pragma.html`:
@@ -2295,6 +2939,40 @@ bool GetPragmaInt(const char *Name, int *OutValue){
 	return Result;
 }
 
+static int g_DataVersion;
+static int g_DataVersionTime;
+static bool g_DataVersionCached;
+
+bool GetDataVersion(int *DataVersion){
+	// NOTE(fusion): `data_version` only changes when some other connection
+	// commits to the database, so in-memory copies of data that is mostly
+	// written externally (e.g. from the sqlite shell) can use it to know when
+	// they're stale, without being thrown away by our own writes. It's only
+	// queried once per update, meaning external changes are picked up at most
+	// one update later.
+	ASSERT(DataVersion != NULL);
+	if(!g_DataVersionCached || g_DataVersionTime != g_MonotonicTimeMS){
+		sqlite3_stmt *Stmt = PrepareQuery("PRAGMA data_version");
+		if(Stmt == NULL){
+			LOG_ERR("Failed to prepare query");
+			return false;
+		}
+
+		AutoStmtReset StmtReset(Stmt);
+		if(sqlite3_step(Stmt) != SQLITE_ROW){
+			LOG_ERR("Failed to execute query: %s", sqlite3_errmsg(g_Database));
+			return false;
+		}
+
+		g_DataVersion = sqlite3_column_int(Stmt, 0);
+		g_DataVersionTime = g_MonotonicTimeMS;
+		g_DataVersionCached = true;
+	}
+
+	*DataVersion = g_DataVersion;
+	return true;
+}
+
 bool InitDatabaseSchema(void){
 	TransactionScope Tx("SchemaInit");
 	if(!Tx.Begin()){
@@ -2344,7 +3022,7 @@ bool UpgradeDatabaseSchema(int UserVersion){
 		}
 
 		while(UserVersion < NewVersion){
-			snprintf(FileName, sizeof(FileName), "upgrade-%d.sql", UserVersion);
+			snprintf(FileName, sizeof(FileName), "sql/upgrade-%d.sql", UserVersion);
 			if(!ExecFile(FileName)){
 				LOG_ERR("Failed to execute \"%s\"", FileName);
 				return false;
@@ -2400,6 +3078,14 @@ bool CheckDatabaseSchema(void){
 bool InitDatabase(void){
 	LOG("Database file: \"%s\"", g_DatabaseFile);
 	LOG("Max cached statements: %d", g_MaxCachedStatements);
+	LOG("Login attempts max age: %dms", g_LoginAttemptsMaxAge);
+	LOG("Prune login attempts interval: %dms", g_PruneLoginAttemptsInterval);
+	LOG("Checkpoint interval: %dms", g_CheckpointInterval);
+	LOG("Optimize interval: %dms", g_OptimizeInterval);
+	LOG("Kill history rollup interval: %dms", g_KillHistoryRollupInterval);
+	LOG("Kill history hourly days: %d", g_KillHistoryHourlyDays);
+	LOG("Kill history daily months: %d", g_KillHistoryDailyMonths);
+	LOG("Index advisor interval: %dms", g_IndexAdvisorInterval);
 
 	int Flags = SQLITE_OPEN_READWRITE
 			| SQLITE_OPEN_CREATE
@@ -2428,10 +3114,14 @@ bool InitDatabase(void){
 		return false;
 	}
 
+	LoadRowEstimates();
+	InitDatabaseMaintenance();
+	ScheduleDatabaseMaintenance();
 	return true;
 }
 
 void ExitDatabase(void){
+	CancelDatabaseMaintenance();
 	ExitStatementCache();
 
 	if(g_Database != NULL){
@@ -0,0 +1,631 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): Each world's highscore list is kept in memory as an AVL tree
+// ordered by level, highest first, then by name, with subtree sizes so both the
+// rank of a character and the character at a given rank are found in O(log n).
+// Nodes live in a per world array and are referenced by index, with a hash
+// table from character id to node for updates.
+//	Lists are bulk loaded in rank order, which is served straight from the
+// `CharactersHighscoreIndex` covering index, at startup and whenever the
+// database's `data_version` changes (e.g. when a character is deleted or gets
+// `NO_STATISTICS` from the sqlite shell). Characters created by us are added as
+// they're created and levels are updated on logout, both of which are kept in a
+// small undo log so they can be reverted if the transaction that made them is
+// rolled back.
+#define HIGHSCORES_MAX_UNDO 16
+
+enum : int {
+	HIGHSCORE_UNDO_INSERT	= 0,
+	HIGHSCORE_UNDO_UPDATE	= 1,
+};
+
+struct THighscoreNode{
+	int Left;
+	int Right;
+	int Height;
+	int Size;
+	int CharacterID;
+	int Level;
+	char Name[30];
+	char Profession[30];
+};
+
+struct THighscoreList{
+	int WorldID;
+	int Root;
+	int NumNodes;
+	int MaxNodes;
+	THighscoreNode *Nodes;
+	int NumSlots;
+	uint32 *Slots;
+};
+
+struct THighscoreUndo{
+	int Type;
+	int WorldID;
+	int CharacterID;
+	int Level;
+	char Profession[30];
+};
+
+static THighscoreList *g_HighscoreLists;
+static int g_NumHighscoreLists;
+static THighscoreUndo g_HighscoreUndo[HIGHSCORES_MAX_UNDO];
+static int g_NumHighscoreUndo;
+static int g_HighscoresDataVersion;
+static bool g_HighscoresLoaded;
+
+static void ClearHighscoreList(THighscoreList *List){
+	free(List->Nodes);
+	free(List->Slots);
+	int WorldID = List->WorldID;
+	memset(List, 0, sizeof(THighscoreList));
+	List->WorldID = WorldID;
+	List->Root = -1;
+}
+
+static void ClearHighscores(void){
+	for(int i = 0; i < g_NumHighscoreLists; i += 1){
+		ClearHighscoreList(&g_HighscoreLists[i]);
+	}
+	free(g_HighscoreLists);
+	g_HighscoreLists = NULL;
+	g_NumHighscoreLists = 0;
+}
+
+static THighscoreList *FindHighscoreList(int WorldID){
+	for(int i = 0; i < g_NumHighscoreLists; i += 1){
+		if(g_HighscoreLists[i].WorldID == WorldID){
+			return &g_HighscoreLists[i];
+		}
+	}
+	return NULL;
+}
+
+static THighscoreList *GetHighscoreList(int WorldID){
+	THighscoreList *List = FindHighscoreList(WorldID);
+	if(List != NULL){
+		return List;
+	}
+
+	THighscoreList *NewHighscoreLists = (THighscoreList*)realloc(g_HighscoreLists,
+			sizeof(THighscoreList) * (usize)(g_NumHighscoreLists + 1));
+	if(NewHighscoreLists == NULL){
+		PANIC("Failed to grow highscore lists to %d", g_NumHighscoreLists + 1);
+		return NULL;
+	}
+
+	g_HighscoreLists = NewHighscoreLists;
+	List = &g_HighscoreLists[g_NumHighscoreLists];
+	g_NumHighscoreLists += 1;
+
+	memset(List, 0, sizeof(THighscoreList));
+	List->WorldID = WorldID;
+	List->Root = -1;
+	return List;
+}
+
+// Character ID Table
+//==============================================================================
+static uint32 HashCharacterID(int CharacterID){
+	// NOTE(fusion): Character ids are mostly sequential, so mix them up a bit
+	// before masking.
+	uint32 Hash = (uint32)CharacterID;
+	Hash ^= Hash >> 16;
+	Hash *= 0x7FEB352DU;
+	Hash ^= Hash >> 15;
+	return Hash;
+}
+
+static void LinkHighscoreNode(THighscoreList *List, int Node){
+	// NOTE(fusion): Slots hold the node index plus one, so zero is empty.
+	uint32 Mask = (uint32)(List->NumSlots - 1);
+	uint32 Slot = HashCharacterID(List->Nodes[Node].CharacterID) & Mask;
+	while(List->Slots[Slot] != 0){
+		Slot = (Slot + 1) & Mask;
+	}
+	List->Slots[Slot] = (uint32)Node + 1;
+}
+
+static void RebuildHighscoreSlots(THighscoreList *List, int MinEntries){
+	int NumSlots = 64;
+	while(NumSlots < (MinEntries * 2)){
+		NumSlots *= 2;
+	}
+
+	if(NumSlots != List->NumSlots){
+		free(List->Slots);
+		List->Slots = (uint32*)malloc(sizeof(uint32) * (usize)NumSlots);
+		if(List->Slots == NULL){
+			PANIC("Failed to allocate highscore table with %d slots", NumSlots);
+			return;
+		}
+		List->NumSlots = NumSlots;
+	}
+
+	memset(List->Slots, 0, sizeof(uint32) * (usize)List->NumSlots);
+	for(int i = 0; i < List->NumNodes; i += 1){
+		LinkHighscoreNode(List, i);
+	}
+}
+
+static int FindHighscoreSlot(THighscoreList *List, int CharacterID){
+	if(List->NumNodes == 0){
+		return -1;
+	}
+
+	uint32 Mask = (uint32)(List->NumSlots - 1);
+	uint32 Slot = HashCharacterID(CharacterID) & Mask;
+	while(List->Slots[Slot] != 0){
+		int Node = (int)List->Slots[Slot] - 1;
+		if(List->Nodes[Node].CharacterID == CharacterID){
+			return (int)Slot;
+		}
+		Slot = (Slot + 1) & Mask;
+	}
+	return -1;
+}
+
+// AVL Tree
+//==============================================================================
+static int NodeHeight(THighscoreList *List, int Node){
+	return (Node != -1 ? List->Nodes[Node].Height : 0);
+}
+
+static int NodeSize(THighscoreList *List, int Node){
+	return (Node != -1 ? List->Nodes[Node].Size : 0);
+}
+
+static int CompareHighscoreNodes(THighscoreList *List, int A, int B){
+	// NOTE(fusion): Names are unique and compared the same way as the `NOCASE`
+	// collation, so this matches the order of `CharactersHighscoreIndex`.
+	THighscoreNode *NodeA = &List->Nodes[A];
+	THighscoreNode *NodeB = &List->Nodes[B];
+	if(NodeA->Level != NodeB->Level){
+		return (NodeA->Level > NodeB->Level ? -1 : 1);
+	}
+	return StringCompareCI(NodeA->Name, NodeB->Name);
+}
+
+static void UpdateHighscoreNode(THighscoreList *List, int Node){
+	THighscoreNode *N = &List->Nodes[Node];
+	N->Height = 1 + std::max<int>(NodeHeight(List, N->Left), NodeHeight(List, N->Right));
+	N->Size = 1 + NodeSize(List, N->Left) + NodeSize(List, N->Right);
+}
+
+static int RotateHighscoreRight(THighscoreList *List, int Node){
+	int Left = List->Nodes[Node].Left;
+	List->Nodes[Node].Left = List->Nodes[Left].Right;
+	List->Nodes[Left].Right = Node;
+	UpdateHighscoreNode(List, Node);
+	UpdateHighscoreNode(List, Left);
+	return Left;
+}
+
+static int RotateHighscoreLeft(THighscoreList *List, int Node){
+	int Right = List->Nodes[Node].Right;
+	List->Nodes[Node].Right = List->Nodes[Right].Left;
+	List->Nodes[Right].Left = Node;
+	UpdateHighscoreNode(List, Node);
+	UpdateHighscoreNode(List, Right);
+	return Right;
+}
+
+static int RebalanceHighscoreNode(THighscoreList *List, int Node){
+	UpdateHighscoreNode(List, Node);
+	THighscoreNode *N = &List->Nodes[Node];
+	int Balance = NodeHeight(List, N->Left) - NodeHeight(List, N->Right);
+	if(Balance > 1){
+		THighscoreNode *Left = &List->Nodes[N->Left];
+		if(NodeHeight(List, Left->Left) < NodeHeight(List, Left->Right)){
+			N->Left = RotateHighscoreLeft(List, N->Left);
+		}
+		return RotateHighscoreRight(List, Node);
+	}else if(Balance < -1){
+		THighscoreNode *Right = &List->Nodes[N->Right];
+		if(NodeHeight(List, Right->Right) < NodeHeight(List, Right->Left)){
+			N->Right = RotateHighscoreRight(List, N->Right);
+		}
+		return RotateHighscoreLeft(List, Node);
+	}
+	return Node;
+}
+
+static int InsertHighscoreNode(THighscoreList *List, int Root, int Node){
+	if(Root == -1){
+		return Node;
+	}
+
+	if(CompareHighscoreNodes(List, Node, Root) < 0){
+		int Left = InsertHighscoreNode(List, List->Nodes[Root].Left, Node);
+		List->Nodes[Root].Left = Left;
+	}else{
+		int Right = InsertHighscoreNode(List, List->Nodes[Root].Right, Node);
+		List->Nodes[Root].Right = Right;
+	}
+	return RebalanceHighscoreNode(List, Root);
+}
+
+static int RemoveMinHighscoreNode(THighscoreList *List, int Root, int *Min){
+	if(List->Nodes[Root].Left == -1){
+		*Min = Root;
+		return List->Nodes[Root].Right;
+	}
+
+	int Left = RemoveMinHighscoreNode(List, List->Nodes[Root].Left, Min);
+	List->Nodes[Root].Left = Left;
+	return RebalanceHighscoreNode(List, Root);
+}
+
+static int RemoveHighscoreNode(THighscoreList *List, int Root, int Node){
+	ASSERT(Root != -1);
+	if(Root == Node){
+		int Left = List->Nodes[Root].Left;
+		int Right = List->Nodes[Root].Right;
+		if(Right == -1){
+			return Left;
+		}
+
+		int Min;
+		Right = RemoveMinHighscoreNode(List, Right, &Min);
+		List->Nodes[Min].Left = Left;
+		List->Nodes[Min].Right = Right;
+		return RebalanceHighscoreNode(List, Min);
+	}
+
+	if(CompareHighscoreNodes(List, Node, Root) < 0){
+		int Left = RemoveHighscoreNode(List, List->Nodes[Root].Left, Node);
+		List->Nodes[Root].Left = Left;
+	}else{
+		int Right = RemoveHighscoreNode(List, List->Nodes[Root].Right, Node);
+		List->Nodes[Root].Right = Right;
+	}
+	return RebalanceHighscoreNode(List, Root);
+}
+
+static int BuildHighscoreTree(THighscoreList *List, int First, int Last){
+	// NOTE(fusion): Builds a perfectly balanced tree from nodes that are already
+	// in rank order, in O(n).
+	if(First > Last){
+		return -1;
+	}
+
+	int Middle = First + (Last - First) / 2;
+	int Left = BuildHighscoreTree(List, First, Middle - 1);
+	int Right = BuildHighscoreTree(List, Middle + 1, Last);
+	List->Nodes[Middle].Left = Left;
+	List->Nodes[Middle].Right = Right;
+	UpdateHighscoreNode(List, Middle);
+	return Middle;
+}
+
+static int GetHighscoreNodeRank(THighscoreList *List, int Node){
+	int Rank = 0;
+	int Current = List->Root;
+	while(Current != -1){
+		THighscoreNode *N = &List->Nodes[Current];
+		if(Current == Node){
+			return Rank + NodeSize(List, N->Left) + 1;
+		}else if(CompareHighscoreNodes(List, Node, Current) < 0){
+			Current = N->Left;
+		}else{
+			Rank += NodeSize(List, N->Left) + 1;
+			Current = N->Right;
+		}
+	}
+	return 0;
+}
+
+static int GetHighscoreNodeAt(THighscoreList *List, int Index){
+	int Current = List->Root;
+	while(Current != -1){
+		THighscoreNode *N = &List->Nodes[Current];
+		int LeftSize = NodeSize(List, N->Left);
+		if(Index < LeftSize){
+			Current = N->Left;
+		}else if(Index > LeftSize){
+			Index -= LeftSize + 1;
+			Current = N->Right;
+		}else{
+			break;
+		}
+	}
+	return Current;
+}
+
+// Highscore Lists
+//==============================================================================
+static int AppendHighscoreNode(THighscoreList *List,
+		const TCharacterHighscore *Character){
+	if(List->NumNodes >= List->MaxNodes){
+		int NewMaxNodes = std::max<int>(List->MaxNodes * 2, 64);
+		THighscoreNode *NewNodes = (THighscoreNode*)realloc(List->Nodes,
+				sizeof(THighscoreNode) * (usize)NewMaxNodes);
+		if(NewNodes == NULL){
+			PANIC("Failed to grow highscore list to %d nodes", NewMaxNodes);
+			return -1;
+		}
+		List->Nodes = NewNodes;
+		List->MaxNodes = NewMaxNodes;
+	}
+
+	int Node = List->NumNodes;
+	THighscoreNode *N = &List->Nodes[Node];
+	N->CharacterID = Character->CharacterID;
+	N->Level = Character->Level;
+	StringCopy(N->Name, sizeof(N->Name), Character->Name);
+	StringCopy(N->Profession, sizeof(N->Profession), Character->Profession);
+	N->Left = -1;
+	N->Right = -1;
+	N->Height = 1;
+	N->Size = 1;
+	List->NumNodes += 1;
+	return Node;
+}
+
+static void BuildHighscoreList(THighscoreList *List){
+	// NOTE(fusion): Rows should already be in rank order but if the collation
+	// ever disagrees with `CompareHighscoreNodes`, fall back to inserting them
+	// one by one rather than ending up with a broken tree.
+	bool Sorted = true;
+	for(int i = 1; i < List->NumNodes && Sorted; i += 1){
+		Sorted = (CompareHighscoreNodes(List, i - 1, i) < 0);
+	}
+
+	if(Sorted){
+		List->Root = BuildHighscoreTree(List, 0, List->NumNodes - 1);
+	}else{
+		LOG_WARN("Highscores for world %d are out of order", List->WorldID);
+		List->Root = -1;
+		for(int i = 0; i < List->NumNodes; i += 1){
+			List->Root = InsertHighscoreNode(List, List->Root, i);
+		}
+	}
+
+	RebuildHighscoreSlots(List, List->NumNodes);
+}
+
+static bool LoadHighscores(void){
+	DynamicArray<TCharacterHighscore> Characters;
+	if(!GetCharacterHighscores(&Characters)){
+		return false;
+	}
+
+	ClearHighscores();
+	THighscoreList *List = NULL;
+	for(int i = 0; i < Characters.Length(); i += 1){
+		if(List == NULL || List->WorldID != Characters[i].WorldID){
+			if(List != NULL){
+				BuildHighscoreList(List);
+			}
+			List = GetHighscoreList(Characters[i].WorldID);
+		}
+		AppendHighscoreNode(List, &Characters[i]);
+	}
+
+	if(List != NULL){
+		BuildHighscoreList(List);
+	}
+
+	// NOTE(fusion): The lists may be loaded in the middle of a transaction, in
+	// which case they could have picked up uncommitted changes.
+	g_NumHighscoreUndo = -1;
+	return true;
+}
+
+static bool CheckHighscores(void){
+	int DataVersion;
+	if(!GetDataVersion(&DataVersion)){
+		return g_HighscoresLoaded;
+	}
+
+	if(!g_HighscoresLoaded || DataVersion != g_HighscoresDataVersion){
+		if(!LoadHighscores()){
+			LOG_ERR("Failed to load highscores");
+			g_HighscoresLoaded = false;
+			return false;
+		}
+
+		g_HighscoresDataVersion = DataVersion;
+		g_HighscoresLoaded = true;
+	}
+
+	return true;
+}
+
+// Undo Log
+//==============================================================================
+static void LogHighscoreUndo(int Type, int WorldID, int CharacterID,
+		int Level, const char *Profession){
+	// NOTE(fusion): A negative count means the log overflowed or the lists were
+	// loaded since the last mark, in which case everything is reloaded on
+	// rollback.
+	if(g_NumHighscoreUndo < 0){
+		return;
+	}
+
+	if(g_NumHighscoreUndo >= NARRAY(g_HighscoreUndo)){
+		g_NumHighscoreUndo = -1;
+		return;
+	}
+
+	THighscoreUndo *Undo = &g_HighscoreUndo[g_NumHighscoreUndo];
+	Undo->Type = Type;
+	Undo->WorldID = WorldID;
+	Undo->CharacterID = CharacterID;
+	Undo->Level = Level;
+	StringCopy(Undo->Profession, sizeof(Undo->Profession), Profession);
+	g_NumHighscoreUndo += 1;
+}
+
+static void SetHighscoreNode(THighscoreList *List, int Node, int Level, const char *Profession){
+	THighscoreNode *N = &List->Nodes[Node];
+	StringCopy(N->Profession, sizeof(N->Profession), Profession);
+	if(N->Level != Level){
+		List->Root = RemoveHighscoreNode(List, List->Root, Node);
+		N = &List->Nodes[Node];
+		N->Left = -1;
+		N->Right = -1;
+		N->Height = 1;
+		N->Size = 1;
+		N->Level = Level;
+		List->Root = InsertHighscoreNode(List, List->Root, Node);
+	}
+}
+
+static void UndoHighscore(const THighscoreUndo *Undo){
+	THighscoreList *List = FindHighscoreList(Undo->WorldID);
+	int Slot = (List != NULL ? FindHighscoreSlot(List, Undo->CharacterID) : -1);
+	if(Slot == -1){
+		LOG_ERR("Character %d not found in highscores for world %d",
+				Undo->CharacterID, Undo->WorldID);
+		g_HighscoresLoaded = false;
+		return;
+	}
+
+	int Node = (int)List->Slots[Slot] - 1;
+	if(Undo->Type == HIGHSCORE_UNDO_INSERT){
+		// NOTE(fusion): Undos are applied in reverse order so an inserted node
+		// is always the last one. Slots can't be unlinked with linear probing
+		// but characters are rarely created so just rebuild them.
+		ASSERT(Node == (List->NumNodes - 1));
+		List->Root = RemoveHighscoreNode(List, List->Root, Node);
+		List->NumNodes -= 1;
+		RebuildHighscoreSlots(List, List->NumNodes);
+	}else{
+		SetHighscoreNode(List, Node, Undo->Level, Undo->Profession);
+	}
+}
+
+void MarkHighscores(void){
+	g_NumHighscoreUndo = 0;
+}
+
+void RollbackHighscores(void){
+	if(g_HighscoresLoaded){
+		if(g_NumHighscoreUndo < 0){
+			g_HighscoresLoaded = false;
+		}else{
+			for(int i = g_NumHighscoreUndo - 1; i >= 0 && g_HighscoresLoaded; i -= 1){
+				UndoHighscore(&g_HighscoreUndo[i]);
+			}
+		}
+	}
+	g_NumHighscoreUndo = 0;
+}
+
+// Highscores
+//==============================================================================
+bool InitHighscores(void){
+	if(!CheckHighscores()){
+		return false;
+	}
+
+	int NumEntries = 0;
+	for(int i = 0; i < g_NumHighscoreLists; i += 1){
+		NumEntries += g_HighscoreLists[i].NumNodes;
+	}
+	LOG("Highscore entries: %d", NumEntries);
+	return true;
+}
+
+void ExitHighscores(void){
+	ClearHighscores();
+	g_HighscoresLoaded = false;
+}
+
+void InsertHighscore(int WorldID, int CharacterID,
+		const char *Name, int Level, const char *Profession){
+	ASSERT(Name != NULL && Profession != NULL);
+	// NOTE(fusion): Updates are only applied to lists that are loaded, else
+	// they'll be picked up from the database when they're loaded again.
+	if(!g_HighscoresLoaded){
+		return;
+	}
+
+	THighscoreList *List = GetHighscoreList(WorldID);
+	if(FindHighscoreSlot(List, CharacterID) != -1){
+		return;
+	}
+
+	LogHighscoreUndo(HIGHSCORE_UNDO_INSERT, WorldID, CharacterID, Level, Profession);
+	TCharacterHighscore Character = {};
+	Character.WorldID = WorldID;
+	Character.CharacterID = CharacterID;
+	Character.Level = Level;
+	StringCopy(Character.Name, sizeof(Character.Name), Name);
+	StringCopy(Character.Profession, sizeof(Character.Profession), Profession);
+	int Node = AppendHighscoreNode(List, &Character);
+	List->Root = InsertHighscoreNode(List, List->Root, Node);
+	if((List->NumNodes * 2) > List->NumSlots){
+		RebuildHighscoreSlots(List, List->NumNodes);
+	}else{
+		LinkHighscoreNode(List, Node);
+	}
+}
+
+void UpdateHighscore(int WorldID, int CharacterID, int Level, const char *Profession){
+	ASSERT(Profession != NULL);
+	// NOTE(fusion): Characters that aren't in the list (e.g. `NO_STATISTICS`)
+	// are left out.
+	if(!g_HighscoresLoaded){
+		return;
+	}
+
+	THighscoreList *List = FindHighscoreList(WorldID);
+	int Slot = (List != NULL ? FindHighscoreSlot(List, CharacterID) : -1);
+	if(Slot == -1){
+		return;
+	}
+
+	int Node = (int)List->Slots[Slot] - 1;
+	THighscoreNode *N = &List->Nodes[Node];
+	LogHighscoreUndo(HIGHSCORE_UNDO_UPDATE, WorldID, CharacterID, N->Level, N->Profession);
+	SetHighscoreNode(List, Node, Level, Profession);
+}
+
+bool GetHighscores(int WorldID, int FirstRank, int MaxEntries,
+		const char *CharacterName, int *NumEntries, int *CharacterRank,
+		DynamicArray<THighscoreEntry> *Entries){
+	ASSERT(FirstRank >= 1 && MaxEntries >= 0 && CharacterName != NULL
+			&& NumEntries != NULL && CharacterRank != NULL && Entries != NULL);
+	if(!CheckHighscores()){
+		return false;
+	}
+
+	*NumEntries = 0;
+	*CharacterRank = 0;
+	THighscoreList *List = FindHighscoreList(WorldID);
+	if(List == NULL){
+		return true;
+	}
+
+	*NumEntries = List->NumNodes;
+	if(!StringEmpty(CharacterName)){
+		bool Found;
+		int CharacterID, CharacterWorldID;
+		if(FindCharacterName(CharacterName, &Found, &CharacterID, &CharacterWorldID)
+				&& Found && CharacterWorldID == WorldID){
+			int Slot = FindHighscoreSlot(List, CharacterID);
+			if(Slot != -1){
+				*CharacterRank = GetHighscoreNodeRank(List, (int)List->Slots[Slot] - 1);
+			}
+		}
+	}
+
+	int Rank = FirstRank;
+	int Node = GetHighscoreNodeAt(List, Rank - 1);
+	while(Node != -1 && Entries->Length() < MaxEntries){
+		THighscoreEntry Entry = {};
+		Entry.Rank = Rank;
+		Entry.Level = List->Nodes[Node].Level;
+		memcpy(Entry.Name, List->Nodes[Node].Name, sizeof(Entry.Name));
+		memcpy(Entry.Profession, List->Nodes[Node].Profession, sizeof(Entry.Profession));
+		Entries->Push(Entry);
+
+		Rank += 1;
+		Node = GetHighscoreNodeAt(List, Rank - 1);
+	}
+
+	return true;
+}
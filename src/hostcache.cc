@@ -32,6 +32,33 @@ void ExitHostCache(void){
 	}
 }
 
+void ResizeHostCache(int NewMaxCachedHostNames){
+	ASSERT(g_CachedHostNames != NULL && NewMaxCachedHostNames > 0);
+
+	// NOTE(fusion): Keep the most recently resolved host names when shrinking.
+	if(NewMaxCachedHostNames < g_MaxCachedHostNames){
+		std::sort(g_CachedHostNames, g_CachedHostNames + g_MaxCachedHostNames,
+				[](const THostCacheEntry &A, const THostCacheEntry &B){
+					return A.ResolveTime > B.ResolveTime;
+				});
+	}
+
+	THostCacheEntry *NewCachedHostNames = (THostCacheEntry*)realloc(
+			g_CachedHostNames, sizeof(THostCacheEntry) * (usize)NewMaxCachedHostNames);
+	if(NewCachedHostNames == NULL){
+		PANIC("Failed to resize host cache from %d to %d",
+				g_MaxCachedHostNames, NewMaxCachedHostNames);
+		return;
+	}
+
+	for(int i = g_MaxCachedHostNames; i < NewMaxCachedHostNames; i += 1){
+		memset(&NewCachedHostNames[i], 0, sizeof(THostCacheEntry));
+	}
+
+	g_CachedHostNames = NewCachedHostNames;
+	g_MaxCachedHostNames = NewMaxCachedHostNames;
+}
+
 static bool DoResolveHostName(const char *HostName, int *OutAddr){
 	ASSERT(HostName != NULL && OutAddr != NULL);
 	addrinfo *Result = NULL;
@@ -0,0 +1,473 @@
+#include "querymanager.hh"
+
+#if OS_LINUX
+#	include <errno.h>
+#	include <unistd.h>
+#else
+#	error "Operating system not currently supported."
+#endif
+
+// NOTE(fusion): Game servers send kill statistics every few minutes and they're
+// only read by the website, so they're accumulated in memory and merged into
+// `KillStatistics` with a single transaction every `KillStatisticsFlushInterval`
+// and at shutdown. Race names are interned into small integer ids, shared by all
+// worlds, and each world has a dense array of counters indexed by race id.
+//	Every batch is also appended to a journal before it's accumulated, which is
+// replayed at startup in case the query manager didn't shut down cleanly, and
+// truncated after each flush. If the process dies right between committing the
+// flush and truncating the journal, that last interval would be counted twice,
+// but that's a much smaller window than losing the whole interval.
+//	Counters only ever hold statistics from a single hour, which are also added
+// to that hour's bucket in `KillStatisticsHistory` when flushed, so counters are
+// flushed early whenever a new hour starts.
+struct TKillCounter{
+	int TimesKilled;
+	int PlayersKilled;
+};
+
+struct TKillWorld{
+	int WorldID;
+	bool Dirty;
+	int NumCounters;
+	TKillCounter *Counters;
+};
+
+static char (*g_RaceNames)[30];
+static int g_NumRaces;
+static int g_MaxRaces;
+static int *g_RaceSlots;
+static int g_NumRaceSlots;
+static TKillWorld *g_KillWorlds;
+static int g_NumKillWorlds;
+static int g_KillPendingHour;
+static FILE *g_KillJournal;
+static TTimer g_KillStatisticsTimer;
+
+static uint32 HashRaceName(const char *RaceName){
+	// NOTE(fusion): ASCII case insensitive, to match the `NOCASE` collation of
+	// `KillStatistics.RaceName`.
+	uint32 Hash = 0x811C9DC5U;
+	for(int i = 0; RaceName[i] != 0; i += 1){
+		Hash ^= (uint32)tolower((uint8)RaceName[i]);
+		Hash *= 0x01000193U;
+	}
+	return Hash;
+}
+
+static void LinkRaceName(int RaceID){
+	// NOTE(fusion): Slots hold the race id plus one, so zero is empty.
+	uint32 Mask = (uint32)(g_NumRaceSlots - 1);
+	uint32 Slot = HashRaceName(g_RaceNames[RaceID]) & Mask;
+	while(g_RaceSlots[Slot] != 0){
+		Slot = (Slot + 1) & Mask;
+	}
+	g_RaceSlots[Slot] = RaceID + 1;
+}
+
+static int FindRaceID(const char *RaceName){
+	if(g_NumRaces == 0){
+		return -1;
+	}
+
+	uint32 Mask = (uint32)(g_NumRaceSlots - 1);
+	uint32 Slot = HashRaceName(RaceName) & Mask;
+	while(g_RaceSlots[Slot] != 0){
+		int RaceID = g_RaceSlots[Slot] - 1;
+		if(StringEqCI(g_RaceNames[RaceID], RaceName)){
+			return RaceID;
+		}
+		Slot = (Slot + 1) & Mask;
+	}
+	return -1;
+}
+
+static int InternRaceName(const char *RaceName){
+	int RaceID = FindRaceID(RaceName);
+	if(RaceID != -1){
+		return RaceID;
+	}
+
+	if(g_NumRaces >= g_MaxRaces){
+		int NewMaxRaces = std::max<int>(g_MaxRaces * 2, 256);
+		char (*NewRaceNames)[30] = (char(*)[30])realloc(g_RaceNames,
+				sizeof(g_RaceNames[0]) * (usize)NewMaxRaces);
+		if(NewRaceNames == NULL){
+			PANIC("Failed to grow race names to %d", NewMaxRaces);
+			return -1;
+		}
+		g_RaceNames = NewRaceNames;
+		g_MaxRaces = NewMaxRaces;
+	}
+
+	RaceID = g_NumRaces;
+	StringCopy(g_RaceNames[RaceID], sizeof(g_RaceNames[RaceID]), RaceName);
+	g_NumRaces += 1;
+
+	if((g_NumRaces * 2) > g_NumRaceSlots){
+		int NumSlots = std::max<int>(g_NumRaceSlots * 2, 512);
+		free(g_RaceSlots);
+		g_RaceSlots = (int*)calloc((usize)NumSlots, sizeof(int));
+		if(g_RaceSlots == NULL){
+			PANIC("Failed to allocate race table with %d slots", NumSlots);
+			return -1;
+		}
+
+		g_NumRaceSlots = NumSlots;
+		for(int i = 0; i < g_NumRaces; i += 1){
+			LinkRaceName(i);
+		}
+	}else{
+		LinkRaceName(RaceID);
+	}
+
+	return RaceID;
+}
+
+static TKillWorld *FindKillWorld(int WorldID){
+	for(int i = 0; i < g_NumKillWorlds; i += 1){
+		if(g_KillWorlds[i].WorldID == WorldID){
+			return &g_KillWorlds[i];
+		}
+	}
+	return NULL;
+}
+
+static TKillWorld *GetOrCreateKillWorld(int WorldID){
+	TKillWorld *World = FindKillWorld(WorldID);
+	if(World == NULL){
+		TKillWorld *NewKillWorlds = (TKillWorld*)realloc(g_KillWorlds,
+				sizeof(TKillWorld) * (usize)(g_NumKillWorlds + 1));
+		if(NewKillWorlds == NULL){
+			PANIC("Failed to grow kill statistics worlds to %d", g_NumKillWorlds + 1);
+			return NULL;
+		}
+
+		g_KillWorlds = NewKillWorlds;
+		World = &g_KillWorlds[g_NumKillWorlds];
+		g_NumKillWorlds += 1;
+
+		memset(World, 0, sizeof(TKillWorld));
+		World->WorldID = WorldID;
+	}
+	return World;
+}
+
+static void AddKillCounter(TKillWorld *World, int RaceID, int TimesKilled, int PlayersKilled){
+	if(RaceID >= World->NumCounters){
+		int NewNumCounters = std::max<int>(g_MaxRaces, RaceID + 1);
+		TKillCounter *NewCounters = (TKillCounter*)realloc(World->Counters,
+				sizeof(TKillCounter) * (usize)NewNumCounters);
+		if(NewCounters == NULL){
+			PANIC("Failed to grow kill counters to %d", NewNumCounters);
+			return;
+		}
+
+		memset(&NewCounters[World->NumCounters], 0,
+				sizeof(TKillCounter) * (usize)(NewNumCounters - World->NumCounters));
+		World->Counters = NewCounters;
+		World->NumCounters = NewNumCounters;
+	}
+
+	World->Counters[RaceID].TimesKilled += TimesKilled;
+	World->Counters[RaceID].PlayersKilled += PlayersKilled;
+	World->Dirty = true;
+}
+
+static int GetKillHour(void){
+	int Now = (int)time(NULL);
+	return Now - (Now % 3600);
+}
+
+static bool KillStatisticsDirty(void){
+	for(int i = 0; i < g_NumKillWorlds; i += 1){
+		if(g_KillWorlds[i].Dirty){
+			return true;
+		}
+	}
+	return false;
+}
+
+static void SetPendingKillHour(int Hour){
+	// NOTE(fusion): If the previous hour can't be flushed, new statistics are
+	// still accumulated into it rather than being dropped.
+	if(Hour != g_KillPendingHour){
+		if(KillStatisticsDirty() && !FlushKillStatistics()){
+			LOG_ERR("Failed to flush kill statistics for hour %d", g_KillPendingHour);
+			return;
+		}
+		g_KillPendingHour = Hour;
+	}
+}
+
+static void AccumulateKillStatistics(int WorldID, int NumStats, const TKillStatistics *Stats){
+	TKillWorld *World = GetOrCreateKillWorld(WorldID);
+	for(int i = 0; i < NumStats; i += 1){
+		if(Stats[i].TimesKilled != 0 || Stats[i].PlayersKilled != 0){
+			AddKillCounter(World, InternRaceName(Stats[i].RaceName),
+					Stats[i].TimesKilled, Stats[i].PlayersKilled);
+		}
+	}
+}
+
+static bool AppendKillJournal(int WorldID, int Hour, int NumStats, const TKillStatistics *Stats){
+	if(g_KillJournal == NULL){
+		return true;
+	}
+
+	// NOTE(fusion): One line per race, with the race name last since it may have
+	// spaces. A line without its newline is a torn write and ignored on replay.
+	for(int i = 0; i < NumStats; i += 1){
+		fprintf(g_KillJournal, "%d\t%d\t%d\t%d\t%s\n", WorldID, Hour,
+				Stats[i].TimesKilled, Stats[i].PlayersKilled, Stats[i].RaceName);
+	}
+
+	if(fflush(g_KillJournal) != 0 || ferror(g_KillJournal)){
+		LOG_ERR("Failed to write kill statistics journal \"%s\": (%d) %s",
+				g_KillStatisticsJournal, errno, strerrordesc_np(errno));
+		clearerr(g_KillJournal);
+		return false;
+	}
+
+	return true;
+}
+
+static void TruncateKillJournal(void){
+	// NOTE(fusion): The journal is opened in append mode so writes always go to
+	// the end of the file, wherever that is after truncating it.
+	if(g_KillJournal != NULL && ftruncate(fileno(g_KillJournal), 0) == -1){
+		LOG_ERR("Failed to truncate kill statistics journal \"%s\": (%d) %s",
+				g_KillStatisticsJournal, errno, strerrordesc_np(errno));
+	}
+}
+
+static int ReplayKillJournal(void){
+	// NOTE(fusion): This is called before the journal is opened for writing, so
+	// hours that are flushed along the way don't truncate it.
+	FILE *File = fopen(g_KillStatisticsJournal, "rb");
+	if(File == NULL){
+		return 0;
+	}
+
+	int NumEntries = 0;
+	char Line[256];
+	while(fgets(Line, sizeof(Line), File) != NULL){
+		int LineSize = (int)strlen(Line);
+		if(LineSize == 0 || Line[LineSize - 1] != '\n'){
+			LOG_WARN("Ignoring incomplete kill statistics journal entry");
+			continue;
+		}
+		Line[LineSize - 1] = 0;
+
+		// NOTE(fusion): A tab in a `scanf` format matches any run of whitespace,
+		// including none, so the one before the race name is checked by hand to
+		// keep leading spaces in the name and reject entries without one.
+		int WorldID, Hour, CountersEnd = 0;
+		TKillStatistics Entry = {};
+		if(sscanf(Line, "%d\t%d\t%d\t%d%n", &WorldID, &Hour,
+					&Entry.TimesKilled, &Entry.PlayersKilled, &CountersEnd) != 4
+				|| Line[CountersEnd] != '\t'
+				|| StringEmpty(&Line[CountersEnd + 1])
+				|| !StringCopy(Entry.RaceName, sizeof(Entry.RaceName), &Line[CountersEnd + 1])){
+			LOG_WARN("Ignoring invalid kill statistics journal entry \"%s\"", Line);
+			continue;
+		}
+
+		SetPendingKillHour(Hour);
+		AccumulateKillStatistics(WorldID, 1, &Entry);
+		NumEntries += 1;
+	}
+
+	fclose(File);
+	return NumEntries;
+}
+
+static void KillStatisticsJob(TTimer *Timer){
+	FlushKillStatistics();
+	ScheduleKillStatisticsFlush();
+}
+
+void ScheduleKillStatisticsFlush(void){
+	if(g_KillStatisticsFlushInterval > 0){
+		ScheduleTimer(&g_TimerWheel, &g_KillStatisticsTimer,
+				(int64)g_MonotonicTimeMS + g_KillStatisticsFlushInterval);
+	}else{
+		CancelTimer(&g_KillStatisticsTimer);
+	}
+}
+
+bool InitKillStatistics(void){
+	int NumEntries = ReplayKillJournal();
+	if(!StringEmpty(g_KillStatisticsJournal)){
+		g_KillJournal = fopen(g_KillStatisticsJournal, "ab");
+		if(g_KillJournal == NULL){
+			LOG_ERR("Failed to open kill statistics journal \"%s\": (%d) %s",
+					g_KillStatisticsJournal, errno, strerrordesc_np(errno));
+			return false;
+		}
+	}
+
+	if(NumEntries > 0){
+		LOG("Recovered %d kill statistics entries from journal", NumEntries);
+		if(!FlushKillStatistics()){
+			return false;
+		}
+	}
+
+	InitTimer(&g_KillStatisticsTimer, KillStatisticsJob, NULL);
+	ScheduleKillStatisticsFlush();
+	return true;
+}
+
+void ExitKillStatistics(void){
+	CancelTimer(&g_KillStatisticsTimer);
+	if(!FlushKillStatistics()){
+		LOG_ERR("Failed to flush kill statistics, they're kept in the journal");
+	}
+
+	if(g_KillJournal != NULL){
+		fclose(g_KillJournal);
+		g_KillJournal = NULL;
+	}
+
+	for(int i = 0; i < g_NumKillWorlds; i += 1){
+		free(g_KillWorlds[i].Counters);
+	}
+
+	free(g_KillWorlds);
+	free(g_RaceNames);
+	free(g_RaceSlots);
+	g_KillWorlds = NULL;
+	g_NumKillWorlds = 0;
+	g_RaceNames = NULL;
+	g_NumRaces = 0;
+	g_MaxRaces = 0;
+	g_RaceSlots = NULL;
+	g_NumRaceSlots = 0;
+}
+
+bool LogKillStatistics(int WorldID, int NumStats, const TKillStatistics *Stats){
+	ASSERT(NumStats >= 0 && (Stats != NULL || NumStats == 0));
+	if(NumStats == 0){
+		return true;
+	}
+
+	SetPendingKillHour(GetKillHour());
+	if(!AppendKillJournal(WorldID, g_KillPendingHour, NumStats, Stats)){
+		return false;
+	}
+
+	AccumulateKillStatistics(WorldID, NumStats, Stats);
+	InvalidateKillStatisticsResponse(WorldID);
+	if(g_KillStatisticsFlushInterval <= 0){
+		return FlushKillStatistics();
+	}
+
+	return true;
+}
+
+bool FlushKillStatistics(void){
+	if(!KillStatisticsDirty()){
+		return true;
+	}
+
+	TransactionScope Tx("FlushKillStatistics");
+	if(!Tx.Begin()){
+		return false;
+	}
+
+	DynamicArray<TKillStatistics> Stats;
+	for(int i = 0; i < g_NumKillWorlds; i += 1){
+		TKillWorld *World = &g_KillWorlds[i];
+		if(!World->Dirty){
+			continue;
+		}
+
+		Stats.Resize(0);
+		for(int RaceID = 0; RaceID < World->NumCounters; RaceID += 1){
+			const TKillCounter *Counter = &World->Counters[RaceID];
+			if(Counter->TimesKilled != 0 || Counter->PlayersKilled != 0){
+				TKillStatistics Entry = {};
+				StringCopy(Entry.RaceName, sizeof(Entry.RaceName), g_RaceNames[RaceID]);
+				Entry.TimesKilled = Counter->TimesKilled;
+				Entry.PlayersKilled = Counter->PlayersKilled;
+				Stats.Push(Entry);
+			}
+		}
+
+		if(Stats.Length() > 0){
+			if(!MergeKillStatistics(World->WorldID, Stats.Length(), Stats.begin())
+					|| !MergeKillStatisticsHistory(World->WorldID, g_KillPendingHour,
+							Stats.Length(), Stats.begin())){
+				return false;
+			}
+		}
+	}
+
+	if(!Tx.Commit()){
+		return false;
+	}
+
+	for(int i = 0; i < g_NumKillWorlds; i += 1){
+		TKillWorld *World = &g_KillWorlds[i];
+		if(World->Dirty){
+			memset(World->Counters, 0, sizeof(TKillCounter) * (usize)World->NumCounters);
+			World->Dirty = false;
+		}
+	}
+
+	TruncateKillJournal();
+	return true;
+}
+
+void MergePendingKillStatistics(int WorldID, DynamicArray<TKillStatistics> *Stats){
+	ASSERT(Stats != NULL);
+	TKillWorld *World = FindKillWorld(WorldID);
+	if(World == NULL || !World->Dirty){
+		return;
+	}
+
+	// NOTE(fusion): Races that are already persisted are added in place and
+	// marked by clearing the local copy of their counter. Whatever is left is
+	// appended as new rows.
+	TKillCounter *Pending = (TKillCounter*)malloc(sizeof(TKillCounter) * (usize)World->NumCounters);
+	if(Pending == NULL){
+		PANIC("Failed to allocate %d pending kill counters", World->NumCounters);
+		return;
+	}
+	memcpy(Pending, World->Counters, sizeof(TKillCounter) * (usize)World->NumCounters);
+
+	for(int i = 0; i < Stats->Length(); i += 1){
+		int RaceID = FindRaceID((*Stats)[i].RaceName);
+		if(RaceID != -1 && RaceID < World->NumCounters){
+			(*Stats)[i].TimesKilled += Pending[RaceID].TimesKilled;
+			(*Stats)[i].PlayersKilled += Pending[RaceID].PlayersKilled;
+			Pending[RaceID].TimesKilled = 0;
+			Pending[RaceID].PlayersKilled = 0;
+		}
+	}
+
+	for(int RaceID = 0; RaceID < World->NumCounters; RaceID += 1){
+		if(Pending[RaceID].TimesKilled != 0 || Pending[RaceID].PlayersKilled != 0){
+			TKillStatistics Entry = {};
+			StringCopy(Entry.RaceName, sizeof(Entry.RaceName), g_RaceNames[RaceID]);
+			Entry.TimesKilled = Pending[RaceID].TimesKilled;
+			Entry.PlayersKilled = Pending[RaceID].PlayersKilled;
+			Stats->Push(Entry);
+		}
+	}
+
+	free(Pending);
+}
+
+bool GetKillStatisticsWindow(int WorldID, int From, int To, DynamicArray<TKillStatistics> *Stats){
+	ASSERT(Stats != NULL);
+	if(!GetKillStatisticsHistory(WorldID, From, To, Stats)){
+		return false;
+	}
+
+	if(From <= g_KillPendingHour && g_KillPendingHour < To){
+		MergePendingKillStatistics(WorldID, Stats);
+	}
+
+	return true;
+}
@@ -0,0 +1,252 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): Every character name is kept in memory so name lookups, which
+// are done by most game server queries and by the website, and name checks for
+// new characters don't need to go through the database. Entries are stored in
+// a dense array, with names in a single string buffer, and indexed by an open
+// addressing hash table of entry indices, for about 20 bytes per character plus
+// its name.
+//	The index is loaded from the database when first used and reloaded whenever
+// the database's `data_version` changes (e.g. when a character is renamed from
+// the sqlite shell). Characters created by us are added as they're created, and
+// removed again if the transaction that created them is rolled back.
+struct TNameIndexEntry{
+	uint32 NameOffset;
+	int CharacterID;
+	int WorldID;
+};
+
+static TNameIndexEntry *g_NameEntries;
+static int g_NumNameEntries;
+static int g_MaxNameEntries;
+static char *g_NameText;
+static uint32 g_NameTextSize;
+static uint32 g_MaxNameTextSize;
+static uint32 *g_NameSlots;
+static int g_NumNameSlots;
+static int g_NameIndexMark;
+static uint32 g_NameTextMark;
+static int g_NameIndexDataVersion;
+static bool g_NameIndexLoaded;
+
+static uint32 HashCharacterName(const char *Name){
+	// NOTE(fusion): ASCII case insensitive, to match the `NOCASE` collation of
+	// `Characters.Name`.
+	uint32 Hash = 0x811C9DC5U;
+	for(int i = 0; Name[i] != 0; i += 1){
+		Hash ^= (uint32)tolower((uint8)Name[i]);
+		Hash *= 0x01000193U;
+	}
+	return Hash;
+}
+
+static void ClearNameIndex(void){
+	free(g_NameEntries);
+	free(g_NameText);
+	free(g_NameSlots);
+	g_NameEntries = NULL;
+	g_NumNameEntries = 0;
+	g_MaxNameEntries = 0;
+	g_NameText = NULL;
+	g_NameTextSize = 0;
+	g_MaxNameTextSize = 0;
+	g_NameSlots = NULL;
+	g_NumNameSlots = 0;
+}
+
+static void LinkNameEntry(int Index){
+	// NOTE(fusion): Slots hold the entry index plus one, so zero is empty.
+	uint32 Mask = (uint32)(g_NumNameSlots - 1);
+	uint32 Slot = HashCharacterName(&g_NameText[g_NameEntries[Index].NameOffset]) & Mask;
+	while(g_NameSlots[Slot] != 0){
+		Slot = (Slot + 1) & Mask;
+	}
+	g_NameSlots[Slot] = (uint32)Index + 1;
+}
+
+static void RebuildNameSlots(int MinEntries){
+	int NumSlots = 1024;
+	while(NumSlots < (MinEntries * 2)){
+		NumSlots *= 2;
+	}
+
+	if(NumSlots != g_NumNameSlots){
+		free(g_NameSlots);
+		g_NameSlots = (uint32*)malloc(sizeof(uint32) * (usize)NumSlots);
+		if(g_NameSlots == NULL){
+			PANIC("Failed to allocate name index with %d slots", NumSlots);
+			return;
+		}
+		g_NumNameSlots = NumSlots;
+	}
+
+	memset(g_NameSlots, 0, sizeof(uint32) * (usize)g_NumNameSlots);
+	for(int i = 0; i < g_NumNameEntries; i += 1){
+		LinkNameEntry(i);
+	}
+}
+
+static int FindNameEntry(const char *Name){
+	if(g_NumNameEntries == 0){
+		return -1;
+	}
+
+	uint32 Mask = (uint32)(g_NumNameSlots - 1);
+	uint32 Slot = HashCharacterName(Name) & Mask;
+	while(g_NameSlots[Slot] != 0){
+		int Index = (int)g_NameSlots[Slot] - 1;
+		if(StringEqCI(&g_NameText[g_NameEntries[Index].NameOffset], Name)){
+			return Index;
+		}
+		Slot = (Slot + 1) & Mask;
+	}
+	return -1;
+}
+
+static void AppendNameEntry(int CharacterID, int WorldID, const char *Name){
+	uint32 NameSize = (uint32)strlen(Name) + 1;
+	if((g_NameTextSize + NameSize) > g_MaxNameTextSize){
+		uint32 NewMaxNameTextSize = std::max<uint32>(g_MaxNameTextSize, (uint32)KB(16));
+		while(NewMaxNameTextSize < (g_NameTextSize + NameSize)){
+			NewMaxNameTextSize *= 2;
+		}
+
+		char *NewNameText = (char*)realloc(g_NameText, NewMaxNameTextSize);
+		if(NewNameText == NULL){
+			PANIC("Failed to grow name index text to %u bytes", NewMaxNameTextSize);
+			return;
+		}
+		g_NameText = NewNameText;
+		g_MaxNameTextSize = NewMaxNameTextSize;
+	}
+
+	if(g_NumNameEntries >= g_MaxNameEntries){
+		int NewMaxNameEntries = std::max<int>(g_MaxNameEntries * 2, 1024);
+		TNameIndexEntry *NewNameEntries = (TNameIndexEntry*)realloc(g_NameEntries,
+				sizeof(TNameIndexEntry) * (usize)NewMaxNameEntries);
+		if(NewNameEntries == NULL){
+			PANIC("Failed to grow name index to %d entries", NewMaxNameEntries);
+			return;
+		}
+		g_NameEntries = NewNameEntries;
+		g_MaxNameEntries = NewMaxNameEntries;
+	}
+
+	TNameIndexEntry *Entry = &g_NameEntries[g_NumNameEntries];
+	Entry->NameOffset = g_NameTextSize;
+	Entry->CharacterID = CharacterID;
+	Entry->WorldID = WorldID;
+	memcpy(&g_NameText[g_NameTextSize], Name, NameSize);
+	g_NameTextSize += NameSize;
+	g_NumNameEntries += 1;
+}
+
+static bool LoadNameIndex(void){
+	DynamicArray<TCharacterName> Names;
+	if(!GetCharacterNames(&Names)){
+		return false;
+	}
+
+	ClearNameIndex();
+	for(int i = 0; i < Names.Length(); i += 1){
+		AppendNameEntry(Names[i].CharacterID, Names[i].WorldID, Names[i].Name);
+	}
+	RebuildNameSlots(g_NumNameEntries);
+
+	// NOTE(fusion): The index may be loaded in the middle of a transaction, in
+	// which case it could have picked up uncommitted characters.
+	g_NameIndexMark = -1;
+	return true;
+}
+
+static bool CheckNameIndex(void){
+	int DataVersion;
+	if(!GetDataVersion(&DataVersion)){
+		return false;
+	}
+
+	if(!g_NameIndexLoaded || DataVersion != g_NameIndexDataVersion){
+		if(!LoadNameIndex()){
+			LOG_ERR("Failed to load name index");
+			g_NameIndexLoaded = false;
+			return false;
+		}
+
+		g_NameIndexDataVersion = DataVersion;
+		g_NameIndexLoaded = true;
+	}
+
+	return true;
+}
+
+bool InitNameIndex(void){
+	if(!CheckNameIndex()){
+		return false;
+	}
+
+	LOG("Character names: %d (%dKB)", g_NumNameEntries,
+			(int)((sizeof(TNameIndexEntry) * (usize)g_MaxNameEntries
+				+ sizeof(uint32) * (usize)g_NumNameSlots
+				+ (usize)g_MaxNameTextSize) >> 10));
+	return true;
+}
+
+void ExitNameIndex(void){
+	ClearNameIndex();
+	g_NameIndexLoaded = false;
+}
+
+void MarkNameIndex(void){
+	g_NameIndexMark = g_NumNameEntries;
+	g_NameTextMark = g_NameTextSize;
+}
+
+void RollbackNameIndex(void){
+	// NOTE(fusion): Entries added after the mark are dropped, which can only be
+	// done by rebuilding the table with open addressing, but it doesn't touch
+	// the database and only happens if a character was actually created.
+	if(g_NameIndexLoaded){
+		if(g_NameIndexMark < 0){
+			g_NameIndexLoaded = false;
+		}else if(g_NumNameEntries > g_NameIndexMark){
+			g_NumNameEntries = g_NameIndexMark;
+			g_NameTextSize = g_NameTextMark;
+			RebuildNameSlots(g_NumNameEntries);
+		}
+	}
+}
+
+void InsertCharacterName(int CharacterID, int WorldID, const char *Name){
+	ASSERT(Name != NULL);
+	if(g_NameIndexLoaded && FindNameEntry(Name) == -1){
+		AppendNameEntry(CharacterID, WorldID, Name);
+		if((g_NumNameEntries * 2) > g_NumNameSlots){
+			RebuildNameSlots(g_NumNameEntries);
+		}else{
+			LinkNameEntry(g_NumNameEntries - 1);
+		}
+	}
+}
+
+bool FindCharacterName(const char *Name, bool *Found, int *CharacterID, int *WorldID){
+	ASSERT(Name != NULL && Found != NULL);
+	// NOTE(fusion): Returns false if the index couldn't be loaded, in which case
+	// the database should be used instead.
+	if(!CheckNameIndex()){
+		return false;
+	}
+
+	int Index = FindNameEntry(Name);
+	*Found = (Index != -1);
+	if(Index != -1){
+		if(CharacterID != NULL){
+			*CharacterID = g_NameEntries[Index].CharacterID;
+		}
+
+		if(WorldID != NULL){
+			*WorldID = g_NameEntries[Index].WorldID;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,200 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): The online list of each world only lives in memory. The game
+// server sends the whole list every few minutes and it's only ever needed for
+// the website, so there is no point in having the database rewrite it over and
+// over. It's replaced as a whole once the new list is fully parsed, and kept
+// sorted by name so lookups and updates don't need to scan it. Only the main
+// thread touches it.
+//	Game servers may also send deltas against a sequence number, which are only
+// applied on top of the list they were built against. Lists replaced with the
+// legacy `QUERY_CREATE_PLAYERLIST` have no sequence number so the next delta
+// will always ask for the full list.
+struct TOnlineList{
+	int WorldID;
+	uint32 Sequence;
+	int NumCharacters;
+	TOnlineListEntry *Characters;
+};
+
+static TOnlineList *g_OnlineLists;
+static int g_NumOnlineLists;
+
+static bool OnlineEntryLess(const TOnlineListEntry &A, const TOnlineListEntry &B){
+	return StringCompareCI(A.Name, B.Name) < 0;
+}
+
+static TOnlineList *FindOnlineList(int WorldID){
+	for(int i = 0; i < g_NumOnlineLists; i += 1){
+		if(g_OnlineLists[i].WorldID == WorldID){
+			return &g_OnlineLists[i];
+		}
+	}
+	return NULL;
+}
+
+static TOnlineList *GetOrCreateOnlineList(int WorldID){
+	TOnlineList *List = FindOnlineList(WorldID);
+	if(List == NULL){
+		TOnlineList *NewOnlineLists = (TOnlineList*)realloc(g_OnlineLists,
+				sizeof(TOnlineList) * (usize)(g_NumOnlineLists + 1));
+		if(NewOnlineLists == NULL){
+			PANIC("Failed to grow online lists to %d", g_NumOnlineLists + 1);
+			return NULL;
+		}
+
+		g_OnlineLists = NewOnlineLists;
+		List = &g_OnlineLists[g_NumOnlineLists];
+		g_NumOnlineLists += 1;
+
+		memset(List, 0, sizeof(TOnlineList));
+		List->WorldID = WorldID;
+	}
+	return List;
+}
+
+void ExitOnlineLists(void){
+	if(g_OnlineLists != NULL){
+		for(int i = 0; i < g_NumOnlineLists; i += 1){
+			free(g_OnlineLists[i].Characters);
+		}
+
+		free(g_OnlineLists);
+		g_OnlineLists = NULL;
+		g_NumOnlineLists = 0;
+	}
+}
+
+int GetOnlineCharacterCount(int WorldID){
+	TOnlineList *List = FindOnlineList(WorldID);
+	return (List != NULL ? List->NumCharacters : 0);
+}
+
+void GetOnlineCharacters(int WorldID, TArena *Arena, DynamicArray<TOnlineCharacter> *Characters){
+	ASSERT(Arena != NULL && Characters != NULL);
+	TOnlineList *List = FindOnlineList(WorldID);
+	if(List == NULL){
+		return;
+	}
+
+	// NOTE(fusion): Strings are copied because the response may only be written
+	// after the list is replaced, possibly by a network thread.
+	Characters->Reserve(Characters->Length() + List->NumCharacters);
+	for(int i = 0; i < List->NumCharacters; i += 1){
+		TOnlineCharacter Character = {};
+		Character.Name = ArenaStringCopy(Arena, List->Characters[i].Name);
+		Character.Level = List->Characters[i].Level;
+		Character.Profession = ArenaStringCopy(Arena, List->Characters[i].Profession);
+		Characters->Push(Character);
+	}
+}
+
+static void SortOnlineCharacters(int WorldID, int *NumCharacters, TOnlineListEntry *Characters){
+	// NOTE(fusion): Duplicate names used to fail the whole update on the primary
+	// key of the `OnlineCharacters` table but now only the first one is kept.
+	if(*NumCharacters > 0){
+		std::stable_sort(Characters, Characters + *NumCharacters, OnlineEntryLess);
+		int NumUnique = 1;
+		for(int i = 1; i < *NumCharacters; i += 1){
+			if(!StringEqCI(Characters[NumUnique - 1].Name, Characters[i].Name)){
+				Characters[NumUnique] = Characters[i];
+				NumUnique += 1;
+			}else{
+				LOG_WARN("Duplicate online character \"%s\" on world %d",
+						Characters[i].Name, WorldID);
+			}
+		}
+		*NumCharacters = NumUnique;
+	}
+}
+
+int ReplaceOnlineCharacters(int WorldID, uint32 Sequence,
+		int NumCharacters, TOnlineListEntry *Characters){
+	ASSERT(NumCharacters >= 0 && (Characters != NULL || NumCharacters == 0));
+	// NOTE(fusion): The list takes ownership of `Characters`, which MUST have
+	// been allocated with `malloc`. The resulting number of characters is
+	// returned.
+	SortOnlineCharacters(WorldID, &NumCharacters, Characters);
+	TOnlineList *List = GetOrCreateOnlineList(WorldID);
+	free(List->Characters);
+	List->Sequence = Sequence;
+	List->NumCharacters = NumCharacters;
+	List->Characters = Characters;
+	InvalidateOnlineListResponses(WorldID);
+	return NumCharacters;
+}
+
+int UpdateOnlineCharacters(int WorldID, uint32 BaseSequence, uint32 Sequence,
+		int NumRemoved, TOnlineListEntry *Removed,
+		int NumUpdated, TOnlineListEntry *Updated){
+	ASSERT(NumRemoved >= 0 && (Removed != NULL || NumRemoved == 0));
+	ASSERT(NumUpdated >= 0 && (Updated != NULL || NumUpdated == 0));
+	// NOTE(fusion): Returns the resulting number of characters, or -1 if the
+	// delta doesn't apply to the current list, in which case the game server
+	// should send the full list. `Updated` has characters that joined or had
+	// their level or profession changed, and takes precedence over `Removed`.
+	// Both arrays are sorted in place but not kept.
+	TOnlineList *List = FindOnlineList(WorldID);
+	if(List == NULL || List->Sequence == 0 || List->Sequence != BaseSequence){
+		return -1;
+	}
+
+	SortOnlineCharacters(WorldID, &NumRemoved, Removed);
+	SortOnlineCharacters(WorldID, &NumUpdated, Updated);
+
+	// NOTE(fusion): Merge everything into a new list in a single pass since all
+	// three arrays are sorted by name.
+	int MaxCharacters = List->NumCharacters + NumUpdated;
+	TOnlineListEntry *Characters = NULL;
+	if(MaxCharacters > 0){
+		Characters = (TOnlineListEntry*)malloc(sizeof(TOnlineListEntry) * (usize)MaxCharacters);
+		if(Characters == NULL){
+			PANIC("Failed to allocate online list with %d characters", MaxCharacters);
+			return -1;
+		}
+	}
+
+	int NumCharacters = 0;
+	int Current = 0, RemovedIndex = 0, UpdatedIndex = 0;
+	while(Current < List->NumCharacters || UpdatedIndex < NumUpdated){
+		int Cmp;
+		if(Current >= List->NumCharacters){
+			Cmp = 1;
+		}else if(UpdatedIndex >= NumUpdated){
+			Cmp = -1;
+		}else{
+			Cmp = StringCompareCI(List->Characters[Current].Name, Updated[UpdatedIndex].Name);
+		}
+
+		if(Cmp > 0){
+			Characters[NumCharacters] = Updated[UpdatedIndex];
+			NumCharacters += 1;
+			UpdatedIndex += 1;
+		}else if(Cmp == 0){
+			Characters[NumCharacters] = Updated[UpdatedIndex];
+			NumCharacters += 1;
+			UpdatedIndex += 1;
+			Current += 1;
+		}else{
+			const TOnlineListEntry *Character = &List->Characters[Current];
+			while(RemovedIndex < NumRemoved
+					&& StringCompareCI(Removed[RemovedIndex].Name, Character->Name) < 0){
+				RemovedIndex += 1;
+			}
+
+			if(RemovedIndex >= NumRemoved
+					|| !StringEqCI(Removed[RemovedIndex].Name, Character->Name)){
+				Characters[NumCharacters] = *Character;
+				NumCharacters += 1;
+			}
+			Current += 1;
+		}
+	}
+
+	free(List->Characters);
+	List->Sequence = Sequence;
+	List->NumCharacters = NumCharacters;
+	List->Characters = Characters;
+	InvalidateOnlineListResponses(WorldID);
+	return NumCharacters;
+}
@@ -9,28 +9,52 @@
 #	error "Operating system not currently supported."
 #endif
 
-// Shutdown Signal
+// Signals
 int  g_ShutdownSignal			= 0;
+int  g_ReloadSignal				= 0;
 
 // Time
-int  g_MonotonicTimeMS			= 0;
+std::atomic<int> g_MonotonicTimeMS(0);
 
 // Database Config
 char g_DatabaseFile[1024]		= "tibia.db";
 int  g_MaxCachedStatements		= 100;
+int  g_LoginAttemptsMaxAge		= 24 * 60 * 60 * 1000; // milliseconds
+int  g_PruneLoginAttemptsInterval	= 60 * 60 * 1000; // milliseconds
+int  g_CheckpointInterval		= 5 * 60 * 1000; // milliseconds
+int  g_OptimizeInterval			= 6 * 60 * 60 * 1000; // milliseconds
+int  g_KillHistoryRollupInterval	= 60 * 60 * 1000; // milliseconds
+int  g_KillHistoryHourlyDays	= 2;
+int  g_KillHistoryDailyMonths	= 2;
+int  g_IndexAdvisorInterval		= 60 * 60 * 1000; // milliseconds
 
 // HostCache Config
 int  g_MaxCachedHostNames		= 100;
 int  g_HostNameExpireTime       = 30 * 60 * 1000; // milliseconds
 
+// RecordCache Config
+int  g_RecordCacheSize			= (int)MB(16);
+int  g_RecordCacheStatsInterval	= 10 * 60 * 1000; // milliseconds
+
+// KillStatistics Config
+char g_KillStatisticsJournal[1024]	= "killstats.journal";
+int  g_KillStatisticsFlushInterval	= 5 * 60 * 1000; // milliseconds
+
 // Connection Config
 int  g_UpdateRate				= 20;
 int  g_QueryManagerPort			= 7174;
+char g_QueryManagerUnixPath[108]	= "";
 char g_QueryManagerPassword[30]	= "";
+int  g_NetworkThreads			= 0;
+int  g_CryptoThreads			= 0;
 int  g_MaxConnections			= 50;
 int  g_MaxConnectionIdleTime	= 60 * 1000; // milliseconds
 int  g_MaxConnectionPacketSize	= (int)MB(1);
 
+// Password Config
+int  g_PasswordHashTime			= 50; // milliseconds
+int  g_PasswordHashIterations	= 0;
+
 void LogAdd(const char *Prefix, const char *Format, ...){
 	char Entry[4096];
 	va_list ap;
@@ -151,6 +175,20 @@ bool StringEqCI(const char *A, const char *B){
 	}
 }
 
+int StringCompareCI(const char *A, const char *B){
+	int Index = 0;
+	while(true){
+		int ChA = tolower(A[Index]);
+		int ChB = tolower(B[Index]);
+		if(ChA != ChB){
+			return ChA - ChB;
+		}else if(ChA == 0){
+			return 0;
+		}
+		Index += 1;
+	}
+}
+
 bool StringCopyN(char *Dest, int DestCapacity, const char *Src, int SrcLength){
 	ASSERT(DestCapacity > 0);
 	bool Result = (SrcLength < DestCapacity);
@@ -226,7 +264,10 @@ bool ReadDurationConfig(int *Dest, const char *Val){
 		Suffix += 1;
 	}
 
-	if(Suffix[0] == 'S' || Suffix[0] == 's'){
+	if((Suffix[0] == 'M' || Suffix[0] == 'm')
+			&& (Suffix[1] == 'S' || Suffix[1] == 's')){
+		// NOTE(fusion): Already in milliseconds.
+	}else if(Suffix[0] == 'S' || Suffix[0] == 's'){
 		*Dest *= (1000);
 	}else if(Suffix[0] == 'M' || Suffix[0] == 'm'){
 		*Dest *= (60 * 1000);
@@ -378,22 +419,56 @@ bool ReadConfig(const char *FileName){
 			ReadStringConfig(g_DatabaseFile, (int)sizeof(g_DatabaseFile), Val);
 		}else if(StringEqCI(Key, "MaxCachedStatements")){
 			ReadIntegerConfig(&g_MaxCachedStatements, Val);
+		}else if(StringEqCI(Key, "LoginAttemptsMaxAge")){
+			ReadDurationConfig(&g_LoginAttemptsMaxAge, Val);
+		}else if(StringEqCI(Key, "PruneLoginAttemptsInterval")){
+			ReadDurationConfig(&g_PruneLoginAttemptsInterval, Val);
+		}else if(StringEqCI(Key, "CheckpointInterval")){
+			ReadDurationConfig(&g_CheckpointInterval, Val);
+		}else if(StringEqCI(Key, "OptimizeInterval")){
+			ReadDurationConfig(&g_OptimizeInterval, Val);
+		}else if(StringEqCI(Key, "KillHistoryRollupInterval")){
+			ReadDurationConfig(&g_KillHistoryRollupInterval, Val);
+		}else if(StringEqCI(Key, "KillHistoryHourlyDays")){
+			ReadIntegerConfig(&g_KillHistoryHourlyDays, Val);
+		}else if(StringEqCI(Key, "KillHistoryDailyMonths")){
+			ReadIntegerConfig(&g_KillHistoryDailyMonths, Val);
+		}else if(StringEqCI(Key, "IndexAdvisorInterval")){
+			ReadDurationConfig(&g_IndexAdvisorInterval, Val);
 		}else if(StringEqCI(Key, "MaxCachedHostNames")){
 			ReadIntegerConfig(&g_MaxCachedHostNames, Val);
 		}else if(StringEqCI(Key, "HostNameExpireTime")){
 			ReadDurationConfig(&g_HostNameExpireTime, Val);
+		}else if(StringEqCI(Key, "RecordCacheSize")){
+			ReadSizeConfig(&g_RecordCacheSize, Val);
+		}else if(StringEqCI(Key, "RecordCacheStatsInterval")){
+			ReadDurationConfig(&g_RecordCacheStatsInterval, Val);
+		}else if(StringEqCI(Key, "KillStatisticsJournal")){
+			ReadStringConfig(g_KillStatisticsJournal, (int)sizeof(g_KillStatisticsJournal), Val);
+		}else if(StringEqCI(Key, "KillStatisticsFlushInterval")){
+			ReadDurationConfig(&g_KillStatisticsFlushInterval, Val);
 		}else if(StringEqCI(Key, "UpdateRate")){
 			ReadIntegerConfig(&g_UpdateRate, Val);
 		}else if(StringEqCI(Key, "QueryManagerPort")){
 			ReadIntegerConfig(&g_QueryManagerPort, Val);
+		}else if(StringEqCI(Key, "QueryManagerUnixPath")){
+			ReadStringConfig(g_QueryManagerUnixPath, (int)sizeof(g_QueryManagerUnixPath), Val);
 		}else if(StringEqCI(Key, "QueryManagerPassword")){
 			ReadStringConfig(g_QueryManagerPassword, (int)sizeof(g_QueryManagerPassword), Val);
+		}else if(StringEqCI(Key, "NetworkThreads")){
+			ReadIntegerConfig(&g_NetworkThreads, Val);
+		}else if(StringEqCI(Key, "CryptoThreads")){
+			ReadIntegerConfig(&g_CryptoThreads, Val);
 		}else if(StringEqCI(Key, "MaxConnections")){
 			ReadIntegerConfig(&g_MaxConnections, Val);
 		}else if(StringEqCI(Key, "MaxConnectionIdleTime")){
 			ReadDurationConfig(&g_MaxConnectionIdleTime, Val);
 		}else if(StringEqCI(Key, "MaxConnectionPacketSize")){
 			ReadSizeConfig(&g_MaxConnectionPacketSize, Val);
+		}else if(StringEqCI(Key, "PasswordHashTime")){
+			ReadDurationConfig(&g_PasswordHashTime, Val);
+		}else if(StringEqCI(Key, "PasswordHashIterations")){
+			ReadIntegerConfig(&g_PasswordHashIterations, Val);
 		}else{
 			LOG_WARN("Unknown config \"%s\"", Key);
 		}
@@ -419,48 +494,235 @@ static void ShutdownHandler(int SigNr){
 	g_ShutdownSignal = SigNr;
 }
 
+static void ReloadHandler(int SigNr){
+	g_ReloadSignal = SigNr;
+}
+
+static void KeepConfigString(const char *Name, char *Value, const char *OldValue){
+	if(!StringEq(Value, OldValue)){
+		LOG_WARN("%s can't be changed without a restart (keeping \"%s\")",
+				Name, OldValue);
+		strcpy(Value, OldValue);
+	}
+}
+
+static void KeepConfigInt(const char *Name, int *Value, int OldValue){
+	if(*Value != OldValue){
+		LOG_WARN("%s can't be changed without a restart (keeping %d)",
+				Name, OldValue);
+		*Value = OldValue;
+	}
+}
+
+static bool CheckConfigInt(const char *Name, int *Value, int OldValue, int MinValue){
+	if(*Value < MinValue){
+		LOG_WARN("Invalid %s %d (keeping %d)", Name, *Value, OldValue);
+		*Value = OldValue;
+	}else if(*Value != OldValue){
+		LOG("%s changed from %d to %d", Name, OldValue, *Value);
+	}
+	return *Value != OldValue;
+}
+
+static void ReloadConfig(void){
+	// NOTE(fusion): `ReadConfig` will overwrite config values in place so we
+	// need to keep the old values around to detect changes, restore settings
+	// that can't change while running, and resize structures that depend on
+	// them. Resize functions expect the global to still hold the old size.
+	char OldDatabaseFile[sizeof(g_DatabaseFile)];
+	char OldKillStatisticsJournal[sizeof(g_KillStatisticsJournal)];
+	char OldQueryManagerUnixPath[sizeof(g_QueryManagerUnixPath)];
+	char OldQueryManagerPassword[sizeof(g_QueryManagerPassword)];
+	memcpy(OldDatabaseFile, g_DatabaseFile, sizeof(g_DatabaseFile));
+	memcpy(OldKillStatisticsJournal, g_KillStatisticsJournal, sizeof(g_KillStatisticsJournal));
+	memcpy(OldQueryManagerUnixPath, g_QueryManagerUnixPath, sizeof(g_QueryManagerUnixPath));
+	memcpy(OldQueryManagerPassword, g_QueryManagerPassword, sizeof(g_QueryManagerPassword));
+	int OldMaxCachedStatements		= g_MaxCachedStatements;
+	int OldLoginAttemptsMaxAge		= g_LoginAttemptsMaxAge;
+	int OldPruneLoginAttemptsInterval	= g_PruneLoginAttemptsInterval;
+	int OldCheckpointInterval		= g_CheckpointInterval;
+	int OldOptimizeInterval			= g_OptimizeInterval;
+	int OldKillHistoryRollupInterval	= g_KillHistoryRollupInterval;
+	int OldKillHistoryHourlyDays	= g_KillHistoryHourlyDays;
+	int OldKillHistoryDailyMonths	= g_KillHistoryDailyMonths;
+	int OldIndexAdvisorInterval		= g_IndexAdvisorInterval;
+	int OldMaxCachedHostNames		= g_MaxCachedHostNames;
+	int OldHostNameExpireTime		= g_HostNameExpireTime;
+	int OldRecordCacheSize			= g_RecordCacheSize;
+	int OldRecordCacheStatsInterval	= g_RecordCacheStatsInterval;
+	int OldKillStatisticsFlushInterval	= g_KillStatisticsFlushInterval;
+	int OldUpdateRate				= g_UpdateRate;
+	int OldQueryManagerPort			= g_QueryManagerPort;
+	int OldNetworkThreads			= g_NetworkThreads;
+	int OldCryptoThreads			= g_CryptoThreads;
+	int OldMaxConnections			= g_MaxConnections;
+	int OldMaxConnectionIdleTime	= g_MaxConnectionIdleTime;
+	int OldMaxConnectionPacketSize	= g_MaxConnectionPacketSize;
+	int OldPasswordHashTime			= g_PasswordHashTime;
+	int OldPasswordHashIterations	= g_PasswordHashIterations;
+
+	LOG("Reloading config...");
+	if(!ReadConfig("config.cfg")){
+		LOG_ERR("Failed to reload config");
+		return;
+	}
+
+	// NOTE(fusion): These are baked into the database handle, the journal file,
+	// the listening socket, and connection buffers that may be in use.
+	KeepConfigString("DatabaseFile", g_DatabaseFile, OldDatabaseFile);
+	KeepConfigString("KillStatisticsJournal", g_KillStatisticsJournal, OldKillStatisticsJournal);
+	KeepConfigInt("QueryManagerPort", &g_QueryManagerPort, OldQueryManagerPort);
+	KeepConfigString("QueryManagerUnixPath", g_QueryManagerUnixPath, OldQueryManagerUnixPath);
+	KeepConfigInt("NetworkThreads", &g_NetworkThreads, OldNetworkThreads);
+	KeepConfigInt("CryptoThreads", &g_CryptoThreads, OldCryptoThreads);
+	KeepConfigInt("MaxConnectionPacketSize", &g_MaxConnectionPacketSize, OldMaxConnectionPacketSize);
+
+	// NOTE(fusion): The iteration count is picked once at startup and read by
+	// crypto threads without synchronization.
+	KeepConfigInt("PasswordHashTime", &g_PasswordHashTime, OldPasswordHashTime);
+	KeepConfigInt("PasswordHashIterations", &g_PasswordHashIterations, OldPasswordHashIterations);
+
+	if(!StringEq(g_QueryManagerPassword, OldQueryManagerPassword)){
+		LOG("QueryManagerPassword changed (existing connections stay authorized)");
+	}
+
+	CheckConfigInt("UpdateRate", &g_UpdateRate, OldUpdateRate, 1);
+	CheckConfigInt("HostNameExpireTime", &g_HostNameExpireTime, OldHostNameExpireTime, 0);
+	CheckConfigInt("MaxConnectionIdleTime", &g_MaxConnectionIdleTime, OldMaxConnectionIdleTime, 0);
+	CheckConfigInt("LoginAttemptsMaxAge", &g_LoginAttemptsMaxAge, OldLoginAttemptsMaxAge, 0);
+	CheckConfigInt("KillHistoryHourlyDays", &g_KillHistoryHourlyDays, OldKillHistoryHourlyDays, 0);
+	CheckConfigInt("KillHistoryDailyMonths", &g_KillHistoryDailyMonths, OldKillHistoryDailyMonths, 0);
+
+	bool PruneLoginAttemptsChanged = CheckConfigInt("PruneLoginAttemptsInterval",
+			&g_PruneLoginAttemptsInterval, OldPruneLoginAttemptsInterval, 0);
+	bool CheckpointChanged = CheckConfigInt("CheckpointInterval",
+			&g_CheckpointInterval, OldCheckpointInterval, 0);
+	bool OptimizeChanged = CheckConfigInt("OptimizeInterval",
+			&g_OptimizeInterval, OldOptimizeInterval, 0);
+	bool KillHistoryRollupChanged = CheckConfigInt("KillHistoryRollupInterval",
+			&g_KillHistoryRollupInterval, OldKillHistoryRollupInterval, 0);
+	bool IndexAdvisorChanged = CheckConfigInt("IndexAdvisorInterval",
+			&g_IndexAdvisorInterval, OldIndexAdvisorInterval, 0);
+	if(PruneLoginAttemptsChanged || CheckpointChanged || OptimizeChanged
+			|| KillHistoryRollupChanged || IndexAdvisorChanged){
+		ScheduleDatabaseMaintenance();
+	}
+
+	if(CheckConfigInt("MaxCachedStatements", &g_MaxCachedStatements, OldMaxCachedStatements, 1)){
+		int NewMaxCachedStatements = g_MaxCachedStatements;
+		g_MaxCachedStatements = OldMaxCachedStatements;
+		ResizeStatementCache(NewMaxCachedStatements);
+	}
+
+	if(CheckConfigInt("MaxCachedHostNames", &g_MaxCachedHostNames, OldMaxCachedHostNames, 1)){
+		int NewMaxCachedHostNames = g_MaxCachedHostNames;
+		g_MaxCachedHostNames = OldMaxCachedHostNames;
+		ResizeHostCache(NewMaxCachedHostNames);
+	}
+
+	if(CheckConfigInt("RecordCacheSize", &g_RecordCacheSize, OldRecordCacheSize, 0)){
+		int NewRecordCacheSize = g_RecordCacheSize;
+		g_RecordCacheSize = OldRecordCacheSize;
+		ResizeRecordCache(NewRecordCacheSize);
+	}
+
+	if(CheckConfigInt("RecordCacheStatsInterval", &g_RecordCacheStatsInterval,
+			OldRecordCacheStatsInterval, 0)){
+		ScheduleRecordCacheStats();
+	}
+
+	if(CheckConfigInt("KillStatisticsFlushInterval", &g_KillStatisticsFlushInterval,
+			OldKillStatisticsFlushInterval, 0)){
+		FlushKillStatistics();
+		ScheduleKillStatisticsFlush();
+	}
+
+	// NOTE(fusion): Network threads own their slice of the connection table and
+	// crypto threads may hold on to connections with deferred queries so it can
+	// only be resized when connections are handled by the main thread alone.
+	if(g_NetworkThreads > 0 || g_CryptoThreads > 0){
+		KeepConfigInt("MaxConnections", &g_MaxConnections, OldMaxConnections);
+	}else if(CheckConfigInt("MaxConnections", &g_MaxConnections, OldMaxConnections, 1)){
+		int NewMaxConnections = g_MaxConnections;
+		g_MaxConnections = OldMaxConnections;
+		ResizeConnections(NewMaxConnections);
+	}
+
+	// NOTE(fusion): Reloading the config also reloads worlds, so changes made
+	// to the `Worlds` table with the sqlite shell can be picked up on demand.
+	InvalidateWorldCache();
+	LOG("Config reloaded");
+}
+
 int main(int argc, const char **argv){
 	(void)argc;
 	(void)argv;
 
 	g_ShutdownSignal = 0;
+	g_ReloadSignal = 0;
 	if(!SigHandler(SIGPIPE, SIG_IGN)
 	|| !SigHandler(SIGINT, ShutdownHandler)
-	|| !SigHandler(SIGTERM, ShutdownHandler)){
+	|| !SigHandler(SIGTERM, ShutdownHandler)
+	|| !SigHandler(SIGHUP, ReloadHandler)){
 		return EXIT_FAILURE;
 	}
 
 	int64 StartTime = GetClockMonotonicMS();
 	g_MonotonicTimeMS = 0;
+	InitTimerWheel(&g_TimerWheel, 0);
 
 	LOG("Tibia Query Manager v0.1");
 	if(!ReadConfig("config.cfg")){
 		return EXIT_FAILURE;
 	}
 
-	if(!CheckSHA256()){
+	if(!CheckSHA256() || !InitPasswordHashing()){
 		return EXIT_FAILURE;
 	}
 
 	atexit(ExitHostCache);
+	atexit(ExitOnlineLists);
+	atexit(ExitBanCache);
+	atexit(ExitRecordCache);
+	atexit(ExitNameIndex);
+	atexit(ExitHighscores);
+	atexit(ExitWorldCache);
+	atexit(ExitResponseCache);
 	atexit(ExitDatabase);
+	// NOTE(fusion): Registered after `ExitDatabase` so pending kill statistics
+	// are flushed while the database is still open.
+	atexit(ExitKillStatistics);
 	atexit(ExitConnections);
+	atexit(ExitCryptoPool);
 	if(!InitHostCache()
 			|| !InitDatabase()
-			|| !InitConnections()){
+			|| !InitRights()
+			|| !InitBanCache()
+			|| !InitRecordCache()
+			|| !InitNameIndex()
+			|| !InitHighscores()
+			|| !InitWorldCache()
+			|| !InitKillStatistics()
+			|| !InitConnections()
+			|| !InitCryptoPool()){
 		return EXIT_FAILURE;
 	}
 
 	LOG("Running at %d updates per second...", g_UpdateRate);
-	int64 UpdateInterval = 1000 / (int64)g_UpdateRate;
 	while(g_ShutdownSignal == 0){
 		int64 UpdateStart = GetClockMonotonicMS();
 		g_MonotonicTimeMS = (int)(UpdateStart - StartTime);
+		if(g_ReloadSignal != 0){
+			g_ReloadSignal = 0;
+			ReloadConfig();
+		}
 		ProcessConnections();
+		AdvanceTimerWheel(&g_TimerWheel, g_MonotonicTimeMS);
+		int64 UpdateInterval = 1000 / (int64)g_UpdateRate;
 		int64 UpdateEnd = GetClockMonotonicMS();
 		int64 NextUpdate = UpdateStart + UpdateInterval;
 		if(NextUpdate > UpdateEnd){
-			SleepMS(NextUpdate - UpdateEnd);
+			WaitConnections(NextUpdate - UpdateEnd);
 		}
 	}
 
@@ -12,6 +12,7 @@
 #include <time.h>
 
 #include <algorithm>
+#include <atomic>
 
 typedef uint8_t uint8;
 typedef uint16_t uint16;
@@ -76,24 +77,47 @@ typedef size_t usize;
 	}while(0)
 
 // Time
-extern int  g_MonotonicTimeMS;
+extern std::atomic<int> g_MonotonicTimeMS;
 
 // Database Config
 extern char g_DatabaseFile[1024];
 extern int  g_MaxCachedStatements;
+extern int  g_LoginAttemptsMaxAge;
+extern int  g_PruneLoginAttemptsInterval;
+extern int  g_CheckpointInterval;
+extern int  g_OptimizeInterval;
+extern int  g_KillHistoryRollupInterval;
+extern int  g_KillHistoryHourlyDays;
+extern int  g_KillHistoryDailyMonths;
+extern int  g_IndexAdvisorInterval;
 
 // HostCache Config
 extern int  g_MaxCachedHostNames;
 extern int  g_HostNameExpireTime;
 
+// RecordCache Config
+extern int  g_RecordCacheSize;
+extern int  g_RecordCacheStatsInterval;
+
+// KillStatistics Config
+extern char g_KillStatisticsJournal[1024];
+extern int  g_KillStatisticsFlushInterval;
+
 // Connection Config
 extern int  g_UpdateRate;
 extern int  g_QueryManagerPort;
+extern char g_QueryManagerUnixPath[108];
 extern char g_QueryManagerPassword[30];
+extern int  g_NetworkThreads;
+extern int  g_CryptoThreads;
 extern int  g_MaxConnections;
 extern int  g_MaxConnectionIdleTime;
 extern int  g_MaxConnectionPacketSize;
 
+// Password Config
+extern int  g_PasswordHashTime;
+extern int  g_PasswordHashIterations;
+
 void LogAdd(const char *Prefix, const char *Format, ...) ATTR_PRINTF(2, 3);
 void LogAddVerbose(const char *Prefix, const char *Function,
 		const char *File, int Line, const char *Format, ...) ATTR_PRINTF(5, 6);
@@ -107,6 +131,7 @@ int RoundSecondsToDays(int Seconds);
 bool StringEmpty(const char *String);
 bool StringEq(const char *A, const char *B);
 bool StringEqCI(const char *A, const char *B);
+int StringCompareCI(const char *A, const char *B);
 bool StringCopyN(char *Dest, int DestCapacity, const char *Src, int SrcLength);
 bool StringCopy(char *Dest, int DestCapacity, const char *Src);
 bool ParseIPAddress(const char *String, int *OutAddr);
@@ -117,6 +142,114 @@ bool ReadSizeConfig(int *Dest, const char *Val);
 bool ReadStringConfig(char *Dest, int DestCapacity, const char *Val);
 bool ReadConfig(const char *FileName);
 
+// Arena
+//==============================================================================
+// NOTE(fusion): Simple bump allocator made of a list of blocks. Resetting the
+// arena keeps its blocks around for reuse so an arena that is reset after each
+// request won't touch the heap in steady state. Blocks past `ARENA_MAX_RETAINED`
+// are released on reset so a single large request doesn't pin memory forever.
+#define ARENA_BLOCK_SIZE KB(64)
+#define ARENA_MAX_RETAINED MB(1)
+#define ARENA_ALIGNMENT 16
+#define ARENA_HEADER_SIZE 32
+
+struct TArenaBlock{
+	TArenaBlock *Next;
+	usize Size;
+	usize Used;
+};
+
+struct TArena{
+	TArenaBlock *Head;
+	TArenaBlock *Current;
+};
+
+inline uint8 *ArenaBlockData(TArenaBlock *Block){
+	// NOTE(fusion): Block headers are padded to keep data aligned.
+	STATIC_ASSERT(sizeof(TArenaBlock) <= ARENA_HEADER_SIZE
+			&& (ARENA_HEADER_SIZE % ARENA_ALIGNMENT) == 0);
+	return (uint8*)Block + ARENA_HEADER_SIZE;
+}
+
+inline void *ArenaAlloc(TArena *Arena, usize Size){
+	Size = (Size + (ARENA_ALIGNMENT - 1)) & ~(usize)(ARENA_ALIGNMENT - 1);
+
+	// NOTE(fusion): Blocks after `Current` are leftovers from before the last
+	// reset and are reused before allocating new ones.
+	TArenaBlock *Block = Arena->Current;
+	while(Block != NULL && (Block->Used + Size) > Block->Size){
+		Block = Block->Next;
+	}
+
+	if(Block == NULL){
+		usize BlockSize = std::max<usize>(Size, ARENA_BLOCK_SIZE);
+		Block = (TArenaBlock*)malloc(ARENA_HEADER_SIZE + BlockSize);
+		if(Block == NULL){
+			PANIC("Failed to allocate arena block of %d bytes", (int)BlockSize);
+			return NULL;
+		}
+
+		Block->Size = BlockSize;
+		Block->Used = 0;
+		if(Arena->Current != NULL){
+			Block->Next = Arena->Current->Next;
+			Arena->Current->Next = Block;
+		}else{
+			Block->Next = Arena->Head;
+			Arena->Head = Block;
+		}
+	}
+
+	Arena->Current = Block;
+	void *Result = ArenaBlockData(Block) + Block->Used;
+	Block->Used += Size;
+	return Result;
+}
+
+template<typename T>
+T *ArenaAllocArray(TArena *Arena, int Count){
+	STATIC_ASSERT(std::is_trivially_destructible<T>::value);
+	return (T*)ArenaAlloc(Arena, sizeof(T) * (usize)std::max<int>(Count, 1));
+}
+
+inline char *ArenaStringCopy(TArena *Arena, const char *String){
+	usize Length = (String != NULL ? strlen(String) : 0);
+	char *Result = (char*)ArenaAlloc(Arena, Length + 1);
+	if(Length > 0){
+		memcpy(Result, String, Length);
+	}
+	Result[Length] = 0;
+	return Result;
+}
+
+inline void ArenaReset(TArena *Arena){
+	usize Retained = 0;
+	TArenaBlock **Link = &Arena->Head;
+	while(*Link != NULL){
+		TArenaBlock *Block = *Link;
+		if((Retained + Block->Size) > ARENA_MAX_RETAINED && Block != Arena->Head){
+			*Link = Block->Next;
+			free(Block);
+		}else{
+			Retained += Block->Size;
+			Block->Used = 0;
+			Link = &Block->Next;
+		}
+	}
+	Arena->Current = Arena->Head;
+}
+
+inline void ArenaFree(TArena *Arena){
+	TArenaBlock *Block = Arena->Head;
+	while(Block != NULL){
+		TArenaBlock *Next = Block->Next;
+		free(Block);
+		Block = Next;
+	}
+	Arena->Head = NULL;
+	Arena->Current = NULL;
+}
+
 // Buffer Utility
 //==============================================================================
 inline uint8 BufferRead8(const uint8 *Buffer){
@@ -303,20 +436,42 @@ struct TReadBuffer{
 	}
 };
 
+// NOTE(fusion): Data referenced by a write buffer rather than copied into it.
+// It's spliced into the output right before `Offset` when the response is sent
+// and MUST remain valid until then, which is why it's expected to live in the
+// connection's arena.
+struct TWriteRef{
+	int Offset;
+	int Length;
+	const uint8 *Data;
+};
+
 struct TWriteBuffer{
 	uint8 *Buffer;
 	int Size;
 	int Position;
-
-	TWriteBuffer(uint8 *Buffer, int Size)
-		: Buffer(Buffer), Size(Size), Position(0) {}
-
+	TArena *Arena;
+	TWriteRef *Refs;
+	int NumRefs;
+	int MaxRefs;
+	int RefBytes;
+
+	TWriteBuffer(uint8 *Buffer, int Size, TArena *Arena = NULL)
+		: Buffer(Buffer), Size(Size), Position(0), Arena(Arena),
+		Refs(NULL), NumRefs(0), MaxRefs(0), RefBytes(0) {}
+
+	// NOTE(fusion): Referenced data counts towards the buffer size, as if it
+	// had been copied, so the total response size is still bounded by it.
 	bool CanWrite(int Bytes){
-		return (this->Position + Bytes) <= this->Size;
+		return (this->Position + this->RefBytes + Bytes) <= this->Size;
 	}
 
 	bool Overflowed(void){
-		return this->Position > this->Size;
+		return (this->Position + this->RefBytes) > this->Size;
+	}
+
+	int TotalSize(void){
+		return this->Position + this->RefBytes;
 	}
 
 	void WriteFlag(bool Value){
@@ -378,6 +533,55 @@ struct TWriteBuffer{
 		this->Position += StringLength;
 	}
 
+	// NOTE(fusion): Same as `WriteString` except the string itself isn't copied
+	// but referenced, if there is an arena to keep track of references.
+	void WriteStringRef(const char *String){
+		int StringLength = 0;
+		if(String != NULL){
+			StringLength = (int)strlen(String);
+		}
+
+		if(this->Arena == NULL || StringLength == 0){
+			this->WriteString(String);
+			return;
+		}
+
+		if(StringLength < 0xFFFF){
+			this->Write16((uint16)StringLength);
+		}else{
+			this->Write16(0xFFFF);
+			this->Write32((uint32)StringLength);
+		}
+
+		if(this->CanWrite(StringLength)){
+			if(this->NumRefs >= this->MaxRefs){
+				int NewMaxRefs = std::max<int>(this->MaxRefs * 2, 64);
+				TWriteRef *NewRefs = ArenaAllocArray<TWriteRef>(this->Arena, NewMaxRefs);
+				if(this->NumRefs > 0){
+					memcpy(NewRefs, this->Refs, sizeof(TWriteRef) * (usize)this->NumRefs);
+				}
+				this->Refs = NewRefs;
+				this->MaxRefs = NewMaxRefs;
+			}
+
+			TWriteRef *Ref = &this->Refs[this->NumRefs];
+			Ref->Offset = this->Position;
+			Ref->Length = StringLength;
+			Ref->Data = (const uint8*)String;
+			this->NumRefs += 1;
+		}
+
+		this->RefBytes += StringLength;
+	}
+
+	void WriteBytes(const uint8 *Data, int Length){
+		if(Length > 0 && this->CanWrite(Length)){
+			memcpy(this->Buffer + this->Position, Data, Length);
+		}
+
+		this->Position += Length;
+	}
+
 	void Rewrite16(int Position, uint16 Value){
 		if((Position + 2) <= this->Position && !this->Overflowed()){
 			BufferWrite16LE(this->Buffer + Position, Value);
@@ -391,6 +595,12 @@ struct TWriteBuffer{
 						this->Buffer + Position,
 						this->Position - Position);
 				BufferWrite32LE(this->Buffer + Position, Value);
+
+				for(int i = 0; i < this->NumRefs; i += 1){
+					if(this->Refs[i].Offset >= Position){
+						this->Refs[i].Offset += 4;
+					}
+				}
 			}
 
 			this->Position += 4;
@@ -412,6 +622,13 @@ private:
 	T *m_Data;
 	int m_Length;
 	int m_Capacity;
+	TArena *m_Arena;
+
+	void FreeData(void){
+		if(m_Data != NULL && m_Arena == NULL){
+			free(m_Data);
+		}
+	}
 
 	void EnsureCapacity(int Capacity){
 		int OldCapacity = m_Capacity;
@@ -428,34 +645,71 @@ private:
 			}
 			ASSERT(NewCapacity >= Capacity);
 
-			T *NewData = (T*)realloc(m_Data, sizeof(T) * (usize)NewCapacity);
-			if(NewData == NULL){
-				PANIC("Failed to resize dynamic array from %d to %d", OldCapacity, NewCapacity);
-				return;
+			T *NewData;
+			if(m_Arena != NULL){
+				// NOTE(fusion): Arena memory can't be resized or released so the
+				// old array is simply left behind until the arena is reset.
+				NewData = ArenaAllocArray<T>(m_Arena, NewCapacity);
+				if(m_Length > 0){
+					memcpy(NewData, m_Data, sizeof(T) * (usize)m_Length);
+				}
+			}else{
+				NewData = (T*)realloc(m_Data, sizeof(T) * (usize)NewCapacity);
+				if(NewData == NULL){
+					PANIC("Failed to resize dynamic array from %d to %d", OldCapacity, NewCapacity);
+					return;
+				}
 			}
 
-			// NOTE(fusion): Zero initialize newly allocated elements.
-			memset(&NewData[OldCapacity], 0, sizeof(T) * (usize)(NewCapacity - OldCapacity));
-
+			// NOTE(fusion): Elements past `m_Length` are left uninitialized and
+			// only zeroed when exposed by `Resize`, since they'd otherwise be
+			// overwritten anyway.
 			m_Data = NewData;
 			m_Capacity = NewCapacity;
 		}
 	}
 
 public:
-	DynamicArray(void) : m_Data(NULL), m_Length(0), m_Capacity(0) {}
+	DynamicArray(void) : m_Data(NULL), m_Length(0), m_Capacity(0), m_Arena(NULL) {}
+
+	// NOTE(fusion): Arena backed arrays don't own their memory, which MUST
+	// outlive them. They're meant for per request data, where the arena is
+	// reset after the response is sent.
+	explicit DynamicArray(TArena *Arena)
+		: m_Data(NULL), m_Length(0), m_Capacity(0), m_Arena(Arena) {}
+
 	~DynamicArray(void){
-		if(m_Data != NULL){
-			free(m_Data);
-		}
+		FreeData();
 	}
 
-	// NOTE(fusion): Make it non copyable for simplicity. Implementing copy and
-	// move operations could be useful on a general context but it won't make a
-	// difference here since we're not gonna use it.
+	// NOTE(fusion): Copying is still not allowed to avoid accidental copies of
+	// large arrays but moving is, so arrays can be returned from functions.
 	DynamicArray(const DynamicArray &Other) = delete;
 	void operator=(const DynamicArray &Other) = delete;
 
+	DynamicArray(DynamicArray &&Other)
+		: m_Data(Other.m_Data), m_Length(Other.m_Length),
+		m_Capacity(Other.m_Capacity), m_Arena(Other.m_Arena)
+	{
+		Other.m_Data = NULL;
+		Other.m_Length = 0;
+		Other.m_Capacity = 0;
+	}
+
+	DynamicArray &operator=(DynamicArray &&Other){
+		if(this != &Other){
+			FreeData();
+			m_Data = Other.m_Data;
+			m_Length = Other.m_Length;
+			m_Capacity = Other.m_Capacity;
+			m_Arena = Other.m_Arena;
+			Other.m_Data = NULL;
+			Other.m_Length = 0;
+			Other.m_Capacity = 0;
+		}
+		return *this;
+	}
+
 	bool Empty(void) const { return m_Length == 0; }
 	int Length(void) const { return m_Length; }
 	int Capacity(void) const { return m_Capacity; }
@@ -467,9 +721,9 @@ public:
 	void Resize(int Length){
 		ASSERT(Length >= 0);
 		EnsureCapacity(Length);
-		if(Length < m_Length){
-			// NOTE(fusion): Maintain non-active elements zero initialized.
-			memset(&m_Data[Length], 0, sizeof(T) * (usize)(m_Length - Length));
+		if(Length > m_Length){
+			// NOTE(fusion): Zero initialize newly exposed elements.
+			memset(&m_Data[m_Length], 0, sizeof(T) * (usize)(Length - m_Length));
 		}
 
 		m_Length = Length;
@@ -497,23 +751,17 @@ public:
 		for(int i = Index; i < m_Length; i += 1){
 			m_Data[i] = m_Data[i + 1];
 		}
-		// NOTE(fusion): Maintain non-active elements zero initialized.
-		memset(&m_Data[m_Length], 0, sizeof(T));
 	}
 
 	void Pop(void){
 		ASSERT(m_Length > 0);
 		m_Length -= 1;
-		// NOTE(fusion): Maintain non-active elements zero initialized.
-		memset(&m_Data[m_Length], 0, sizeof(T));
 	}
 
 	void SwapAndPop(int Index){
 		ASSERT(Index >= 0 && Index < m_Length);
 		m_Length -= 1;
 		m_Data[Index] = m_Data[m_Length];
-		// NOTE(fusion): Maintain non-active elements zero initialized.
-		memset(&m_Data[m_Length], 0, sizeof(T));
 	}
 
 	T &operator[](int Index){
@@ -533,6 +781,80 @@ public:
 	const T *end(void) const { return m_Data + m_Length; }
 };
 
+// Authentication Data
+//==============================================================================
+// NOTE(fusion): Accounts may have either legacy authentication data, which is
+// a single salted SHA256 round, or versioned PBKDF2-HMAC-SHA256 data that also
+// stores its iteration count. Legacy data is migrated when players log in.
+#define AUTH_LEGACY_SIZE 64
+#define AUTH_SIZE 72
+#define AUTH_VERSION_PBKDF2 1
+#define AUTH_MIN_ITERATIONS 1000
+#define AUTH_MAX_ITERATIONS 10000000
+#define AUTH_MAX_INLINE_TIME 5 // milliseconds
+
+// timer.cc
+//==============================================================================
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+struct TTimer;
+struct TTimerWheel;
+typedef void TTimerCallback(TTimer *Timer);
+
+struct TTimer{
+	TTimer *Next;
+	TTimer **Prev;
+	TTimerWheel *Wheel;
+	int64 Expire;
+	TTimerCallback *Callback;
+	void *Data;
+};
+
+struct TTimerWheel{
+	int64 CurrentTime;
+	int NumTimers;
+	TTimer *Slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+void InitTimerWheel(TTimerWheel *Wheel, int64 Time);
+void InitTimer(TTimer *Timer, TTimerCallback *Callback, void *Data);
+bool TimerScheduled(const TTimer *Timer);
+void ScheduleTimer(TTimerWheel *Wheel, TTimer *Timer, int64 Expire);
+void CancelTimer(TTimer *Timer);
+void AdvanceTimerWheel(TTimerWheel *Wheel, int64 Time);
+
+// NOTE(fusion): Timer wheel advanced by the main thread on every update. It's
+// meant for deferred database work so it MUST NOT be used by network threads.
+extern TTimerWheel g_TimerWheel;
+
+// cryptopool.cc
+//==============================================================================
+struct TCryptoJob;
+typedef void TCryptoCallback(TCryptoJob *Job);
+
+// NOTE(fusion): Password check handed to the crypto pool. The job is owned by
+// the pool from `SubmitCryptoJob` until its callback is called. If `Rehash` is
+// set and the password matches, new authentication data is also generated into
+// `NewAuth`, otherwise `Rehash` is cleared.
+struct TCryptoJob{
+	TCryptoJob *Next;
+	uint8 Auth[AUTH_SIZE];
+	int AuthSize;
+	char Password[30];
+	bool Result;
+	bool Rehash;
+	uint8 NewAuth[AUTH_SIZE];
+	TCryptoCallback *Callback;
+	void *Data;
+};
+
+bool CryptoPoolEnabled(void);
+void SubmitCryptoJob(TCryptoJob *Job);
+bool InitCryptoPool(void);
+void ExitCryptoPool(void);
+
 // connections.cc
 //==============================================================================
 enum : int {
@@ -582,6 +904,7 @@ enum : int {
 	QUERY_EXCLUDE_FROM_AUCTIONS		= 51,
 	QUERY_CANCEL_HOUSE_TRANSFER		= 52,
 	QUERY_LOAD_WORLD_CONFIG			= 53,
+	QUERY_UPDATE_PLAYERLIST			= 54,
 	QUERY_CREATE_ACCOUNT			= 100,
 	QUERY_CREATE_CHARACTER			= 101,
 	QUERY_GET_ACCOUNT_SUMMARY		= 102,
@@ -589,6 +912,8 @@ enum : int {
 	QUERY_GET_WORLDS				= 150,
 	QUERY_GET_ONLINE_CHARACTERS		= 151,
 	QUERY_GET_KILL_STATISTICS		= 152,
+	QUERY_GET_KILL_STATISTICS_HISTORY	= 153,
+	QUERY_GET_HIGHSCORES			= 154,
 };
 
 enum ConnectionState: int {
@@ -598,6 +923,13 @@ enum ConnectionState: int {
 	CONNECTION_WRITING		= 3,
 };
 
+// NOTE(fusion): Pieces of a response that are written with a single `writev`,
+// either from the connection buffer or from data referenced by the response.
+struct TWriteSegment{
+	const uint8 *Data;
+	int Length;
+};
+
 struct TConnection{
 	ConnectionState State;
 	int Socket;
@@ -605,23 +937,40 @@ struct TConnection{
 	int RWSize;
 	int RWPosition;
 	uint8 *Buffer;
+	TArena Arena;
+	TWriteSegment *WriteSegments;
+	int NumWriteSegments;
+	int WriteSegmentIndex;
+	TTimer IdleTimer;
+	int NextFree;
+	int ActiveIndex;
+	bool Queued;
+	TConnection *QueueNext;
+	bool PasswordCheckPending;
+	TCryptoJob PasswordJob;
 	bool Authorized;
 	int ApplicationType;
 	int WorldID;
 	char RemoteAddress[30];
 };
 
-int ListenerBind(uint16 Port);
+struct TConnectionShard;
+
+int ListenerBind(uint16 Port, bool ReusePort);
 int ListenerAccept(int Listener, uint32 *OutAddr, uint16 *OutPort);
+int UnixListenerBind(const char *Path);
+int UnixListenerAccept(int Listener, char *RemoteAddress, int RemoteAddressSize);
 void CloseConnection(TConnection *Connection);
 void EnsureConnectionBuffer(TConnection *Connection);
 void DeleteConnectionBuffer(TConnection *Connection);
-TConnection *AssignConnection(int Socket, uint32 Addr, uint16 Port);
+TConnection *AssignConnection(TConnectionShard *Shard, int Socket, const char *RemoteAddress);
 void ReleaseConnection(TConnection *Connection);
 void CheckConnectionInput(TConnection *Connection, int Events);
 void CheckConnectionOutput(TConnection *Connection, int Events);
 void CheckConnection(TConnection *Connection, int Events);
 void ProcessConnections(void);
+void WaitConnections(int64 DurationMS);
+void ResizeConnections(int NewMaxConnections);
 bool InitConnections(void);
 void ExitConnections(void);
 
@@ -664,17 +1013,22 @@ void ProcessLoadPlayersQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessExcludeFromAuctionsQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessCancelHouseTransferQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessLoadWorldConfigQuery(TConnection *Connection, TReadBuffer *Buffer);
+void ProcessUpdatePlayerlistQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessCreateAccountQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessCreateCharacterQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessGetAccountSummaryQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessGetCharacterProfileQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessGetWorldsQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessGetOnlineCharactersQuery(TConnection *Connection, TReadBuffer *Buffer);
+void ProcessGetKillStatisticsQuery(TConnection *Connection, TReadBuffer *Buffer);
+void ProcessGetKillStatisticsHistoryQuery(TConnection *Connection, TReadBuffer *Buffer);
+void ProcessGetHighscoresQuery(TConnection *Connection, TReadBuffer *Buffer);
 void ProcessConnectionQuery(TConnection *Connection);
 
 // database.cc
 //==============================================================================
 struct TWorld{
+	int WorldID;
 	char Name[30];
 	int Type;
 	int NumPlayers;
@@ -683,6 +1037,21 @@ struct TWorld{
 	int OnlineRecordTimestamp;
 };
 
+struct TWorldRecord{
+	int WorldID;
+	char Name[30];
+	int Type;
+	int RebootTime;
+	char Host[100];
+	int Port;
+	int MaxPlayers;
+	int PremiumPlayerBuffer;
+	int MaxNewbies;
+	int PremiumNewbieBuffer;
+	int OnlineRecord;
+	int OnlineRecordTimestamp;
+};
+
 struct TWorldConfig{
 	int Type;
 	int RebootTime;
@@ -697,7 +1066,8 @@ struct TWorldConfig{
 struct TAccount{
 	int AccountID;
 	char Email[100];
-	uint8 Auth[64];
+	uint8 Auth[AUTH_SIZE];
+	int AuthSize;
 	int PremiumDays;
 	int PendingPremiumDays;
 	bool Deleted;
@@ -757,8 +1127,22 @@ struct TCharacterRight{
 };
 
 struct TCharacterIndexEntry{
+	const char *Name;
+	int CharacterID;
+};
+
+struct TCharacterName{
+	int CharacterID;
+	int WorldID;
 	char Name[30];
+};
+
+struct TCharacterHighscore{
+	int WorldID;
 	int CharacterID;
+	int Level;
+	char Name[30];
+	char Profession[30];
 };
 
 struct THouseAuction{
@@ -784,7 +1168,7 @@ struct THouseEviction{
 struct THouseOwner{
 	int HouseID;
 	int OwnerID;
-	char OwnerName[30];
+	const char *OwnerName;
 	int PaidUntil;
 };
 
@@ -812,6 +1196,12 @@ struct TBanishmentStatus{
 	int TimesBanished;
 };
 
+struct TActiveBanishment{
+	int Key;
+	int Issued;
+	int Until;
+};
+
 struct TStatement{
 	int Timestamp;
 	int StatementID;
@@ -826,10 +1216,16 @@ struct TKillStatistics{
 	int PlayersKilled;
 };
 
+enum : int {
+	KILL_PERIOD_HOUR	= 0,
+	KILL_PERIOD_DAY		= 1,
+	KILL_PERIOD_MONTH	= 2,
+};
+
 struct TOnlineCharacter{
-	char Name[30];
+	const char *Name;
 	int Level;
-	char Profession[30];
+	const char *Profession;
 };
 
 // NOTE(fusion): Transaction scope guard.
@@ -846,13 +1242,12 @@ public:
 };
 
 // NOTE(fusion): Primary tables.
-int GetWorldID(const char *WorldName);
-bool GetWorlds(DynamicArray<TWorld> *Worlds);
-bool GetWorldConfig(int WorldID, TWorldConfig *WorldConfig);
+bool GetWorldRecords(DynamicArray<TWorldRecord> *Worlds);
 bool AccountExists(int AccountID, const char *Email);
 bool AccountNumberExists(int AccountID);
 bool AccountEmailExists(const char *Email);
 bool CreateAccount(int AccountID, const char *Email, const uint8 *Auth, int AuthSize);
+bool UpdateAccountAuth(int AccountID, const uint8 *Auth, int AuthSize);
 bool GetAccountData(int AccountID, TAccount *Account);
 int GetAccountOnlineCharacters(int AccountID);
 bool IsCharacterOnline(int CharacterID);
@@ -864,9 +1259,7 @@ bool CreateCharacter(int WorldID, int AccountID, const char *Name, int Sex);
 int GetCharacterID(int WorldID, const char *CharacterName);
 bool GetCharacterLoginData(const char *CharacterName, TCharacterLoginData *Character);
 bool GetCharacterProfile(const char *CharacterName, TCharacterProfile *Character);
-bool GetCharacterRight(int CharacterID, const char *Right);
 bool GetCharacterRights(int CharacterID, DynamicArray<TCharacterRight> *Rights);
-bool GetGuildLeaderStatus(int WorldID, int CharacterID);
 bool IncrementIsOnline(int WorldID, int CharacterID);
 bool DecrementIsOnline(int WorldID, int CharacterID);
 bool ClearIsOnline(int WorldID, int *NumAffectedCharacters);
@@ -874,7 +1267,9 @@ bool LogoutCharacter(int WorldID, int CharacterID, int Level,
 		const char *Profession, const char *Residence, int LastLoginTime,
 		int TutorActivities);
 bool GetCharacterIndexEntries(int WorldID, int MinimumCharacterID,
-		int MaxEntries, int *NumEntries, TCharacterIndexEntry *Entries);
+		TArena *Arena, int MaxEntries, int *NumEntries, TCharacterIndexEntry *Entries);
+bool GetCharacterNames(DynamicArray<TCharacterName> *Names);
+bool GetCharacterHighscores(DynamicArray<TCharacterHighscore> *Characters);
 bool InsertCharacterDeath(int WorldID, int CharacterID, int Level,
 		int OffenderID, const char *Remark, bool Unjustified, int Timestamp);
 bool InsertBuddy(int WorldID, int AccountID, int BuddyID);
@@ -884,16 +1279,19 @@ bool GetWorldInvitation(int WorldID, int CharacterID);
 bool InsertLoginAttempt(int AccountID, int IPAddress, bool Failed);
 int GetAccountFailedLoginAttempts(int AccountID, int TimeWindow);
 int GetIPAddressFailedLoginAttempts(int IPAddress, int TimeWindow);
+bool PruneLoginAttempts(int MaxAge, int *NumDeleted);
 
 // NOTE(fusion): House tables.
 bool FinishHouseAuctions(int WorldID, DynamicArray<THouseAuction> *Auctions);
 bool FinishHouseTransfers(int WorldID, DynamicArray<THouseTransfer> *Transfers);
 bool GetFreeAccountEvictions(int WorldID, DynamicArray<THouseEviction> *Evictions);
 bool GetDeletedCharacterEvictions(int WorldID, DynamicArray<THouseEviction> *Evictions);
+bool GetExGuildLeaderEvictions(int WorldID, int NumGuildHouses,
+		THouseEviction *GuildHouses, DynamicArray<THouseEviction> *Evictions);
 bool InsertHouseOwner(int WorldID, int HouseID, int OwnerID, int PaidUntil);
 bool UpdateHouseOwner(int WorldID, int HouseID, int OwnerID, int PaidUntil);
 bool DeleteHouseOwner(int WorldID, int HouseID);
-bool GetHouseOwners(int WorldID, DynamicArray<THouseOwner> *Owners);
+bool GetHouseOwners(int WorldID, TArena *Arena, DynamicArray<THouseOwner> *Owners);
 bool GetHouseAuctions(int WorldID, DynamicArray<int> *Auctions);
 bool StartHouseAuction(int WorldID, int HouseID);
 bool DeleteHouses(int WorldID);
@@ -905,7 +1303,7 @@ bool IsCharacterNamelocked(int CharacterID);
 TNamelockStatus GetNamelockStatus(int CharacterID);
 bool InsertNamelock(int CharacterID, int IPAddress, int GamemasterID,
 		const char *Reason, const char *Comment);
-bool IsAccountBanished(int AccountID);
+bool GetActiveBanishments(DynamicArray<TActiveBanishment> *Banishments);
 TBanishmentStatus GetBanishmentStatus(int CharacterID);
 bool InsertBanishment(int CharacterID, int IPAddress, int GamemasterID,
 		const char *Reason, const char *Comment, bool FinalWarning,
@@ -913,7 +1311,7 @@ bool InsertBanishment(int CharacterID, int IPAddress, int GamemasterID,
 int GetNotationCount(int CharacterID);
 bool InsertNotation(int CharacterID, int IPAddress, int GamemasterID,
 		const char *Reason, const char *Comment);
-bool IsIPBanished(int IPAddress);
+bool GetActiveIPBanishments(DynamicArray<TActiveBanishment> *Banishments);
 bool InsertIPBanishment(int CharacterID, int IPAddress, int GamemasterID,
 		const char *Reason, const char *Comment, int Duration);
 bool IsStatementReported(int WorldID, TStatement *Statement);
@@ -924,33 +1322,300 @@ bool InsertReportedStatement(int WorldID, TStatement *Statement, int BanishmentI
 // NOTE(fusion): Info tables.
 bool GetKillStatistics(int WorldID, DynamicArray<TKillStatistics> *Stats);
 bool MergeKillStatistics(int WorldID, int NumStats, TKillStatistics *Stats);
-bool GetOnlineCharacters(int WorldID, DynamicArray<TOnlineCharacter> *Characters);
-bool DeleteOnlineCharacters(int WorldID);
-bool InsertOnlineCharacters(int WorldID, int NumCharacters, TOnlineCharacter *Characters);
+bool GetKillStatisticsHistory(int WorldID, int From, int To, DynamicArray<TKillStatistics> *Stats);
+bool MergeKillStatisticsHistory(int WorldID, int PeriodStart, int NumStats, TKillStatistics *Stats);
+bool RollupKillStatisticsHistory(int Period, int NewPeriod, int Before, int *NumRolledUp);
 bool CheckOnlineRecord(int WorldID, int NumCharacters, bool *NewRecord);
 
+void ScheduleDatabaseMaintenance(void);
+void CancelDatabaseMaintenance(void);
+
 // NOTE(fusion): Internal database utility and initialization.
 bool FileExists(const char *FileName);
 bool ExecFile(const char *FileName);
 bool ExecInternal(const char *Format, ...) ATTR_PRINTF(1, 2);
 bool GetPragmaInt(const char *Name, int *OutValue);
+bool GetDataVersion(int *DataVersion);
 bool InitDatabaseSchema(void);
 bool UpgradeDatabaseSchema(int UserVersion);
 bool CheckDatabaseSchema(void);
+void ResizeStatementCache(int NewMaxCachedStatements);
+void LoadRowEstimates(void);
+int EstimateRowsPerKey(const char *Index);
 bool InitDatabase(void);
 void ExitDatabase(void);
 
+// bancache.cc
+//==============================================================================
+bool InitBanCache(void);
+void ExitBanCache(void);
+void MarkBanCache(void);
+void RollbackBanCache(void);
+void InsertBanCacheAccount(int AccountID, int Issued, int Until);
+void InsertBanCacheIPAddress(int IPAddress, int Issued, int Until);
+bool IsAccountBanished(int AccountID);
+bool IsIPBanished(int IPAddress);
+
+// highscores.cc
+//==============================================================================
+#define HIGHSCORES_MAX_PAGE_SIZE 100
+
+struct THighscoreEntry{
+	int Rank;
+	int Level;
+	char Name[30];
+	char Profession[30];
+};
+
+bool InitHighscores(void);
+void ExitHighscores(void);
+void MarkHighscores(void);
+void RollbackHighscores(void);
+void InsertHighscore(int WorldID, int CharacterID,
+		const char *Name, int Level, const char *Profession);
+void UpdateHighscore(int WorldID, int CharacterID, int Level, const char *Profession);
+bool GetHighscores(int WorldID, int FirstRank, int MaxEntries,
+		const char *CharacterName, int *NumEntries, int *CharacterRank,
+		DynamicArray<THighscoreEntry> *Entries);
+
 // hostcache.cc
 //==============================================================================
 bool InitHostCache(void);
 void ExitHostCache(void);
+void ResizeHostCache(int NewMaxCachedHostNames);
 bool ResolveHostName(const char *HostName, int *OutAddr);
 
+// killstats.cc
+//==============================================================================
+void ScheduleKillStatisticsFlush(void);
+bool InitKillStatistics(void);
+void ExitKillStatistics(void);
+bool LogKillStatistics(int WorldID, int NumStats, const TKillStatistics *Stats);
+bool FlushKillStatistics(void);
+void MergePendingKillStatistics(int WorldID, DynamicArray<TKillStatistics> *Stats);
+bool GetKillStatisticsWindow(int WorldID, int From, int To, DynamicArray<TKillStatistics> *Stats);
+
+// nameindex.cc
+//==============================================================================
+bool InitNameIndex(void);
+void ExitNameIndex(void);
+void MarkNameIndex(void);
+void RollbackNameIndex(void);
+void InsertCharacterName(int CharacterID, int WorldID, const char *Name);
+bool FindCharacterName(const char *Name, bool *Found, int *CharacterID, int *WorldID);
+
+// onlinelist.cc
+//==============================================================================
+struct TOnlineListEntry{
+	char Name[30];
+	int Level;
+	char Profession[30];
+};
+
+void ExitOnlineLists(void);
+int GetOnlineCharacterCount(int WorldID);
+void GetOnlineCharacters(int WorldID, TArena *Arena, DynamicArray<TOnlineCharacter> *Characters);
+int ReplaceOnlineCharacters(int WorldID, uint32 Sequence,
+		int NumCharacters, TOnlineListEntry *Characters);
+int UpdateOnlineCharacters(int WorldID, uint32 BaseSequence, uint32 Sequence,
+		int NumRemoved, TOnlineListEntry *Removed,
+		int NumUpdated, TOnlineListEntry *Updated);
+
+// recordcache.cc
+//==============================================================================
+// NOTE(fusion): Raw account and character rows as cached by the record cache.
+// Values derived from the current time, like premium days, are computed when
+// the row is read, and world fields are only valid if `HasWorld` is set.
+#define RECORD_CACHE_MAX_CHARACTERS 16
+
+struct TAccountRecord{
+	int AccountID;
+	char Email[100];
+	uint8 Auth[AUTH_SIZE];
+	int AuthSize;
+	int PremiumEnd;
+	int PendingPremiumDays;
+	bool Deleted;
+};
+
+struct TCharacterRecord{
+	int CharacterID;
+	int WorldID;
+	int AccountID;
+	char Name[30];
+	int Sex;
+	char Guild[30];
+	char Rank[30];
+	char Title[30];
+	int Level;
+	char Profession[30];
+	char Residence[30];
+	int LastLoginTime;
+	int IsOnline;
+	bool Deleted;
+	bool HasWorld;
+	char WorldName[30];
+};
+
+bool FindCachedAccount(int AccountID, TAccountRecord *Account);
+void CacheAccount(const TAccountRecord *Account);
+void DropCachedAccount(int AccountID);
+void DropCachedAccountCharacters(int AccountID);
+bool FindCachedCharacter(const char *Name, TCharacterRecord *Character);
+void CacheCharacter(const TCharacterRecord *Character);
+void DropCachedCharacter(int CharacterID);
+void DropCachedWorldCharacters(int WorldID);
+bool FindCachedAccountCharacters(int AccountID, DynamicArray<TCharacterRecord> *Characters);
+void CacheAccountCharacters(int AccountID, int NumCharacters, const TCharacterRecord *Characters);
+void LogRecordCacheStats(void);
+void ScheduleRecordCacheStats(void);
+bool InitRecordCache(void);
+void ExitRecordCache(void);
+void ResizeRecordCache(int NewRecordCacheSize);
+void MarkRecordCache(void);
+void RollbackRecordCache(void);
+
+// responsecache.cc
+//==============================================================================
+void ExitResponseCache(void);
+void InvalidateResponseCache(void);
+void InvalidateOnlineListResponses(int WorldID);
+void InvalidateKillStatisticsResponse(int WorldID);
+bool GetWorldsResponse(const uint8 **Data, int *Length);
+bool GetOnlineCharactersResponse(int WorldID, const uint8 **Data, int *Length);
+bool GetKillStatisticsResponse(int WorldID, const uint8 **Data, int *Length);
+
+// rights.cc
+//==============================================================================
+// NOTE(fusion): Rights known by the game server, plus `NO_STATISTICS` which
+// hides characters from the website. They're interned so rights checks are a
+// single bit test and the login response doesn't need to copy strings out of
+// the database. They're kept sorted by name so the login response has them in
+// the same order as the `CharacterRights` index, which is case insensitive so
+// underscores sort before letters.
+enum : int {
+	RIGHT_ALL_SPELLS,
+	RIGHT_ALLOW_MULTICLIENT,
+	RIGHT_ANONYMOUS_BROADCAST,
+	RIGHT_ATTACK_EVERYWHERE,
+	RIGHT_BANISHMENT,
+	RIGHT_CHANGE_PROFESSION,
+	RIGHT_CHANGE_SKILLS,
+	RIGHT_CHEATING_ACCOUNT_SHARING,
+	RIGHT_CHEATING_ACCOUNT_TRADING,
+	RIGHT_CHEATING_BUG_ABUSE,
+	RIGHT_CHEATING_GAME_WEAKNESS,
+	RIGHT_CHEATING_HACKING,
+	RIGHT_CHEATING_MACRO_USE,
+	RIGHT_CHEATING_MODIFIED_CLIENT,
+	RIGHT_CHEATING_MULTI_CLIENT,
+	RIGHT_CLEANUP_FIELDS,
+	RIGHT_CREATE_MONEY,
+	RIGHT_CREATE_MONSTERS,
+	RIGHT_CREATE_OBJECTS,
+	RIGHT_DESTRUCTIVE_BEHAVIOUR,
+	RIGHT_ENTER_HOUSES,
+	RIGHT_FINAL_WARNING,
+	RIGHT_GAMEMASTER_BROADCAST,
+	RIGHT_GAMEMASTER_FALSE_REPORTS,
+	RIGHT_GAMEMASTER_INFLUENCE,
+	RIGHT_GAMEMASTER_OUTFIT,
+	RIGHT_GAMEMASTER_PRETENDING,
+	RIGHT_GAMEMASTER_THREATENING,
+	RIGHT_HIGHLIGHT_HELP_CHANNEL,
+	RIGHT_HOME_TELEPORT,
+	RIGHT_IGNORED_BY_MONSTERS,
+	RIGHT_ILLUMINATE,
+	RIGHT_INVALID_PAYMENT,
+	RIGHT_INVULNERABLE,
+	RIGHT_IP_BANISHMENT,
+	RIGHT_KEEP_INVENTORY,
+	RIGHT_KICK,
+	RIGHT_KILLING_EXCESSIVE_UNJUSTIFIED,
+	RIGHT_LEVITATE,
+	RIGHT_LOG_COMMUNICATION,
+	RIGHT_MODIFY_GOSTRENGTH,
+	RIGHT_NAME_BADLY_FORMATTED,
+	RIGHT_NAME_CELEBRITY,
+	RIGHT_NAME_COUNTRY,
+	RIGHT_NAME_FAKE_IDENTITY,
+	RIGHT_NAME_FAKE_POSITION,
+	RIGHT_NAME_INSULTING,
+	RIGHT_NAME_NO_PERSON,
+	RIGHT_NAME_NONSENSICAL_LETTERS,
+	RIGHT_NAME_SENTENCE,
+	RIGHT_NAMELOCK,
+	RIGHT_NO_BANISHMENT,
+	RIGHT_NO_LOGOUT_BLOCK,
+	RIGHT_NO_STATISTICS,
+	RIGHT_NOTATION,
+	RIGHT_OPEN_NAMEDOORS,
+	RIGHT_READ_GAMEMASTER_CHANNEL,
+	RIGHT_READ_TUTOR_CHANNEL,
+	RIGHT_RETRIEVE,
+	RIGHT_SEND_BUGREPORTS,
+	RIGHT_SHOW_COORDINATE,
+	RIGHT_SHOW_KEYHOLE_NUMBERS,
+	RIGHT_SPECIAL_MOVEUSE,
+	RIGHT_SPOILING_AUCTION,
+	RIGHT_STATEMENT_ADVERT_MONEY,
+	RIGHT_STATEMENT_ADVERT_OFFTOPIC,
+	RIGHT_STATEMENT_CHANNEL_OFFTOPIC,
+	RIGHT_STATEMENT_INSULTING,
+	RIGHT_STATEMENT_NON_ENGLISH,
+	RIGHT_STATEMENT_REPORT,
+	RIGHT_STATEMENT_SPAMMING,
+	RIGHT_STATEMENT_VIOLATION_INCITING,
+	RIGHT_TELEPORT_TO_CHARACTER,
+	RIGHT_TELEPORT_TO_COORDINATE,
+	RIGHT_TELEPORT_TO_MARK,
+	RIGHT_TELEPORT_VERTICAL,
+	RIGHT_UNLIMITED_CAPACITY,
+	RIGHT_UNLIMITED_MANA,
+	NUM_CHARACTER_RIGHTS,
+};
+
+#define RIGHT_SET_WORDS ((NUM_CHARACTER_RIGHTS + 63) / 64)
+
+struct TRightSet{
+	uint64 Words[RIGHT_SET_WORDS];
+};
+
+inline bool RightSetHas(const TRightSet *Set, int Right){
+	ASSERT(Right >= 0 && Right < NUM_CHARACTER_RIGHTS);
+	return (Set->Words[Right / 64] & ((uint64)1 << (Right % 64))) != 0;
+}
+
+bool InitRights(void);
+bool CheckCharacterRight(int CharacterID, int Right);
+bool GetCharacterRightNames(int CharacterID, TArena *Arena, DynamicArray<const char*> *Rights);
+
 // sha256.cc
 //==============================================================================
 void SHA256(const uint8 *Input, int InputBytes, uint8 *Digest);
+void SHA256Batch(int Count, const uint8 *const *Inputs,
+		const int *InputBytes, uint8 *const *Digests);
+const char *SHA256KernelName(void);
 bool TestPassword(const uint8 *Auth, int AuthSize, const char *Password);
+void TestPasswordBatch(int Count, const uint8 *const *Auths, const int *AuthSizes,
+		const char *const *Passwords, bool *Results);
 bool GenerateAuth(const char *Password, uint8 *Auth, int AuthSize);
+bool AuthNeedsRehash(const uint8 *Auth, int AuthSize);
+bool InitPasswordHashing(void);
 bool CheckSHA256(void);
 
+// worldcache.cc
+//==============================================================================
+bool InitWorldCache(void);
+void ExitWorldCache(void);
+void InvalidateWorldCache(void);
+void InvalidateWorldOnlineRecord(void);
+void MarkWorldCache(void);
+void RollbackWorldCache(void);
+int GetWorldID(const char *WorldName);
+bool GetWorlds(DynamicArray<TWorld> *Worlds);
+bool GetWorldConfig(int WorldID, TWorldConfig *WorldConfig);
+bool GetWorldEndpoint(int WorldID, int *IPAddress, int *Port);
+int GetWorldOnlineRecord(int WorldID);
+
 #endif //TIBIA_QUERYMANAGER_HH_
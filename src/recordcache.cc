@@ -0,0 +1,630 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): Account and character rows read by the login server, the game
+// server, and the website are kept in two fixed pools, sized from a single
+// memory budget, so popular rows don't need to go through the database every
+// time. Accounts are indexed by id, and characters by id and case insensitive
+// name. Each pool is evicted with the CLOCK algorithm, which is close enough to
+// LRU without having to touch any lists on hits.
+//	Accounts may also remember the ids of their characters, in which case the
+// character list of the account can be built without the database as long as
+// all of them are still cached, which is the common case since lists are only
+// ever loaded as a whole.
+//	Every write function in `database.cc` drops whatever rows it modifies, and
+// everything is dropped whenever the database's `data_version` changes. Drops
+// are also logged so they can be repeated if the transaction that made them is
+// rolled back, in case the modified rows were loaded again before that.
+#define RECORD_CACHE_MIN_SLOTS 64
+#define RECORD_CACHE_MAX_DROPS 64
+
+enum : int {
+	RECORD_DROP_ACCOUNT				= 0,
+	RECORD_DROP_ACCOUNT_CHARACTERS	= 1,
+	RECORD_DROP_CHARACTER			= 2,
+	RECORD_DROP_WORLD_CHARACTERS	= 3,
+};
+
+struct TAccountSlot{
+	TAccountRecord Record;
+	int Next;
+	bool Used;
+	bool Referenced;
+	bool CharactersLoaded;
+	int NumCharacters;
+	int CharacterIDs[RECORD_CACHE_MAX_CHARACTERS];
+};
+
+struct TCharacterSlot{
+	TCharacterRecord Record;
+	int Next;
+	int NameNext;
+	bool Used;
+	bool Referenced;
+};
+
+struct TRecordDrop{
+	int Type;
+	int Key;
+};
+
+struct TRecordCacheStats{
+	int64 Hits;
+	int64 Misses;
+};
+
+static TAccountSlot *g_AccountSlots;
+static int *g_AccountBuckets;
+static int g_NumAccountSlots;
+static int g_NumAccountBuckets;
+static int g_NumAccounts;
+static int g_AccountHand;
+
+static TCharacterSlot *g_CharacterSlots;
+static int *g_CharacterBuckets;
+static int *g_CharacterNameBuckets;
+static int g_NumCharacterSlots;
+static int g_NumCharacterBuckets;
+static int g_NumCharacters;
+static int g_CharacterHand;
+
+static TRecordCacheStats g_AccountStats;
+static TRecordCacheStats g_CharacterStats;
+static TRecordCacheStats g_CharacterListStats;
+static int64 g_RecordCacheEvictions;
+static int64 g_RecordCacheInvalidations;
+static usize g_RecordCacheMemory;
+
+static TRecordDrop g_RecordDrops[RECORD_CACHE_MAX_DROPS];
+static int g_NumRecordDrops;
+
+static int g_RecordCacheDataVersion;
+static bool g_RecordCacheLoaded;
+static TTimer g_RecordCacheStatsTimer;
+
+static uint32 HashRecordKey(int Key){
+	uint32 Hash = (uint32)Key * 0x9E3779B1U;
+	return Hash ^ (Hash >> 16);
+}
+
+static uint32 HashRecordName(const char *Name){
+	// NOTE(fusion): Same as `HashText` but ASCII case insensitive, to match
+	// the `NOCASE` collation of `Characters.Name`.
+	uint32 Hash = 0x811C9DC5U;
+	for(int i = 0; Name[i] != 0; i += 1){
+		Hash ^= (uint32)tolower((uint8)Name[i]);
+		Hash *= 0x01000193U;
+	}
+	return Hash;
+}
+
+static int NextPowerOfTwo(int Value){
+	int Result = 1;
+	while(Result < Value){
+		Result *= 2;
+	}
+	return Result;
+}
+
+static void ClearRecordCache(void){
+	for(int i = 0; i < g_NumAccountBuckets; i += 1){
+		g_AccountBuckets[i] = -1;
+	}
+
+	for(int i = 0; i < g_NumAccountSlots; i += 1){
+		g_AccountSlots[i].Used = false;
+	}
+
+	for(int i = 0; i < g_NumCharacterBuckets; i += 1){
+		g_CharacterBuckets[i] = -1;
+		g_CharacterNameBuckets[i] = -1;
+	}
+
+	for(int i = 0; i < g_NumCharacterSlots; i += 1){
+		g_CharacterSlots[i].Used = false;
+	}
+
+	g_NumAccounts = 0;
+	g_NumCharacters = 0;
+}
+
+static bool CheckRecordCache(void){
+	if(g_NumAccountSlots == 0 || g_NumCharacterSlots == 0){
+		return false;
+	}
+
+	int DataVersion;
+	if(!GetDataVersion(&DataVersion)){
+		ClearRecordCache();
+		g_RecordCacheLoaded = false;
+		return false;
+	}
+
+	if(!g_RecordCacheLoaded || DataVersion != g_RecordCacheDataVersion){
+		if(g_NumAccounts > 0 || g_NumCharacters > 0){
+			g_RecordCacheInvalidations += 1;
+		}
+		ClearRecordCache();
+	}
+
+	g_RecordCacheDataVersion = DataVersion;
+	g_RecordCacheLoaded = true;
+	return true;
+}
+
+// Accounts
+//==============================================================================
+static int *FindAccountLink(int AccountID){
+	int *Link = &g_AccountBuckets[HashRecordKey(AccountID) & (uint32)(g_NumAccountBuckets - 1)];
+	while(*Link != -1 && g_AccountSlots[*Link].Record.AccountID != AccountID){
+		Link = &g_AccountSlots[*Link].Next;
+	}
+	return Link;
+}
+
+static TAccountSlot *FindAccountSlot(int AccountID){
+	int Index = *FindAccountLink(AccountID);
+	return (Index != -1 ? &g_AccountSlots[Index] : NULL);
+}
+
+static void UnlinkAccountSlot(int Index){
+	int *Link = FindAccountLink(g_AccountSlots[Index].Record.AccountID);
+	ASSERT(*Link == Index);
+	*Link = g_AccountSlots[Index].Next;
+	g_AccountSlots[Index].Used = false;
+	g_NumAccounts -= 1;
+}
+
+static int AllocAccountSlot(void){
+	while(true){
+		int Index = g_AccountHand;
+		TAccountSlot *Slot = &g_AccountSlots[Index];
+		g_AccountHand = (g_AccountHand + 1) % g_NumAccountSlots;
+		if(!Slot->Used){
+			return Index;
+		}else if(Slot->Referenced){
+			Slot->Referenced = false;
+		}else{
+			UnlinkAccountSlot(Index);
+			g_RecordCacheEvictions += 1;
+			return Index;
+		}
+	}
+}
+
+bool FindCachedAccount(int AccountID, TAccountRecord *Account){
+	ASSERT(Account != NULL);
+	if(!CheckRecordCache()){
+		return false;
+	}
+
+	TAccountSlot *Slot = FindAccountSlot(AccountID);
+	if(Slot == NULL){
+		g_AccountStats.Misses += 1;
+		return false;
+	}
+
+	g_AccountStats.Hits += 1;
+	Slot->Referenced = true;
+	*Account = Slot->Record;
+	return true;
+}
+
+void CacheAccount(const TAccountRecord *Account){
+	ASSERT(Account != NULL);
+	if(!CheckRecordCache()){
+		return;
+	}
+
+	TAccountSlot *Slot = FindAccountSlot(Account->AccountID);
+	if(Slot == NULL){
+		int Index = AllocAccountSlot();
+		int *Bucket = &g_AccountBuckets[HashRecordKey(Account->AccountID)
+				& (uint32)(g_NumAccountBuckets - 1)];
+		Slot = &g_AccountSlots[Index];
+		memset(Slot, 0, sizeof(TAccountSlot));
+		Slot->Next = *Bucket;
+		Slot->Used = true;
+		*Bucket = Index;
+		g_NumAccounts += 1;
+	}
+
+	Slot->Record = *Account;
+	Slot->Referenced = true;
+}
+
+static void DropAccountSlot(int AccountID){
+	if(g_NumAccounts > 0){
+		int Index = *FindAccountLink(AccountID);
+		if(Index != -1){
+			UnlinkAccountSlot(Index);
+		}
+	}
+}
+
+static void DropAccountCharacterList(int AccountID){
+	if(g_NumAccounts > 0){
+		TAccountSlot *Slot = FindAccountSlot(AccountID);
+		if(Slot != NULL){
+			Slot->CharactersLoaded = false;
+		}
+	}
+}
+
+// Characters
+//==============================================================================
+static int *FindCharacterLink(int CharacterID){
+	int *Link = &g_CharacterBuckets[HashRecordKey(CharacterID) & (uint32)(g_NumCharacterBuckets - 1)];
+	while(*Link != -1 && g_CharacterSlots[*Link].Record.CharacterID != CharacterID){
+		Link = &g_CharacterSlots[*Link].Next;
+	}
+	return Link;
+}
+
+static int *FindCharacterNameLink(const char *Name){
+	int *Link = &g_CharacterNameBuckets[HashRecordName(Name) & (uint32)(g_NumCharacterBuckets - 1)];
+	while(*Link != -1 && !StringEqCI(g_CharacterSlots[*Link].Record.Name, Name)){
+		Link = &g_CharacterSlots[*Link].NameNext;
+	}
+	return Link;
+}
+
+static void UnlinkCharacterSlot(int Index){
+	TCharacterSlot *Slot = &g_CharacterSlots[Index];
+	int *Link = FindCharacterLink(Slot->Record.CharacterID);
+	ASSERT(*Link == Index);
+	*Link = Slot->Next;
+
+	// NOTE(fusion): Names are unique so there can't be another slot with the
+	// same name before this one.
+	int *NameLink = FindCharacterNameLink(Slot->Record.Name);
+	ASSERT(*NameLink == Index);
+	*NameLink = Slot->NameNext;
+
+	Slot->Used = false;
+	g_NumCharacters -= 1;
+}
+
+static int AllocCharacterSlot(void){
+	while(true){
+		int Index = g_CharacterHand;
+		TCharacterSlot *Slot = &g_CharacterSlots[Index];
+		g_CharacterHand = (g_CharacterHand + 1) % g_NumCharacterSlots;
+		if(!Slot->Used){
+			return Index;
+		}else if(Slot->Referenced){
+			Slot->Referenced = false;
+		}else{
+			UnlinkCharacterSlot(Index);
+			g_RecordCacheEvictions += 1;
+			return Index;
+		}
+	}
+}
+
+static void InsertCharacterSlot(const TCharacterRecord *Character){
+	// NOTE(fusion): A name may be reused by a different character if the old
+	// one was renamed or deleted externally, which would also bump the data
+	// version, but better safe than sorry.
+	int Index = *FindCharacterLink(Character->CharacterID);
+	if(Index != -1){
+		UnlinkCharacterSlot(Index);
+	}
+
+	Index = *FindCharacterNameLink(Character->Name);
+	if(Index != -1){
+		UnlinkCharacterSlot(Index);
+	}
+
+	Index = AllocCharacterSlot();
+	uint32 Mask = (uint32)(g_NumCharacterBuckets - 1);
+	int *Bucket = &g_CharacterBuckets[HashRecordKey(Character->CharacterID) & Mask];
+	int *NameBucket = &g_CharacterNameBuckets[HashRecordName(Character->Name) & Mask];
+	TCharacterSlot *Slot = &g_CharacterSlots[Index];
+	Slot->Record = *Character;
+	Slot->Next = *Bucket;
+	Slot->NameNext = *NameBucket;
+	Slot->Used = true;
+	Slot->Referenced = true;
+	*Bucket = Index;
+	*NameBucket = Index;
+	g_NumCharacters += 1;
+}
+
+bool FindCachedCharacter(const char *Name, TCharacterRecord *Character){
+	ASSERT(Name != NULL && Character != NULL);
+	if(!CheckRecordCache()){
+		return false;
+	}
+
+	int Index = *FindCharacterNameLink(Name);
+	if(Index == -1){
+		g_CharacterStats.Misses += 1;
+		return false;
+	}
+
+	g_CharacterStats.Hits += 1;
+	g_CharacterSlots[Index].Referenced = true;
+	*Character = g_CharacterSlots[Index].Record;
+	return true;
+}
+
+void CacheCharacter(const TCharacterRecord *Character){
+	ASSERT(Character != NULL);
+	if(CheckRecordCache()){
+		InsertCharacterSlot(Character);
+	}
+}
+
+static void DropCharacterSlot(int CharacterID){
+	if(g_NumCharacters > 0){
+		int Index = *FindCharacterLink(CharacterID);
+		if(Index != -1){
+			UnlinkCharacterSlot(Index);
+		}
+	}
+}
+
+static void DropWorldCharacterSlots(int WorldID){
+	for(int i = 0; i < g_NumCharacterSlots && g_NumCharacters > 0; i += 1){
+		if(g_CharacterSlots[i].Used && g_CharacterSlots[i].Record.WorldID == WorldID){
+			UnlinkCharacterSlot(i);
+		}
+	}
+}
+
+bool FindCachedAccountCharacters(int AccountID, DynamicArray<TCharacterRecord> *Characters){
+	ASSERT(Characters != NULL);
+	if(!CheckRecordCache()){
+		return false;
+	}
+
+	TAccountSlot *Slot = FindAccountSlot(AccountID);
+	if(Slot == NULL || !Slot->CharactersLoaded){
+		g_CharacterListStats.Misses += 1;
+		return false;
+	}
+
+	// NOTE(fusion): Characters are evicted independently from their account,
+	// in which case the whole list is loaded again.
+	for(int i = 0; i < Slot->NumCharacters; i += 1){
+		if(*FindCharacterLink(Slot->CharacterIDs[i]) == -1){
+			Slot->CharactersLoaded = false;
+			g_CharacterListStats.Misses += 1;
+			return false;
+		}
+	}
+
+	g_CharacterListStats.Hits += 1;
+	Slot->Referenced = true;
+	Characters->Reserve(Characters->Length() + Slot->NumCharacters);
+	for(int i = 0; i < Slot->NumCharacters; i += 1){
+		TCharacterSlot *CharacterSlot = &g_CharacterSlots[*FindCharacterLink(Slot->CharacterIDs[i])];
+		CharacterSlot->Referenced = true;
+		Characters->Push(CharacterSlot->Record);
+	}
+	return true;
+}
+
+void CacheAccountCharacters(int AccountID, int NumCharacters, const TCharacterRecord *Characters){
+	ASSERT(NumCharacters >= 0 && (Characters != NULL || NumCharacters == 0));
+	if(!CheckRecordCache()){
+		return;
+	}
+
+	for(int i = 0; i < NumCharacters; i += 1){
+		InsertCharacterSlot(&Characters[i]);
+	}
+
+	// NOTE(fusion): The list is only kept if the account itself is cached and
+	// small enough, otherwise it's always loaded from the database.
+	TAccountSlot *Slot = FindAccountSlot(AccountID);
+	if(Slot != NULL && NumCharacters <= RECORD_CACHE_MAX_CHARACTERS){
+		for(int i = 0; i < NumCharacters; i += 1){
+			Slot->CharacterIDs[i] = Characters[i].CharacterID;
+		}
+		Slot->NumCharacters = NumCharacters;
+		Slot->CharactersLoaded = true;
+	}
+}
+
+// Drops
+//==============================================================================
+static void LogRecordDrop(int Type, int Key){
+	// NOTE(fusion): A negative count means the log overflowed, in which case
+	// the whole cache is dropped on rollback.
+	if(g_NumRecordDrops < 0){
+		return;
+	}
+
+	if(g_NumRecordDrops >= NARRAY(g_RecordDrops)){
+		g_NumRecordDrops = -1;
+		return;
+	}
+
+	TRecordDrop *Drop = &g_RecordDrops[g_NumRecordDrops];
+	Drop->Type = Type;
+	Drop->Key = Key;
+	g_NumRecordDrops += 1;
+}
+
+static void ApplyRecordDrop(int Type, int Key){
+	switch(Type){
+		case RECORD_DROP_ACCOUNT:				DropAccountSlot(Key); break;
+		case RECORD_DROP_ACCOUNT_CHARACTERS:	DropAccountCharacterList(Key); break;
+		case RECORD_DROP_CHARACTER:				DropCharacterSlot(Key); break;
+		case RECORD_DROP_WORLD_CHARACTERS:		DropWorldCharacterSlots(Key); break;
+		default:{
+			LOG_ERR("Invalid record drop type %d", Type);
+			break;
+		}
+	}
+}
+
+void DropCachedAccount(int AccountID){
+	LogRecordDrop(RECORD_DROP_ACCOUNT, AccountID);
+	DropAccountSlot(AccountID);
+}
+
+void DropCachedAccountCharacters(int AccountID){
+	LogRecordDrop(RECORD_DROP_ACCOUNT_CHARACTERS, AccountID);
+	DropAccountCharacterList(AccountID);
+}
+
+void DropCachedCharacter(int CharacterID){
+	LogRecordDrop(RECORD_DROP_CHARACTER, CharacterID);
+	DropCharacterSlot(CharacterID);
+}
+
+void DropCachedWorldCharacters(int WorldID){
+	LogRecordDrop(RECORD_DROP_WORLD_CHARACTERS, WorldID);
+	DropWorldCharacterSlots(WorldID);
+}
+
+void MarkRecordCache(void){
+	g_NumRecordDrops = 0;
+}
+
+void RollbackRecordCache(void){
+	// NOTE(fusion): Rows that weren't modified by the transaction can only have
+	// been loaded with committed values, so only the ones it dropped need to be
+	// dropped again.
+	if(g_NumRecordDrops < 0){
+		g_RecordCacheLoaded = false;
+	}else{
+		for(int i = 0; i < g_NumRecordDrops; i += 1){
+			ApplyRecordDrop(g_RecordDrops[i].Type, g_RecordDrops[i].Key);
+		}
+	}
+	g_NumRecordDrops = 0;
+}
+
+// Record Cache
+//==============================================================================
+static double HitRate(const TRecordCacheStats *Stats){
+	int64 Total = Stats->Hits + Stats->Misses;
+	return (Total > 0 ? (100.0 * (double)Stats->Hits / (double)Total) : 0.0);
+}
+
+void LogRecordCacheStats(void){
+	LOG("Record cache: %d/%d accounts, %d/%d characters, %dKB",
+			g_NumAccounts, g_NumAccountSlots, g_NumCharacters,
+			g_NumCharacterSlots, (int)(g_RecordCacheMemory >> 10));
+	LOG("Record cache hits: accounts %.1f%% (%lld/%lld),"
+			" characters %.1f%% (%lld/%lld), lists %.1f%% (%lld/%lld)",
+			HitRate(&g_AccountStats), (long long)g_AccountStats.Hits,
+			(long long)(g_AccountStats.Hits + g_AccountStats.Misses),
+			HitRate(&g_CharacterStats), (long long)g_CharacterStats.Hits,
+			(long long)(g_CharacterStats.Hits + g_CharacterStats.Misses),
+			HitRate(&g_CharacterListStats), (long long)g_CharacterListStats.Hits,
+			(long long)(g_CharacterListStats.Hits + g_CharacterListStats.Misses));
+	LOG("Record cache evictions: %lld, invalidations: %lld",
+			(long long)g_RecordCacheEvictions, (long long)g_RecordCacheInvalidations);
+}
+
+static void RecordCacheStatsJob(TTimer *Timer){
+	LogRecordCacheStats();
+	ScheduleRecordCacheStats();
+}
+
+void ScheduleRecordCacheStats(void){
+	if(g_RecordCacheStatsInterval > 0 && g_RecordCacheSize > 0){
+		ScheduleTimer(&g_TimerWheel, &g_RecordCacheStatsTimer,
+				(int64)g_MonotonicTimeMS + g_RecordCacheStatsInterval);
+	}else{
+		CancelTimer(&g_RecordCacheStatsTimer);
+	}
+}
+
+static void FreeRecordCache(void){
+	free(g_AccountSlots);
+	free(g_AccountBuckets);
+	free(g_CharacterSlots);
+	free(g_CharacterBuckets);
+	free(g_CharacterNameBuckets);
+	g_AccountSlots = NULL;
+	g_AccountBuckets = NULL;
+	g_CharacterSlots = NULL;
+	g_CharacterBuckets = NULL;
+	g_CharacterNameBuckets = NULL;
+	g_NumAccountSlots = 0;
+	g_NumAccountBuckets = 0;
+	g_NumCharacterSlots = 0;
+	g_NumCharacterBuckets = 0;
+	g_NumAccounts = 0;
+	g_NumCharacters = 0;
+	g_AccountHand = 0;
+	g_CharacterHand = 0;
+	g_RecordCacheMemory = 0;
+	g_RecordCacheLoaded = false;
+}
+
+static void AllocRecordCache(int RecordCacheSize){
+	ASSERT(g_AccountSlots == NULL && g_CharacterSlots == NULL);
+	if(RecordCacheSize <= 0){
+		return;
+	}
+
+	// NOTE(fusion): Accounts get a quarter of the budget since there are
+	// usually a few characters per account. Buckets are accounted for as if
+	// they were part of each slot.
+	usize AccountSize = sizeof(TAccountSlot) + sizeof(int) * 2;
+	usize CharacterSize = sizeof(TCharacterSlot) + sizeof(int) * 4;
+	int NumAccountSlots = std::max<int>((int)(((usize)RecordCacheSize / 4) / AccountSize),
+			RECORD_CACHE_MIN_SLOTS);
+	int NumCharacterSlots = std::max<int>((int)((((usize)RecordCacheSize / 4) * 3) / CharacterSize),
+			RECORD_CACHE_MIN_SLOTS);
+	int NumAccountBuckets = NextPowerOfTwo(NumAccountSlots);
+	int NumCharacterBuckets = NextPowerOfTwo(NumCharacterSlots);
+
+	g_AccountSlots = (TAccountSlot*)calloc((usize)NumAccountSlots, sizeof(TAccountSlot));
+	g_AccountBuckets = (int*)calloc((usize)NumAccountBuckets, sizeof(int));
+	g_CharacterSlots = (TCharacterSlot*)calloc((usize)NumCharacterSlots, sizeof(TCharacterSlot));
+	g_CharacterBuckets = (int*)calloc((usize)NumCharacterBuckets, sizeof(int));
+	g_CharacterNameBuckets = (int*)calloc((usize)NumCharacterBuckets, sizeof(int));
+	if(g_AccountSlots == NULL || g_AccountBuckets == NULL || g_CharacterSlots == NULL
+			|| g_CharacterBuckets == NULL || g_CharacterNameBuckets == NULL){
+		PANIC("Failed to allocate record cache with %d accounts and %d characters",
+				NumAccountSlots, NumCharacterSlots);
+		return;
+	}
+
+	g_NumAccountSlots = NumAccountSlots;
+	g_NumAccountBuckets = NumAccountBuckets;
+	g_NumCharacterSlots = NumCharacterSlots;
+	g_NumCharacterBuckets = NumCharacterBuckets;
+	g_RecordCacheMemory = sizeof(TAccountSlot) * (usize)NumAccountSlots
+			+ sizeof(int) * (usize)NumAccountBuckets
+			+ sizeof(TCharacterSlot) * (usize)NumCharacterSlots
+			+ sizeof(int) * (usize)NumCharacterBuckets * 2;
+	ClearRecordCache();
+}
+
+bool InitRecordCache(void){
+	ASSERT(g_AccountSlots == NULL && g_CharacterSlots == NULL);
+	AllocRecordCache(g_RecordCacheSize);
+	if(g_RecordCacheSize > 0){
+		LOG("Record cache: %d accounts, %d characters (%dKB)",
+				g_NumAccountSlots, g_NumCharacterSlots,
+				(int)(g_RecordCacheMemory >> 10));
+	}else{
+		LOG("Record cache disabled");
+	}
+
+	InitTimer(&g_RecordCacheStatsTimer, RecordCacheStatsJob, NULL);
+	ScheduleRecordCacheStats();
+	return true;
+}
+
+void ExitRecordCache(void){
+	CancelTimer(&g_RecordCacheStatsTimer);
+	FreeRecordCache();
+}
+
+void ResizeRecordCache(int NewRecordCacheSize){
+	// NOTE(fusion): It's only a cache so there is no point in carrying rows
+	// over to the new pools.
+	FreeRecordCache();
+	AllocRecordCache(NewRecordCacheSize);
+	g_RecordCacheSize = NewRecordCacheSize;
+	ScheduleRecordCacheStats();
+}
@@ -0,0 +1,235 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): The website asks for the world list, online characters, and
+// kill statistics on most page views, and the answer only changes when a game
+// server sends a new online list or kill statistics, or when worlds change. The
+// response payload of each of these queries is kept already serialized, so it
+// can be copied straight into the connection buffer, and only rebuilt after it
+// is invalidated.
+//	Responses are also dropped whenever the database's `data_version` changes
+// (e.g. when kill statistics are reset from the sqlite shell).
+struct TResponseBlob{
+	bool Valid;
+	int Length;
+	uint8 *Data;
+};
+
+struct TWorldResponses{
+	int WorldID;
+	TResponseBlob OnlineCharacters;
+	TResponseBlob KillStatistics;
+};
+
+static TResponseBlob g_WorldsResponse;
+static TWorldResponses *g_WorldResponses;
+static int g_NumWorldResponses;
+static uint8 *g_ResponseScratch;
+static int g_ResponseCacheDataVersion;
+static bool g_ResponseCacheChecked;
+
+static void ClearResponseBlob(TResponseBlob *Blob){
+	free(Blob->Data);
+	memset(Blob, 0, sizeof(TResponseBlob));
+}
+
+static TWriteBuffer PrepareResponseBlob(void){
+	// NOTE(fusion): Leave room for the response header, which may use the
+	// extended payload size, and status.
+	if(g_ResponseScratch == NULL){
+		g_ResponseScratch = (uint8*)malloc(g_MaxConnectionPacketSize);
+		if(g_ResponseScratch == NULL){
+			PANIC("Failed to allocate response scratch buffer");
+		}
+	}
+	return TWriteBuffer(g_ResponseScratch, g_MaxConnectionPacketSize - 7);
+}
+
+static bool StoreResponseBlob(TResponseBlob *Blob, TWriteBuffer *WriteBuffer){
+	if(WriteBuffer->Overflowed()){
+		LOG_ERR("Response is too large (%d bytes)", WriteBuffer->TotalSize());
+		return false;
+	}
+
+	uint8 *Data = (uint8*)malloc((usize)std::max<int>(WriteBuffer->Position, 1));
+	if(Data == NULL){
+		PANIC("Failed to allocate %d bytes for response", WriteBuffer->Position);
+		return false;
+	}
+
+	memcpy(Data, WriteBuffer->Buffer, (usize)WriteBuffer->Position);
+	free(Blob->Data);
+	Blob->Valid = true;
+	Blob->Length = WriteBuffer->Position;
+	Blob->Data = Data;
+	return true;
+}
+
+static void CheckResponseCache(void){
+	int DataVersion;
+	if(!GetDataVersion(&DataVersion)){
+		InvalidateResponseCache();
+		return;
+	}
+
+	if(!g_ResponseCacheChecked || DataVersion != g_ResponseCacheDataVersion){
+		InvalidateResponseCache();
+		g_ResponseCacheDataVersion = DataVersion;
+		g_ResponseCacheChecked = true;
+	}
+}
+
+static TWorldResponses *FindWorldResponses(int WorldID){
+	for(int i = 0; i < g_NumWorldResponses; i += 1){
+		if(g_WorldResponses[i].WorldID == WorldID){
+			return &g_WorldResponses[i];
+		}
+	}
+	return NULL;
+}
+
+static TWorldResponses *GetWorldResponses(int WorldID){
+	TWorldResponses *Responses = FindWorldResponses(WorldID);
+	if(Responses != NULL){
+		return Responses;
+	}
+
+	TWorldResponses *NewWorldResponses = (TWorldResponses*)realloc(g_WorldResponses,
+			sizeof(TWorldResponses) * (usize)(g_NumWorldResponses + 1));
+	if(NewWorldResponses == NULL){
+		PANIC("Failed to grow world responses to %d", g_NumWorldResponses + 1);
+		return NULL;
+	}
+
+	g_WorldResponses = NewWorldResponses;
+	Responses = &g_WorldResponses[g_NumWorldResponses];
+	g_NumWorldResponses += 1;
+
+	memset(Responses, 0, sizeof(TWorldResponses));
+	Responses->WorldID = WorldID;
+	return Responses;
+}
+
+void ExitResponseCache(void){
+	InvalidateResponseCache();
+	free(g_WorldResponses);
+	g_WorldResponses = NULL;
+	g_NumWorldResponses = 0;
+	free(g_ResponseScratch);
+	g_ResponseScratch = NULL;
+	g_ResponseCacheChecked = false;
+}
+
+void InvalidateResponseCache(void){
+	ClearResponseBlob(&g_WorldsResponse);
+	for(int i = 0; i < g_NumWorldResponses; i += 1){
+		ClearResponseBlob(&g_WorldResponses[i].OnlineCharacters);
+		ClearResponseBlob(&g_WorldResponses[i].KillStatistics);
+	}
+}
+
+void InvalidateOnlineListResponses(int WorldID){
+	// NOTE(fusion): The world list has the number of players of each world.
+	ClearResponseBlob(&g_WorldsResponse);
+	TWorldResponses *Responses = FindWorldResponses(WorldID);
+	if(Responses != NULL){
+		ClearResponseBlob(&Responses->OnlineCharacters);
+	}
+}
+
+void InvalidateKillStatisticsResponse(int WorldID){
+	TWorldResponses *Responses = FindWorldResponses(WorldID);
+	if(Responses != NULL){
+		ClearResponseBlob(&Responses->KillStatistics);
+	}
+}
+
+bool GetWorldsResponse(const uint8 **Data, int *Length){
+	ASSERT(Data != NULL && Length != NULL);
+	CheckResponseCache();
+	if(!g_WorldsResponse.Valid){
+		DynamicArray<TWorld> Worlds;
+		if(!GetWorlds(&Worlds)){
+			return false;
+		}
+
+		TWriteBuffer WriteBuffer = PrepareResponseBlob();
+		int NumWorlds = std::min<int>(Worlds.Length(), UINT8_MAX);
+		WriteBuffer.Write8((uint8)NumWorlds);
+		for(int i = 0; i < NumWorlds; i += 1){
+			WriteBuffer.WriteString(Worlds[i].Name);
+			WriteBuffer.Write8((uint8)Worlds[i].Type);
+			WriteBuffer.Write16((uint16)Worlds[i].NumPlayers);
+			WriteBuffer.Write16((uint16)Worlds[i].MaxPlayers);
+			WriteBuffer.Write16((uint16)Worlds[i].OnlineRecord);
+			WriteBuffer.Write32((uint32)Worlds[i].OnlineRecordTimestamp);
+		}
+
+		if(!StoreResponseBlob(&g_WorldsResponse, &WriteBuffer)){
+			return false;
+		}
+	}
+
+	*Data = g_WorldsResponse.Data;
+	*Length = g_WorldsResponse.Length;
+	return true;
+}
+
+bool GetOnlineCharactersResponse(int WorldID, const uint8 **Data, int *Length){
+	ASSERT(Data != NULL && Length != NULL);
+	CheckResponseCache();
+	TWorldResponses *Responses = GetWorldResponses(WorldID);
+	if(!Responses->OnlineCharacters.Valid){
+		TArena Arena = {};
+		DynamicArray<TOnlineCharacter> Characters(&Arena);
+		GetOnlineCharacters(WorldID, &Arena, &Characters);
+
+		TWriteBuffer WriteBuffer = PrepareResponseBlob();
+		int NumCharacters = std::min<int>(Characters.Length(), UINT16_MAX);
+		WriteBuffer.Write16((uint16)NumCharacters);
+		for(int i = 0; i < NumCharacters; i += 1){
+			WriteBuffer.WriteString(Characters[i].Name);
+			WriteBuffer.Write16((uint16)Characters[i].Level);
+			WriteBuffer.WriteString(Characters[i].Profession);
+		}
+
+		bool Stored = StoreResponseBlob(&Responses->OnlineCharacters, &WriteBuffer);
+		ArenaFree(&Arena);
+		if(!Stored){
+			return false;
+		}
+	}
+
+	*Data = Responses->OnlineCharacters.Data;
+	*Length = Responses->OnlineCharacters.Length;
+	return true;
+}
+
+bool GetKillStatisticsResponse(int WorldID, const uint8 **Data, int *Length){
+	ASSERT(Data != NULL && Length != NULL);
+	CheckResponseCache();
+	TWorldResponses *Responses = GetWorldResponses(WorldID);
+	if(!Responses->KillStatistics.Valid){
+		DynamicArray<TKillStatistics> Stats;
+		if(!GetKillStatistics(WorldID, &Stats)){
+			return false;
+		}
+		MergePendingKillStatistics(WorldID, &Stats);
+
+		TWriteBuffer WriteBuffer = PrepareResponseBlob();
+		int NumStats = std::min<int>(Stats.Length(), UINT16_MAX);
+		WriteBuffer.Write16((uint16)NumStats);
+		for(int i = 0; i < NumStats; i += 1){
+			WriteBuffer.WriteString(Stats[i].RaceName);
+			WriteBuffer.Write32((uint32)Stats[i].PlayersKilled);
+			WriteBuffer.Write32((uint32)Stats[i].TimesKilled);
+		}
+
+		if(!StoreResponseBlob(&Responses->KillStatistics, &WriteBuffer)){
+			return false;
+		}
+	}
+
+	*Data = Responses->KillStatistics.Data;
+	*Length = Responses->KillStatistics.Length;
+	return true;
+}
@@ -0,0 +1,215 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): Character rights are only ever written externally so they're
+// kept in a small direct mapped cache, indexed by character id, which is thrown
+// away whenever the database's `data_version` changes.
+//	Rights that aren't known at compile time are still sent to the game server
+// but characters that have any of them will always load their names from the
+// database.
+#define RIGHTS_CACHE_SIZE 4096
+
+struct TRightsCacheEntry{
+	int CharacterID;
+	bool Valid;
+	bool UnknownRights;
+	TRightSet Rights;
+};
+
+static const char *g_RightNames[] = {
+	"ALL_SPELLS",
+	"ALLOW_MULTICLIENT",
+	"ANONYMOUS_BROADCAST",
+	"ATTACK_EVERYWHERE",
+	"BANISHMENT",
+	"CHANGE_PROFESSION",
+	"CHANGE_SKILLS",
+	"CHEATING_ACCOUNT_SHARING",
+	"CHEATING_ACCOUNT_TRADING",
+	"CHEATING_BUG_ABUSE",
+	"CHEATING_GAME_WEAKNESS",
+	"CHEATING_HACKING",
+	"CHEATING_MACRO_USE",
+	"CHEATING_MODIFIED_CLIENT",
+	"CHEATING_MULTI_CLIENT",
+	"CLEANUP_FIELDS",
+	"CREATE_MONEY",
+	"CREATE_MONSTERS",
+	"CREATE_OBJECTS",
+	"DESTRUCTIVE_BEHAVIOUR",
+	"ENTER_HOUSES",
+	"FINAL_WARNING",
+	"GAMEMASTER_BROADCAST",
+	"GAMEMASTER_FALSE_REPORTS",
+	"GAMEMASTER_INFLUENCE",
+	"GAMEMASTER_OUTFIT",
+	"GAMEMASTER_PRETENDING",
+	"GAMEMASTER_THREATENING",
+	"HIGHLIGHT_HELP_CHANNEL",
+	"HOME_TELEPORT",
+	"IGNORED_BY_MONSTERS",
+	"ILLUMINATE",
+	"INVALID_PAYMENT",
+	"INVULNERABLE",
+	"IP_BANISHMENT",
+	"KEEP_INVENTORY",
+	"KICK",
+	"KILLING_EXCESSIVE_UNJUSTIFIED",
+	"LEVITATE",
+	"LOG_COMMUNICATION",
+	"MODIFY_GOSTRENGTH",
+	"NAME_BADLY_FORMATTED",
+	"NAME_CELEBRITY",
+	"NAME_COUNTRY",
+	"NAME_FAKE_IDENTITY",
+	"NAME_FAKE_POSITION",
+	"NAME_INSULTING",
+	"NAME_NO_PERSON",
+	"NAME_NONSENSICAL_LETTERS",
+	"NAME_SENTENCE",
+	"NAMELOCK",
+	"NO_BANISHMENT",
+	"NO_LOGOUT_BLOCK",
+	"NO_STATISTICS",
+	"NOTATION",
+	"OPEN_NAMEDOORS",
+	"READ_GAMEMASTER_CHANNEL",
+	"READ_TUTOR_CHANNEL",
+	"RETRIEVE",
+	"SEND_BUGREPORTS",
+	"SHOW_COORDINATE",
+	"SHOW_KEYHOLE_NUMBERS",
+	"SPECIAL_MOVEUSE",
+	"SPOILING_AUCTION",
+	"STATEMENT_ADVERT_MONEY",
+	"STATEMENT_ADVERT_OFFTOPIC",
+	"STATEMENT_CHANNEL_OFFTOPIC",
+	"STATEMENT_INSULTING",
+	"STATEMENT_NON_ENGLISH",
+	"STATEMENT_REPORT",
+	"STATEMENT_SPAMMING",
+	"STATEMENT_VIOLATION_INCITING",
+	"TELEPORT_TO_CHARACTER",
+	"TELEPORT_TO_COORDINATE",
+	"TELEPORT_TO_MARK",
+	"TELEPORT_VERTICAL",
+	"UNLIMITED_CAPACITY",
+	"UNLIMITED_MANA",
+};
+
+STATIC_ASSERT(NARRAY(g_RightNames) == NUM_CHARACTER_RIGHTS);
+STATIC_ASSERT((RIGHTS_CACHE_SIZE & (RIGHTS_CACHE_SIZE - 1)) == 0);
+
+static TRightsCacheEntry g_RightsCache[RIGHTS_CACHE_SIZE];
+static int g_RightsDataVersion;
+static bool g_RightsLoaded;
+
+static int FindRight(const char *Name){
+	// NOTE(fusion): `g_RightNames` is kept sorted with the same case insensitive
+	// comparison so we can binary search it.
+	int Low = 0;
+	int High = NUM_CHARACTER_RIGHTS - 1;
+	while(Low <= High){
+		int Middle = Low + (High - Low) / 2;
+		int Cmp = StringCompareCI(Name, g_RightNames[Middle]);
+		if(Cmp < 0){
+			High = Middle - 1;
+		}else if(Cmp > 0){
+			Low = Middle + 1;
+		}else{
+			return Middle;
+		}
+	}
+	return -1;
+}
+
+bool InitRights(void){
+	// NOTE(fusion): `FindRight` relies on names being strictly ascending, which
+	// the compiler can't check for us. Since the `RIGHT_*` enum is sorted the
+	// same way, this also catches most names that went out of sync with it.
+	for(int i = 1; i < NUM_CHARACTER_RIGHTS; i += 1){
+		if(StringCompareCI(g_RightNames[i - 1], g_RightNames[i]) >= 0){
+			LOG_ERR("Right names \"%s\" and \"%s\" are out of order",
+					g_RightNames[i - 1], g_RightNames[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void InvalidateRightsCache(void){
+	memset(g_RightsCache, 0, sizeof(g_RightsCache));
+}
+
+static void CheckRightsCache(void){
+	int DataVersion;
+	if(!GetDataVersion(&DataVersion)){
+		InvalidateRightsCache();
+		g_RightsLoaded = false;
+		return;
+	}
+
+	if(!g_RightsLoaded || DataVersion != g_RightsDataVersion){
+		InvalidateRightsCache();
+	}
+
+	g_RightsDataVersion = DataVersion;
+	g_RightsLoaded = true;
+}
+
+static TRightsCacheEntry *LoadCharacterRights(int CharacterID){
+	CheckRightsCache();
+	TRightsCacheEntry *Entry = &g_RightsCache[(uint32)CharacterID & (RIGHTS_CACHE_SIZE - 1)];
+	if(!Entry->Valid || Entry->CharacterID != CharacterID){
+		DynamicArray<TCharacterRight> Names;
+		if(!GetCharacterRights(CharacterID, &Names)){
+			return NULL;
+		}
+
+		memset(Entry, 0, sizeof(TRightsCacheEntry));
+		for(int i = 0; i < Names.Length(); i += 1){
+			int Right = FindRight(Names[i].Name);
+			if(Right >= 0){
+				Entry->Rights.Words[Right / 64] |= ((uint64)1 << (Right % 64));
+			}else{
+				Entry->UnknownRights = true;
+			}
+		}
+
+		Entry->CharacterID = CharacterID;
+		Entry->Valid = true;
+	}
+	return Entry;
+}
+
+bool CheckCharacterRight(int CharacterID, int Right){
+	TRightsCacheEntry *Entry = LoadCharacterRights(CharacterID);
+	return Entry != NULL && RightSetHas(&Entry->Rights, Right);
+}
+
+bool GetCharacterRightNames(int CharacterID, TArena *Arena, DynamicArray<const char*> *Rights){
+	ASSERT(Arena != NULL && Rights != NULL);
+	TRightsCacheEntry *Entry = LoadCharacterRights(CharacterID);
+	if(Entry == NULL){
+		return false;
+	}
+
+	if(Entry->UnknownRights){
+		DynamicArray<TCharacterRight> Names;
+		if(!GetCharacterRights(CharacterID, &Names)){
+			return false;
+		}
+
+		Rights->Reserve(Rights->Length() + Names.Length());
+		for(int i = 0; i < Names.Length(); i += 1){
+			Rights->Push(ArenaStringCopy(Arena, Names[i].Name));
+		}
+		return true;
+	}
+
+	for(int Right = 0; Right < NUM_CHARACTER_RIGHTS; Right += 1){
+		if(RightSetHas(&Entry->Rights, Right)){
+			Rights->Push(g_RightNames[Right]);
+		}
+	}
+	return true;
+}
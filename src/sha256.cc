@@ -1,5 +1,15 @@
 #include "querymanager.hh"
 
+// NOTE(fusion): Number of messages hashed together by the multi-buffer kernel,
+// which is also the batch size used by `TestPasswordBatch`.
+#define SHA256_LANES 8
+
+#if (COMPILER_GCC || COMPILER_CLANG) && (defined(__x86_64__) || defined(__i386__))
+#	define SHA256_X86 1
+#	include <cpuid.h>
+#	include <immintrin.h>
+#endif
+
 static const uint32 SHA256IV[8] = {
 	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
 	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
@@ -29,7 +39,12 @@ static uint32 RotR32(uint32 Value, int N){
 	return (Value >> N) | (Value << (32 - N));
 }
 
-static void SHA256Compress(uint32 *H, const uint8 *Block){
+// NOTE(fusion): Compression kernels take any number of consecutive blocks so
+// hardware kernels can keep the state in registers across blocks. The kernel
+// is selected by `CheckSHA256` after it's verified against the test vectors.
+typedef void TSHA256Compress(uint32 *H, const uint8 *Blocks, int NumBlocks);
+
+static void SHA256CompressBlock(uint32 *H, const uint8 *Block){
 	uint32 W[64];
 
 	for(int i = 0; i < 16; i += 1){
@@ -73,29 +88,199 @@ static void SHA256Compress(uint32 *H, const uint8 *Block){
 	H[7] += Aux[7];
 }
 
-void SHA256(const uint8 *Input, int InputBytes, uint8 *Digest){
-	ASSERT(Input != NULL && InputBytes >= 0 && Digest != NULL);
-	uint32 H[8];
-	memcpy(H, SHA256IV, sizeof(uint32) * 8);
+static void SHA256CompressScalar(uint32 *H, const uint8 *Blocks, int NumBlocks){
+	for(int i = 0; i < NumBlocks; i += 1){
+		SHA256CompressBlock(H, &Blocks[i * 64]);
+	}
+}
 
-	const uint8 *InputPtr = Input;
-	int InputRem = InputBytes;
-	while(InputRem >= 64){
-		SHA256Compress(H, InputPtr);
-		InputPtr += 64;
-		InputRem -= 64;
+#if SHA256_X86
+// NOTE(fusion): SHA extensions kernel. The state is kept as ABEF/CDGH, which
+// is what `sha256rnds2` operates on, and each iteration of the inner loop does
+// four rounds while computing the message schedule four words ahead.
+__attribute__((target("sha,sse4.1,ssse3")))
+static void SHA256CompressSHANI(uint32 *H, const uint8 *Blocks, int NumBlocks){
+	const __m128i ByteSwap = _mm_set_epi64x(
+			0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+	__m128i Tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&H[0]), 0xB1);
+	__m128i State1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&H[4]), 0x1B);
+	__m128i State0 = _mm_alignr_epi8(Tmp, State1, 8);
+	State1 = _mm_blend_epi16(State1, Tmp, 0xF0);
+
+	for(int Block = 0; Block < NumBlocks; Block += 1){
+		const uint8 *Data = &Blocks[Block * 64];
+		__m128i SavedState0 = State0;
+		__m128i SavedState1 = State1;
+
+		__m128i Msg[4];
+		for(int i = 0; i < 4; i += 1){
+			Msg[i] = _mm_shuffle_epi8(
+					_mm_loadu_si128((const __m128i*)&Data[i * 16]), ByteSwap);
+		}
+
+		for(int i = 0; i < 16; i += 1){
+			__m128i Cur = _mm_add_epi32(Msg[i & 3],
+					_mm_loadu_si128((const __m128i*)&SHA256K[i * 4]));
+			State1 = _mm_sha256rnds2_epu32(State1, State0, Cur);
+			State0 = _mm_sha256rnds2_epu32(State0, State1,
+					_mm_shuffle_epi32(Cur, 0x0E));
+
+			if(i < 12){
+				__m128i Next = _mm_sha256msg1_epu32(Msg[i & 3], Msg[(i + 1) & 3]);
+				Next = _mm_add_epi32(Next,
+						_mm_alignr_epi8(Msg[(i + 3) & 3], Msg[(i + 2) & 3], 4));
+				Msg[i & 3] = _mm_sha256msg2_epu32(Next, Msg[(i + 3) & 3]);
+			}
+		}
+
+		State0 = _mm_add_epi32(State0, SavedState0);
+		State1 = _mm_add_epi32(State1, SavedState1);
 	}
 
-	ASSERT(InputRem < 64);
-	uint8 Block[64] = {};
-	memcpy(Block, InputPtr, InputRem);
-	BufferWrite8(&Block[InputRem], 0x80);
-	if(InputRem > 55){
-		SHA256Compress(H, Block);
-		memset(Block, 0, sizeof(Block));
+	Tmp = _mm_shuffle_epi32(State0, 0x1B);
+	State1 = _mm_shuffle_epi32(State1, 0xB1);
+	State0 = _mm_blend_epi16(Tmp, State1, 0xF0);
+	State1 = _mm_alignr_epi8(State1, Tmp, 8);
+	_mm_storeu_si128((__m128i*)&H[0], State0);
+	_mm_storeu_si128((__m128i*)&H[4], State1);
+}
+
+// NOTE(fusion): AVX2 multi-buffer kernel. It compresses one block from each
+// of 8 independent messages, with lane N of each vector belonging to message
+// N. The state is laid out as `H[Word][Lane]` and lanes not set in `Active`
+// are left untouched, which is how messages with different lengths share the
+// same batch.
+#define AVX2_ROTR(X, N) _mm256_or_si256(_mm256_srli_epi32(X, N), _mm256_slli_epi32(X, 32 - (N)))
+
+__attribute__((target("avx2")))
+static void SHA256CompressAVX2(uint32 (*H)[SHA256_LANES],
+		const uint8 *const *Blocks, const int *Active){
+	__m256i W[64];
+	for(int i = 0; i < 16; i += 1){
+		W[i] = _mm256_setr_epi32(
+				(int)BufferRead32BE(&Blocks[0][i * 4]),
+				(int)BufferRead32BE(&Blocks[1][i * 4]),
+				(int)BufferRead32BE(&Blocks[2][i * 4]),
+				(int)BufferRead32BE(&Blocks[3][i * 4]),
+				(int)BufferRead32BE(&Blocks[4][i * 4]),
+				(int)BufferRead32BE(&Blocks[5][i * 4]),
+				(int)BufferRead32BE(&Blocks[6][i * 4]),
+				(int)BufferRead32BE(&Blocks[7][i * 4]));
+	}
+
+	for(int i = 16; i < 64; i += 1){
+		__m256i S0 = _mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(W[i - 15], 7), AVX2_ROTR(W[i - 15], 18)),
+				_mm256_srli_epi32(W[i - 15], 3));
+		__m256i S1 = _mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(W[i - 2], 17), AVX2_ROTR(W[i - 2], 19)),
+				_mm256_srli_epi32(W[i - 2], 10));
+		W[i] = _mm256_add_epi32(_mm256_add_epi32(W[i - 16], S0),
+				_mm256_add_epi32(W[i - 7], S1));
+	}
+
+	__m256i Aux[8];
+	for(int i = 0; i < 8; i += 1){
+		Aux[i] = _mm256_loadu_si256((const __m256i*)H[i]);
 	}
-	BufferWrite64BE(&Block[56], ((uint64)InputBytes * 8));
-	SHA256Compress(H, Block);
+
+	for(int i = 0; i < 64; i += 1){
+		__m256i S1 = _mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(Aux[4], 6), AVX2_ROTR(Aux[4], 11)),
+				AVX2_ROTR(Aux[4], 25));
+		__m256i Ch = _mm256_xor_si256(_mm256_and_si256(Aux[4], Aux[5]),
+				_mm256_andnot_si256(Aux[4], Aux[6]));
+		__m256i T1 = _mm256_add_epi32(_mm256_add_epi32(Aux[7], S1),
+				_mm256_add_epi32(_mm256_add_epi32(Ch, W[i]),
+					_mm256_set1_epi32((int)SHA256K[i])));
+
+		__m256i S0 = _mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(Aux[0], 2), AVX2_ROTR(Aux[0], 13)),
+				AVX2_ROTR(Aux[0], 22));
+		__m256i Maj = _mm256_xor_si256(
+				_mm256_xor_si256(_mm256_and_si256(Aux[0], Aux[1]),
+					_mm256_and_si256(Aux[0], Aux[2])),
+				_mm256_and_si256(Aux[1], Aux[2]));
+		__m256i T2 = _mm256_add_epi32(S0, Maj);
+
+		Aux[7] = Aux[6];
+		Aux[6] = Aux[5];
+		Aux[5] = Aux[4];
+		Aux[4] = _mm256_add_epi32(Aux[3], T1);
+		Aux[3] = Aux[2];
+		Aux[2] = Aux[1];
+		Aux[1] = Aux[0];
+		Aux[0] = _mm256_add_epi32(T1, T2);
+	}
+
+	__m256i Mask = _mm256_loadu_si256((const __m256i*)Active);
+	for(int i = 0; i < 8; i += 1){
+		__m256i Old = _mm256_loadu_si256((const __m256i*)H[i]);
+		__m256i New = _mm256_add_epi32(Old, Aux[i]);
+		_mm256_storeu_si256((__m256i*)H[i], _mm256_blendv_epi8(Old, New, Mask));
+	}
+}
+
+static bool CPUSupportsSHANI(void){
+	uint32 Eax, Ebx, Ecx, Edx;
+	if(!__get_cpuid(1, &Eax, &Ebx, &Ecx, &Edx)
+			|| (Ecx & bit_SSSE3) == 0 || (Ecx & bit_SSE4_1) == 0){
+		return false;
+	}
+
+	if(!__get_cpuid_count(7, 0, &Eax, &Ebx, &Ecx, &Edx)){
+		return false;
+	}
+
+	return (Ebx & bit_SHA) != 0;
+}
+
+static bool CPUSupportsAVX2(void){
+	uint32 Eax, Ebx, Ecx, Edx;
+	if(!__get_cpuid(1, &Eax, &Ebx, &Ecx, &Edx)
+			|| (Ecx & bit_OSXSAVE) == 0 || (Ecx & bit_AVX) == 0){
+		return false;
+	}
+
+	// NOTE(fusion): Make sure the OS saves YMM registers on context switches.
+	uint32 XCR0Lo, XCR0Hi;
+	__asm__ volatile("xgetbv" : "=a"(XCR0Lo), "=d"(XCR0Hi) : "c"(0));
+	if((XCR0Lo & 0x06) != 0x06){
+		return false;
+	}
+
+	if(!__get_cpuid_count(7, 0, &Eax, &Ebx, &Ecx, &Edx)){
+		return false;
+	}
+
+	return (Ebx & bit_AVX2) != 0;
+}
+#endif //SHA256_X86
+
+static TSHA256Compress *g_SHA256Compress = SHA256CompressScalar;
+static const char *g_SHA256CompressName = "scalar";
+static bool g_SHA256BatchAVX2 = false;
+
+// NOTE(fusion): Hashes the rest of a message whose first `PrefixBytes` were
+// already compressed into `H`. The prefix MUST be a multiple of the block size.
+static void SHA256Finish(uint32 *H, const uint8 *Input,
+		int InputBytes, int PrefixBytes, uint8 *Digest){
+	ASSERT(Input != NULL && InputBytes >= 0 && Digest != NULL);
+	ASSERT(PrefixBytes >= 0 && (PrefixBytes % 64) == 0);
+	int NumBlocks = InputBytes / 64;
+	if(NumBlocks > 0){
+		g_SHA256Compress(H, Input, NumBlocks);
+	}
+
+	int InputRem = InputBytes - NumBlocks * 64;
+	ASSERT(InputRem < 64);
+	uint8 Tail[128] = {};
+	int TailBlocks = (InputRem > 55 ? 2 : 1);
+	memcpy(Tail, &Input[NumBlocks * 64], InputRem);
+	BufferWrite8(&Tail[InputRem], 0x80);
+	BufferWrite64BE(&Tail[TailBlocks * 64 - 8], ((uint64)(PrefixBytes + InputBytes) * 8));
+	g_SHA256Compress(H, Tail, TailBlocks);
 
 	BufferWrite32BE(&Digest[ 0], H[0]);
 	BufferWrite32BE(&Digest[ 4], H[1]);
@@ -107,60 +292,477 @@ void SHA256(const uint8 *Input, int InputBytes, uint8 *Digest){
 	BufferWrite32BE(&Digest[28], H[7]);
 }
 
-bool TestPassword(const uint8 *Auth, int AuthSize, const char *Password){
-	if(AuthSize != 64){
-		LOG_ERR("Expected 64 bytes of authentication data (got %d)", AuthSize);
-		return false;
+void SHA256(const uint8 *Input, int InputBytes, uint8 *Digest){
+	ASSERT(Input != NULL && InputBytes >= 0 && Digest != NULL);
+	uint32 H[8];
+	memcpy(H, SHA256IV, sizeof(uint32) * 8);
+	SHA256Finish(H, Input, InputBytes, 0, Digest);
+}
+
+#if SHA256_X86
+static void SHA256BatchAVX2(int Count, const uint8 *const *Inputs,
+		const int *InputBytes, uint8 *const *Digests){
+	ASSERT(Count > 0 && Count <= SHA256_LANES);
+
+	// NOTE(fusion): Full blocks are read straight from the inputs while the
+	// padded tail of each message is assembled here. Lanes without a message
+	// or that already finished are fed a dummy block and masked out.
+	static const uint8 Dummy[64] = {};
+	uint8 Tail[SHA256_LANES][128] = {};
+	int NumFullBlocks[SHA256_LANES] = {};
+	int NumBlocks[SHA256_LANES] = {};
+	int MaxBlocks = 0;
+	for(int Lane = 0; Lane < Count; Lane += 1){
+		ASSERT(Inputs[Lane] != NULL && InputBytes[Lane] >= 0 && Digests[Lane] != NULL);
+		int FullBlocks = InputBytes[Lane] / 64;
+		int InputRem = InputBytes[Lane] - FullBlocks * 64;
+		int TailBlocks = (InputRem > 55 ? 2 : 1);
+		memcpy(Tail[Lane], &Inputs[Lane][FullBlocks * 64], InputRem);
+		BufferWrite8(&Tail[Lane][InputRem], 0x80);
+		BufferWrite64BE(&Tail[Lane][TailBlocks * 64 - 8], ((uint64)InputBytes[Lane] * 8));
+		NumFullBlocks[Lane] = FullBlocks;
+		NumBlocks[Lane] = FullBlocks + TailBlocks;
+		MaxBlocks = std::max<int>(MaxBlocks, NumBlocks[Lane]);
 	}
 
-	// NOTE(fusion): Constant time comparison to check whether the authentication
-	// data is set. I'm considering all zeros to be NOT set.
-	bool IsSet = false;
-	for(int i = 0; i < AuthSize; i += 1){
-		if(Auth[i] != 0){
-			IsSet = true;
+	uint32 H[8][SHA256_LANES];
+	for(int i = 0; i < 8; i += 1){
+		for(int Lane = 0; Lane < SHA256_LANES; Lane += 1){
+			H[i][Lane] = SHA256IV[i];
 		}
 	}
 
-	if(!IsSet){
-		LOG_ERR("Authentication data not set");
-		return false;
+	for(int Block = 0; Block < MaxBlocks; Block += 1){
+		const uint8 *Blocks[SHA256_LANES];
+		int Active[SHA256_LANES];
+		for(int Lane = 0; Lane < SHA256_LANES; Lane += 1){
+			if(Block < NumFullBlocks[Lane]){
+				Blocks[Lane] = &Inputs[Lane][Block * 64];
+				Active[Lane] = -1;
+			}else if(Block < NumBlocks[Lane]){
+				Blocks[Lane] = &Tail[Lane][(Block - NumFullBlocks[Lane]) * 64];
+				Active[Lane] = -1;
+			}else{
+				Blocks[Lane] = Dummy;
+				Active[Lane] = 0;
+			}
+		}
+		SHA256CompressAVX2(H, Blocks, Active);
+	}
+
+	for(int Lane = 0; Lane < Count; Lane += 1){
+		for(int i = 0; i < 8; i += 1){
+			BufferWrite32BE(&Digests[Lane][i * 4], H[i][Lane]);
+		}
 	}
+}
+#endif //SHA256_X86
 
-	const uint8 *Hash = &Auth[ 0];
-	const uint8 *Salt = &Auth[32];
+void SHA256Batch(int Count, const uint8 *const *Inputs,
+		const int *InputBytes, uint8 *const *Digests){
+	ASSERT(Count >= 0 && Inputs != NULL && InputBytes != NULL && Digests != NULL);
+#if SHA256_X86
+	// NOTE(fusion): The multi-buffer kernel only pays off when there are no
+	// SHA extensions, which are faster even when hashing a single message.
+	if(g_SHA256BatchAVX2 && Count > 1){
+		for(int i = 0; i < Count; i += SHA256_LANES){
+			SHA256BatchAVX2(std::min<int>(Count - i, SHA256_LANES),
+					&Inputs[i], &InputBytes[i], &Digests[i]);
+		}
+		return;
+	}
+#endif
 
-	// TODO(fusion): It's probably not the best way to mix the salt but should
-	// be better than using plaintext or non-salted hashing schemes.
-	uint8 Digest[32];
-	SHA256((const uint8*)Password, (int)strlen(Password), Digest);
-	for(int i = 0; i < 32; i += 1){
-		Digest[i] ^= Salt[i];
+	for(int i = 0; i < Count; i += 1){
+		SHA256(Inputs[i], InputBytes[i], Digests[i]);
+	}
+}
+
+const char *SHA256KernelName(void){
+	return g_SHA256CompressName;
+}
+
+// NOTE(fusion): Compresses a single block for each of `Count` independent
+// states, skipping lanes not set in `Active`. This is what PBKDF2 iterations
+// boil down to so it's the only place they may use the multi-buffer kernel.
+static void SHA256CompressLanes(int Count, uint32 (*H)[8],
+		const uint8 *const *Blocks, const bool *Active){
+	ASSERT(Count > 0 && Count <= SHA256_LANES);
+#if SHA256_X86
+	if(g_SHA256BatchAVX2 && Count > 1){
+		static const uint8 Dummy[64] = {};
+		uint32 LaneH[8][SHA256_LANES] = {};
+		const uint8 *LaneBlocks[SHA256_LANES];
+		int LaneActive[SHA256_LANES];
+		for(int Lane = 0; Lane < SHA256_LANES; Lane += 1){
+			if(Lane < Count && Active[Lane]){
+				for(int i = 0; i < 8; i += 1){
+					LaneH[i][Lane] = H[Lane][i];
+				}
+				LaneBlocks[Lane] = Blocks[Lane];
+				LaneActive[Lane] = -1;
+			}else{
+				LaneBlocks[Lane] = Dummy;
+				LaneActive[Lane] = 0;
+			}
+		}
+
+		SHA256CompressAVX2(LaneH, LaneBlocks, LaneActive);
+		for(int Lane = 0; Lane < Count; Lane += 1){
+			if(Active[Lane]){
+				for(int i = 0; i < 8; i += 1){
+					H[Lane][i] = LaneH[i][Lane];
+				}
+			}
+		}
+		return;
+	}
+#endif
+
+	for(int Lane = 0; Lane < Count; Lane += 1){
+		if(Active[Lane]){
+			g_SHA256Compress(H[Lane], Blocks[Lane], 1);
+		}
+	}
+}
+
+// NOTE(fusion): PBKDF2-HMAC-SHA256 with a single output block, which is all we
+// need for 32 byte keys. The inner and outer HMAC states are computed once per
+// password so each iteration after the first is exactly two compressions, and
+// those are batched across passwords with `SHA256CompressLanes`.
+static void PBKDF2Batch(int Count, const char *const *Passwords,
+		const uint8 *const *Salts, const int *SaltBytes,
+		const int *Iterations, uint8 *const *Keys){
+	ASSERT(Count > 0 && Count <= SHA256_LANES);
+	uint32 Inner[SHA256_LANES][8];
+	uint32 Outer[SHA256_LANES][8];
+	uint8 InnerBlocks[SHA256_LANES][64] = {};
+	uint8 OuterBlocks[SHA256_LANES][64] = {};
+	int MaxIterations = 0;
+	for(int Lane = 0; Lane < Count; Lane += 1){
+		ASSERT(Passwords[Lane] != NULL && Salts[Lane] != NULL && Keys[Lane] != NULL);
+		ASSERT(SaltBytes[Lane] >= 0 && SaltBytes[Lane] <= 60 && Iterations[Lane] > 0);
+		uint8 Pad[64] = {};
+		int PasswordBytes = (int)strlen(Passwords[Lane]);
+		if(PasswordBytes > 64){
+			SHA256((const uint8*)Passwords[Lane], PasswordBytes, Pad);
+		}else{
+			memcpy(Pad, Passwords[Lane], PasswordBytes);
+		}
+
+		for(int i = 0; i < 64; i += 1){
+			Pad[i] ^= 0x36;
+		}
+		memcpy(Inner[Lane], SHA256IV, sizeof(uint32) * 8);
+		g_SHA256Compress(Inner[Lane], Pad, 1);
+
+		for(int i = 0; i < 64; i += 1){
+			Pad[i] ^= (0x36 ^ 0x5C);
+		}
+		memcpy(Outer[Lane], SHA256IV, sizeof(uint32) * 8);
+		g_SHA256Compress(Outer[Lane], Pad, 1);
+
+		// NOTE(fusion): The first iteration hashes the salt, which may have any
+		// length, so it's done here one password at a time.
+		uint8 Message[64];
+		uint8 U[32];
+		uint32 H[8];
+		memcpy(Message, Salts[Lane], SaltBytes[Lane]);
+		BufferWrite32BE(&Message[SaltBytes[Lane]], 1);
+		memcpy(H, Inner[Lane], sizeof(H));
+		SHA256Finish(H, Message, SaltBytes[Lane] + 4, 64, U);
+		memcpy(H, Outer[Lane], sizeof(H));
+		SHA256Finish(H, U, 32, 64, U);
+		memcpy(Keys[Lane], U, 32);
+
+		// NOTE(fusion): Every other iteration hashes the previous 32 byte digest
+		// after the 64 byte pad, so the padding of both blocks is fixed.
+		memcpy(InnerBlocks[Lane], U, 32);
+		BufferWrite8(&InnerBlocks[Lane][32], 0x80);
+		BufferWrite64BE(&InnerBlocks[Lane][56], (uint64)(64 + 32) * 8);
+		BufferWrite8(&OuterBlocks[Lane][32], 0x80);
+		BufferWrite64BE(&OuterBlocks[Lane][56], (uint64)(64 + 32) * 8);
+		MaxIterations = std::max<int>(MaxIterations, Iterations[Lane]);
 	}
-	SHA256(Digest, 32, Digest);
 
-	// NOTE(fusion): Constant time comparison.
+	const uint8 *InnerPtrs[SHA256_LANES];
+	const uint8 *OuterPtrs[SHA256_LANES];
+	for(int Lane = 0; Lane < Count; Lane += 1){
+		InnerPtrs[Lane] = InnerBlocks[Lane];
+		OuterPtrs[Lane] = OuterBlocks[Lane];
+	}
+
+	for(int Iteration = 2; Iteration <= MaxIterations; Iteration += 1){
+		uint32 H[SHA256_LANES][8];
+		bool Active[SHA256_LANES];
+		for(int Lane = 0; Lane < Count; Lane += 1){
+			Active[Lane] = (Iteration <= Iterations[Lane]);
+			memcpy(H[Lane], Inner[Lane], sizeof(H[Lane]));
+		}
+
+		SHA256CompressLanes(Count, H, InnerPtrs, Active);
+		for(int Lane = 0; Lane < Count; Lane += 1){
+			if(Active[Lane]){
+				for(int i = 0; i < 8; i += 1){
+					BufferWrite32BE(&OuterBlocks[Lane][i * 4], H[Lane][i]);
+				}
+				memcpy(H[Lane], Outer[Lane], sizeof(H[Lane]));
+			}
+		}
+
+		SHA256CompressLanes(Count, H, OuterPtrs, Active);
+		for(int Lane = 0; Lane < Count; Lane += 1){
+			if(Active[Lane]){
+				for(int i = 0; i < 8; i += 1){
+					BufferWrite32BE(&InnerBlocks[Lane][i * 4], H[Lane][i]);
+				}
+
+				for(int i = 0; i < 32; i += 1){
+					Keys[Lane][i] ^= InnerBlocks[Lane][i];
+				}
+			}
+		}
+	}
+}
+
+// NOTE(fusion): Iteration count used for new authentication data. It's picked
+// by `InitPasswordHashing` and never changes after that, so it's safe to read
+// from crypto threads.
+static int g_AuthIterations = AUTH_MIN_ITERATIONS;
+
+static bool ConstantTimeEq(const uint8 *A, const uint8 *B, int Size){
 	uint8 Result = 0;
-	for(int i = 0; i < 32; i += 1){
-		Result |= Digest[i] ^ Hash[i];
+	for(int i = 0; i < Size; i += 1){
+		Result |= A[i] ^ B[i];
 	}
 	return Result == 0;
 }
 
+static int GetAuthIterations(const uint8 *Auth, int AuthSize){
+	if(AuthSize != AUTH_SIZE || Auth[0] != AUTH_VERSION_PBKDF2){
+		return 0;
+	}
+
+	int Iterations = (int)BufferRead32BE(&Auth[4]);
+	if(Iterations < 1 || Iterations > AUTH_MAX_ITERATIONS){
+		return 0;
+	}
+
+	return Iterations;
+}
+
+static void TestLegacyAuthBatch(int Count, const uint8 *const *Auths,
+		const char *const *Passwords, bool *Results){
+	ASSERT(Count > 0 && Count <= SHA256_LANES);
+	uint8 Digests[SHA256_LANES][32];
+	uint8 *DigestPtrs[SHA256_LANES];
+	const uint8 *Inputs[SHA256_LANES];
+	int InputBytes[SHA256_LANES];
+	for(int i = 0; i < Count; i += 1){
+		DigestPtrs[i] = Digests[i];
+		Inputs[i] = (const uint8*)Passwords[i];
+		InputBytes[i] = (int)strlen(Passwords[i]);
+	}
+
+	// TODO(fusion): It's probably not the best way to mix the salt but should
+	// be better than using plaintext or non-salted hashing schemes.
+	SHA256Batch(Count, Inputs, InputBytes, DigestPtrs);
+	for(int i = 0; i < Count; i += 1){
+		const uint8 *Salt = &Auths[i][32];
+		for(int j = 0; j < 32; j += 1){
+			Digests[i][j] ^= Salt[j];
+		}
+		Inputs[i] = Digests[i];
+		InputBytes[i] = 32;
+	}
+	SHA256Batch(Count, Inputs, InputBytes, DigestPtrs);
+
+	for(int i = 0; i < Count; i += 1){
+		const uint8 *Auth = Auths[i];
+		const uint8 *Hash = &Auth[0];
+
+		// NOTE(fusion): Constant time comparison to check whether the
+		// authentication data is set. I'm considering all zeros to be NOT set.
+		bool IsSet = false;
+		for(int j = 0; j < AUTH_LEGACY_SIZE; j += 1){
+			if(Auth[j] != 0){
+				IsSet = true;
+			}
+		}
+
+		if(!IsSet){
+			LOG_ERR("Authentication data not set");
+		}
+
+		Results[i] = IsSet && ConstantTimeEq(Digests[i], Hash, 32);
+	}
+}
+
+static void TestPBKDF2AuthBatch(int Count, const uint8 *const *Auths,
+		const char *const *Passwords, bool *Results){
+	ASSERT(Count > 0 && Count <= SHA256_LANES);
+	uint8 Keys[SHA256_LANES][32];
+	uint8 *KeyPtrs[SHA256_LANES];
+	const uint8 *Salts[SHA256_LANES];
+	int SaltBytes[SHA256_LANES];
+	int Iterations[SHA256_LANES];
+	for(int i = 0; i < Count; i += 1){
+		KeyPtrs[i] = Keys[i];
+		Salts[i] = &Auths[i][8];
+		SaltBytes[i] = 32;
+		Iterations[i] = GetAuthIterations(Auths[i], AUTH_SIZE);
+	}
+
+	PBKDF2Batch(Count, Passwords, Salts, SaltBytes, Iterations, KeyPtrs);
+	for(int i = 0; i < Count; i += 1){
+		Results[i] = ConstantTimeEq(Keys[i], &Auths[i][40], 32);
+	}
+}
+
+bool TestPassword(const uint8 *Auth, int AuthSize, const char *Password){
+	bool Result = false;
+	TestPasswordBatch(1, &Auth, &AuthSize, &Password, &Result);
+	return Result;
+}
+
+void TestPasswordBatch(int Count, const uint8 *const *Auths, const int *AuthSizes,
+		const char *const *Passwords, bool *Results){
+	ASSERT(Count >= 0 && Auths != NULL && AuthSizes != NULL
+			&& Passwords != NULL && Results != NULL);
+
+	// NOTE(fusion): Each format is batched separately since their costs are
+	// nothing alike. Batches are flushed as soon as they fill up.
+	int Legacy[SHA256_LANES];
+	int PBKDF2[SHA256_LANES];
+	int NumLegacy = 0;
+	int NumPBKDF2 = 0;
+	for(int i = 0; i <= Count; i += 1){
+		if(i < Count){
+			Results[i] = false;
+			if(AuthSizes[i] == AUTH_LEGACY_SIZE){
+				Legacy[NumLegacy] = i;
+				NumLegacy += 1;
+			}else if(GetAuthIterations(Auths[i], AuthSizes[i]) > 0){
+				PBKDF2[NumPBKDF2] = i;
+				NumPBKDF2 += 1;
+			}else{
+				LOG_ERR("Invalid authentication data (%d bytes)", AuthSizes[i]);
+			}
+		}
+
+		if(NumLegacy > 0 && (NumLegacy == SHA256_LANES || i == Count)){
+			const uint8 *BatchAuths[SHA256_LANES];
+			const char *BatchPasswords[SHA256_LANES];
+			bool BatchResults[SHA256_LANES];
+			for(int j = 0; j < NumLegacy; j += 1){
+				BatchAuths[j] = Auths[Legacy[j]];
+				BatchPasswords[j] = Passwords[Legacy[j]];
+			}
+
+			TestLegacyAuthBatch(NumLegacy, BatchAuths, BatchPasswords, BatchResults);
+			for(int j = 0; j < NumLegacy; j += 1){
+				Results[Legacy[j]] = BatchResults[j];
+			}
+			NumLegacy = 0;
+		}
+
+		if(NumPBKDF2 > 0 && (NumPBKDF2 == SHA256_LANES || i == Count)){
+			const uint8 *BatchAuths[SHA256_LANES];
+			const char *BatchPasswords[SHA256_LANES];
+			bool BatchResults[SHA256_LANES];
+			for(int j = 0; j < NumPBKDF2; j += 1){
+				BatchAuths[j] = Auths[PBKDF2[j]];
+				BatchPasswords[j] = Passwords[PBKDF2[j]];
+			}
+
+			TestPBKDF2AuthBatch(NumPBKDF2, BatchAuths, BatchPasswords, BatchResults);
+			for(int j = 0; j < NumPBKDF2; j += 1){
+				Results[PBKDF2[j]] = BatchResults[j];
+			}
+			NumPBKDF2 = 0;
+		}
+	}
+}
+
 bool GenerateAuth(const char *Password, uint8 *Auth, int AuthSize){
-	if(AuthSize != 64){
-		LOG_ERR("Expected 64 bytes buffer for authentication data (got %d)", AuthSize);
+	if(AuthSize != AUTH_SIZE){
+		LOG_ERR("Expected %d bytes buffer for authentication data (got %d)",
+				AUTH_SIZE, AuthSize);
+		return false;
+	}
+
+	// NOTE(fusion): Version[1] Reserved[3] Iterations[4] Salt[32] Key[32].
+	memset(Auth, 0, AUTH_SIZE);
+	BufferWrite8(&Auth[0], AUTH_VERSION_PBKDF2);
+	BufferWrite32BE(&Auth[4], (uint32)g_AuthIterations);
+	CryptoRandom(&Auth[8], 32);
+
+	const uint8 *Salt = &Auth[8];
+	int SaltBytes = 32;
+	uint8 *Key = &Auth[40];
+	PBKDF2Batch(1, &Password, &Salt, &SaltBytes, &g_AuthIterations, &Key);
+	return true;
+}
+
+bool AuthNeedsRehash(const uint8 *Auth, int AuthSize){
+	// NOTE(fusion): The benchmark won't pick the exact same count on every
+	// startup so only data that is noticeably cheaper than the current setting
+	// is migrated.
+	int Iterations = GetAuthIterations(Auth, AuthSize);
+	return Iterations < (g_AuthIterations - g_AuthIterations / 4);
+}
+
+bool InitPasswordHashing(void){
+	if(g_PasswordHashIterations > 0){
+		g_AuthIterations = std::min<int>(
+				std::max<int>(g_PasswordHashIterations, AUTH_MIN_ITERATIONS),
+				AUTH_MAX_ITERATIONS);
+		LOG("Password hashing: %d iterations", g_AuthIterations);
+		return true;
+	}
+
+	if(g_PasswordHashTime <= 0){
+		LOG_ERR("Invalid password hash time %d", g_PasswordHashTime);
 		return false;
 	}
 
-	uint8 *Hash = &Auth[ 0];
-	uint8 *Salt = &Auth[32];
-	CryptoRandom(Salt, 32);
-	SHA256((const uint8*)Password, (int)strlen(Password), Hash);
-	for(int i = 0; i < 32; i += 1){
-		Hash[i] ^= Salt[i];
+	// NOTE(fusion): Without crypto threads passwords are hashed on the main
+	// thread, which stalls every other query while it's at it, so the target
+	// is capped to a few milliseconds in that case.
+	int HashTime = g_PasswordHashTime;
+	if(g_CryptoThreads <= 0 && HashTime > AUTH_MAX_INLINE_TIME){
+		LOG_WARN("Password hash time capped to %dms without crypto threads",
+				AUTH_MAX_INLINE_TIME);
+		HashTime = AUTH_MAX_INLINE_TIME;
 	}
-	SHA256(Hash, 32, Hash);
+
+	// NOTE(fusion): Measure how many iterations a single password goes through
+	// in a reasonable amount of time and scale it to the target. Batches may
+	// have better throughput but latency is what players notice.
+	const char *Password = "benchmark";
+	uint8 Salt[32] = {};
+	const uint8 *SaltPtr = Salt;
+	int SaltBytes = (int)sizeof(Salt);
+	int Iterations = 1000;
+	uint8 Key[32];
+	uint8 *KeyPtr = Key;
+	int64 Total = 0;
+	int64 Elapsed = 0;
+	int64 Start = GetClockMonotonicMS();
+	while(Elapsed < 100){
+		PBKDF2Batch(1, &Password, &SaltPtr, &SaltBytes, &Iterations, &KeyPtr);
+		Total += Iterations;
+		Elapsed = GetClockMonotonicMS() - Start;
+	}
+
+	int64 Target = (Total * HashTime) / Elapsed;
+	Target = (Target / 1000) * 1000;
+	g_AuthIterations = (int)std::min<int64>(
+			std::max<int64>(Target, AUTH_MIN_ITERATIONS),
+			AUTH_MAX_ITERATIONS);
+	LOG("Password hashing: %d iterations (~%dms per password, %d/s per thread)",
+			g_AuthIterations, (int)((Elapsed * g_AuthIterations) / Total),
+			(int)((Total * 1000) / (Elapsed * g_AuthIterations)));
 	return true;
 }
 
@@ -206,18 +808,135 @@ static int ParseHexString(uint8 *Buffer, int BufferSize, const char *String){
 	return NumBytes;
 }
 
+static bool RunSHA256Tests(const char *Kernel, bool Batch, int NumTests,
+		const uint8 *const *Inputs, const int *InputBytes, const uint8 (*Expected)[32]){
+	uint8 (*Digests)[32] = (uint8(*)[32])calloc(NumTests, 32);
+	uint8 **DigestPtrs = (uint8**)calloc(NumTests, sizeof(uint8*));
+	for(int i = 0; i < NumTests; i += 1){
+		DigestPtrs[i] = Digests[i];
+	}
+
+	if(Batch){
+		SHA256Batch(NumTests, Inputs, InputBytes, DigestPtrs);
+	}else{
+		for(int i = 0; i < NumTests; i += 1){
+			SHA256(Inputs[i], InputBytes[i], Digests[i]);
+		}
+	}
+
+	bool Result = true;
+	for(int i = 0; i < NumTests; i += 1){
+		if(memcmp(Expected[i], Digests[i], 32) != 0){
+			LOG_ERR("Test vector %d failed (%s kernel)", i, Kernel);
+			Result = false;
+		}
+	}
+
+	free(DigestPtrs);
+	free(Digests);
+	return Result;
+}
+
+static bool CheckPBKDF2(void){
+	// NOTE(fusion): Common PBKDF2-HMAC-SHA256 vectors plus a password longer
+	// than the block size. They're run one at a time and then all together with
+	// different iteration counts sharing the same batch.
+	struct{
+		const char *Password;
+		const char *Salt;
+		int Iterations;
+		const char *Expected;
+	} Tests[] = {
+		{
+			"password", "salt", 1,
+			"120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b",
+		},
+		{
+			"password", "salt", 2,
+			"ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43",
+		},
+		{
+			"password", "salt", 4096,
+			"c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a",
+		},
+		{
+			"passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+			"348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1",
+		},
+		{
+			"passwordPASSWORDpasswordPASSWORDpasswordPASSWORDpasswordPASSWORDpassword",
+			"salt", 2,
+			"ff414b42b279b70a5d3ddadeb002c5e83df81dd2d50fde5291cf04b7c37a9441",
+		},
+	};
+
+	constexpr int NumTests = NARRAY(Tests);
+	STATIC_ASSERT(NumTests <= SHA256_LANES);
+	const char *Passwords[NumTests];
+	const uint8 *Salts[NumTests];
+	int SaltBytes[NumTests];
+	int Iterations[NumTests];
+	uint8 Expected[NumTests][32];
+	uint8 Keys[NumTests][32];
+	uint8 *KeyPtrs[NumTests];
+	for(int i = 0; i < NumTests; i += 1){
+		Passwords[i] = Tests[i].Password;
+		Salts[i] = (const uint8*)Tests[i].Salt;
+		SaltBytes[i] = (int)strlen(Tests[i].Salt);
+		Iterations[i] = Tests[i].Iterations;
+		KeyPtrs[i] = Keys[i];
+		if(ParseHexString(Expected[i], sizeof(Expected[i]),
+				Tests[i].Expected) != sizeof(Expected[i])){
+			LOG_ERR("Invalid PBKDF2 test vector %d", i);
+			return false;
+		}
+	}
+
+	bool Result = true;
+	for(int i = 0; i < NumTests; i += 1){
+		PBKDF2Batch(1, &Passwords[i], &Salts[i], &SaltBytes[i], &Iterations[i], &KeyPtrs[i]);
+		if(memcmp(Expected[i], Keys[i], 32) != 0){
+			LOG_ERR("PBKDF2 test vector %d failed", i);
+			Result = false;
+		}
+	}
+
+	memset(Keys, 0, sizeof(Keys));
+	PBKDF2Batch(NumTests, Passwords, Salts, SaltBytes, Iterations, KeyPtrs);
+	for(int i = 0; i < NumTests; i += 1){
+		if(memcmp(Expected[i], Keys[i], 32) != 0){
+			LOG_ERR("PBKDF2 test vector %d failed (batch)", i);
+			Result = false;
+		}
+	}
+
+	return Result;
+}
+
 bool CheckSHA256(void){
-	// NOTE(fusion): We're using only a few NIST test vectors. This is to make
-	// sure there are no blatant implementation errors but we'd ideally run it
-	// against all of them to be sure.
+	// NOTE(fusion): NIST short message vectors, the FIPS 180-2 examples, and the
+	// NIST additional SHA-256 examples up to one million bytes, plus a few
+	// messages around block and padding boundaries. Every kernel is run against
+	// all of them and accelerated kernels that fail are not used.
+	//	The SHAVS long message set isn't embedded here, but the long additional
+	// examples go through the same multi-block paths. The 512MB+ ones are left
+	// out since this runs at startup.
 	struct{
 		const char *Input;
 		const char *Expected;
-	} Tests[] = {
+	} HexTests[] = {
 		{
 			"",
 			"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
 		},
+		{
+			"bd",
+			"68325720aabd7c82f30f554b313d0570c95accbb7dc4b5aae11204c08ffe732b",
+		},
+		{
+			"c98c8e55",
+			"7abc22c0ae5af26ce93dbb94433a0e0b2e119d014f8e7f65bd56c61ccccd9504",
+		},
 		{
 			"5738c929c4f4ccb6",
 			"963bb88f27f512777aab6c8b1a02c70ec0ad651d428f870036e1917120fb48bf",
@@ -242,23 +961,178 @@ bool CheckSHA256(void){
 		}
 	};
 
-	uint8 Input[64];
-	uint8 Expected[32];
-	uint8 Digest[32];
-	for(int i = 0; i < NARRAY(Tests); i += 1){
-		int InputBytes = ParseHexString(Input, sizeof(Input), Tests[i].Input);
-		int ExpectedBytes = ParseHexString(Expected, sizeof(Expected), Tests[i].Expected);
-		if(InputBytes == -1 || ExpectedBytes != sizeof(Expected)){
+	struct{
+		const char *Input;
+		int Repeat;
+		const char *Expected;
+	} TextTests[] = {
+		{
+			"abc", 1,
+			"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		},
+		{
+			"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+			"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+		},
+		{
+			"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+			"ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+			"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+		},
+		{
+			"a", 55,
+			"9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318",
+		},
+		{
+			"a", 56,
+			"b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a",
+		},
+		{
+			"a", 63,
+			"7d3e74a05d7db15bce4ad9ec0658ea98e3f06eeecf16b4c6fff2da457ddc2f34",
+		},
+		{
+			"a", 64,
+			"ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb",
+		},
+		{
+			"a", 65,
+			"635361c48bb9eab14198e76ea8ab7f1a41685d6ad62aa9146d301d4f17eb0ae0",
+		},
+		{
+			"a", 119,
+			"31eba51c313a5c08226adf18d4a359cfdfd8d2e816b13f4af952f7ea6584dcfb",
+		},
+		{
+			"a", 120,
+			"2f3d335432c70b580af0e8e1b3674a7c020d683aa5f73aaaedfdc55af904c21c",
+		},
+		{
+			"a", 1000000,
+			"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+		},
+	};
+
+	struct{
+		uint8 Byte;
+		int Repeat;
+		const char *Expected;
+	} ByteTests[] = {
+		{
+			0x00, 55,
+			"02779466cdec163811d078815c633f21901413081449002f24aa3e80f0b88ef7",
+		},
+		{
+			0x00, 56,
+			"d4817aa5497628e7c77e6b606107042bbba3130888c5f47a375e6179be789fbb",
+		},
+		{
+			0x00, 57,
+			"65a16cb7861335d5ace3c60718b5052e44660726da4cd13bb745381b235a1785",
+		},
+		{
+			0x00, 64,
+			"f5a5fd42d16a20302798ef6ed309979b43003d2320d9f0e8ea9831a92759fb4b",
+		},
+		{
+			0x00, 1000,
+			"541b3e9daa09b20bf85fa273e5cbd3e80185aa4ec298e765db87742b70138a53",
+		},
+		{
+			0x41, 1000,
+			"c2e686823489ced2017f6059b8b239318b6364f6dcd835d0a519105a1eadd6e4",
+		},
+		{
+			0x55, 1005,
+			"f4d62ddec0f3dd90ea1380fa16a5ff8dc4c54b21740650f24afc4120903552b0",
+		},
+		{
+			0x00, 1000000,
+			"d29751f2649b32ff572b5e0a9f541ea660a50f94ff0beedfb0b692b924cc8025",
+		},
+	};
+
+	constexpr int NumTests = NARRAY(HexTests) + NARRAY(TextTests) + NARRAY(ByteTests);
+	uint8 *Inputs[NumTests] = {};
+	int InputBytes[NumTests] = {};
+	uint8 Expected[NumTests][32] = {};
+	bool Result = true;
+	for(int i = 0; i < NARRAY(HexTests) && Result; i += 1){
+		Inputs[i] = (uint8*)malloc(64);
+		InputBytes[i] = ParseHexString(Inputs[i], 64, HexTests[i].Input);
+		if(InputBytes[i] == -1 || ParseHexString(Expected[i],
+				sizeof(Expected[i]), HexTests[i].Expected) != sizeof(Expected[i])){
 			LOG_ERR("Invalid test vector %d", i);
-			return false;
+			Result = false;
 		}
+	}
 
-		SHA256(Input, InputBytes, Digest);
-		if(memcmp(Expected, Digest, 32) != 0){
-			LOG_ERR("Test vector %d failed", i);
-			return false;
+	for(int i = 0; i < NARRAY(TextTests) && Result; i += 1){
+		int Index = NARRAY(HexTests) + i;
+		int Length = (int)strlen(TextTests[i].Input);
+		InputBytes[Index] = Length * TextTests[i].Repeat;
+		Inputs[Index] = (uint8*)malloc(std::max<int>(InputBytes[Index], 1));
+		for(int j = 0; j < TextTests[i].Repeat; j += 1){
+			memcpy(&Inputs[Index][j * Length], TextTests[i].Input, Length);
+		}
+
+		if(ParseHexString(Expected[Index], sizeof(Expected[Index]),
+				TextTests[i].Expected) != sizeof(Expected[Index])){
+			LOG_ERR("Invalid test vector %d", Index);
+			Result = false;
 		}
 	}
 
-	return true;
+	for(int i = 0; i < NARRAY(ByteTests) && Result; i += 1){
+		int Index = NARRAY(HexTests) + NARRAY(TextTests) + i;
+		InputBytes[Index] = ByteTests[i].Repeat;
+		Inputs[Index] = (uint8*)malloc(InputBytes[Index]);
+		memset(Inputs[Index], ByteTests[i].Byte, InputBytes[Index]);
+		if(ParseHexString(Expected[Index], sizeof(Expected[Index]),
+				ByteTests[i].Expected) != sizeof(Expected[Index])){
+			LOG_ERR("Invalid test vector %d", Index);
+			Result = false;
+		}
+	}
+
+	// NOTE(fusion): The scalar kernel is the fallback for everything else so
+	// it must always pass.
+	if(Result){
+		g_SHA256Compress = SHA256CompressScalar;
+		g_SHA256CompressName = "scalar";
+		g_SHA256BatchAVX2 = false;
+		Result = RunSHA256Tests("scalar", false, NumTests, Inputs, InputBytes, Expected)
+			&& RunSHA256Tests("scalar", true, NumTests, Inputs, InputBytes, Expected);
+	}
+
+#if SHA256_X86
+	if(Result && CPUSupportsSHANI()){
+		g_SHA256Compress = SHA256CompressSHANI;
+		g_SHA256CompressName = "sha-ni";
+		if(!RunSHA256Tests("sha-ni", false, NumTests, Inputs, InputBytes, Expected)){
+			g_SHA256Compress = SHA256CompressScalar;
+			g_SHA256CompressName = "scalar";
+		}
+	}
+
+	if(Result && g_SHA256Compress == SHA256CompressScalar && CPUSupportsAVX2()){
+		g_SHA256BatchAVX2 = true;
+		g_SHA256CompressName = "scalar+avx2";
+		if(!RunSHA256Tests("avx2", true, NumTests, Inputs, InputBytes, Expected)){
+			g_SHA256BatchAVX2 = false;
+			g_SHA256CompressName = "scalar";
+		}
+	}
+#endif
+
+	for(int i = 0; i < NumTests; i += 1){
+		free(Inputs[i]);
+	}
+
+	if(Result){
+		LOG("SHA256 kernel: %s", g_SHA256CompressName);
+		Result = CheckPBKDF2();
+	}
+
+	return Result;
 }
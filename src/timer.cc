@@ -0,0 +1,136 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): Hierarchical timer wheel with millisecond resolution. Level N
+// has `TIMER_WHEEL_SLOTS` slots, each covering `TIMER_WHEEL_SLOTS ^ N` ms, so
+// four levels will cover a little over four and a half hours. Timers further
+// away are parked in the last level and re-inserted when it's cascaded. Timers
+// move down one level at a time as the wheel advances and are only ever looked
+// at when their slot comes up, so advancing the wheel is O(expired) plus a few
+// slot checks per millisecond.
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE ((int64)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+TTimerWheel g_TimerWheel;
+
+static void LinkTimer(TTimerWheel *Wheel, TTimer *Timer, bool Cascading){
+	ASSERT(Timer->Prev == NULL);
+	// NOTE(fusion): Cascading happens right before the current slot is processed
+	// so timers that are due may still go into it. Otherwise, the current slot
+	// was already processed (or is being processed) and anything that is due
+	// should go into the next one.
+	int64 MinDelta = (Cascading ? 0 : 1);
+	int64 Expire = Timer->Expire;
+	int64 Delta = Expire - Wheel->CurrentTime;
+	if(Delta < MinDelta){
+		Expire = Wheel->CurrentTime + MinDelta;
+		Delta = MinDelta;
+	}else if(Delta >= TIMER_WHEEL_RANGE){
+		Expire = Wheel->CurrentTime + TIMER_WHEEL_RANGE - 1;
+		Delta = TIMER_WHEEL_RANGE - 1;
+	}
+
+	int Level = 0;
+	while(Delta >= ((int64)1 << (TIMER_WHEEL_BITS * (Level + 1)))){
+		Level += 1;
+	}
+
+	int Slot = (int)((Expire >> (TIMER_WHEEL_BITS * Level)) & TIMER_WHEEL_MASK);
+	TTimer **Head = &Wheel->Slots[Level][Slot];
+	Timer->Next = *Head;
+	Timer->Prev = Head;
+	if(Timer->Next != NULL){
+		Timer->Next->Prev = &Timer->Next;
+	}
+	*Head = Timer;
+}
+
+static void UnlinkTimer(TTimer *Timer){
+	ASSERT(Timer->Prev != NULL);
+	*Timer->Prev = Timer->Next;
+	if(Timer->Next != NULL){
+		Timer->Next->Prev = Timer->Prev;
+	}
+	Timer->Next = NULL;
+	Timer->Prev = NULL;
+}
+
+static void CascadeTimers(TTimerWheel *Wheel, int Level, int Slot){
+	TTimer *List = Wheel->Slots[Level][Slot];
+	Wheel->Slots[Level][Slot] = NULL;
+	while(List != NULL){
+		TTimer *Timer = List;
+		List = List->Next;
+		Timer->Next = NULL;
+		Timer->Prev = NULL;
+		LinkTimer(Wheel, Timer, true);
+	}
+}
+
+void InitTimerWheel(TTimerWheel *Wheel, int64 Time){
+	memset(Wheel, 0, sizeof(TTimerWheel));
+	Wheel->CurrentTime = Time;
+}
+
+void InitTimer(TTimer *Timer, TTimerCallback *Callback, void *Data){
+	memset(Timer, 0, sizeof(TTimer));
+	Timer->Callback = Callback;
+	Timer->Data = Data;
+}
+
+bool TimerScheduled(const TTimer *Timer){
+	return Timer->Wheel != NULL;
+}
+
+void ScheduleTimer(TTimerWheel *Wheel, TTimer *Timer, int64 Expire){
+	ASSERT(Timer->Callback != NULL);
+	CancelTimer(Timer);
+	Timer->Wheel = Wheel;
+	Timer->Expire = Expire;
+	LinkTimer(Wheel, Timer, false);
+	Wheel->NumTimers += 1;
+}
+
+void CancelTimer(TTimer *Timer){
+	if(Timer->Wheel != NULL){
+		UnlinkTimer(Timer);
+		Timer->Wheel->NumTimers -= 1;
+		Timer->Wheel = NULL;
+	}
+}
+
+void AdvanceTimerWheel(TTimerWheel *Wheel, int64 Time){
+	while(Wheel->CurrentTime < Time){
+		if(Wheel->NumTimers == 0){
+			Wheel->CurrentTime = Time;
+			break;
+		}
+
+		Wheel->CurrentTime += 1;
+		int64 Current = Wheel->CurrentTime;
+
+		// NOTE(fusion): Move timers down from upper levels whenever the level
+		// below it wraps around.
+		for(int Level = 1; Level < TIMER_WHEEL_LEVELS; Level += 1){
+			int64 LowerMask = ((int64)1 << (TIMER_WHEEL_BITS * Level)) - 1;
+			if((Current & LowerMask) != 0){
+				break;
+			}
+
+			int Slot = (int)((Current >> (TIMER_WHEEL_BITS * Level)) & TIMER_WHEEL_MASK);
+			CascadeTimers(Wheel, Level, Slot);
+		}
+
+		// NOTE(fusion): Callbacks are free to schedule or cancel any timers,
+		// including the one being fired, so we always restart from the head.
+		TTimer **Head = &Wheel->Slots[0][Current & TIMER_WHEEL_MASK];
+		while(*Head != NULL){
+			TTimer *Timer = *Head;
+			CancelTimer(Timer);
+			if(Timer->Expire > Current){
+				ScheduleTimer(Wheel, Timer, Timer->Expire);
+			}else{
+				Timer->Callback(Timer);
+			}
+		}
+	}
+}
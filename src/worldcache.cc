@@ -0,0 +1,219 @@
+#include "querymanager.hh"
+
+// NOTE(fusion): The `Worlds` table has a handful of rows that rarely change,
+// but world ids are looked up by name on most web and game server queries, so
+// the whole table is kept in memory. It's loaded at startup and reloaded when
+// the database's `data_version` changes, when a world sets a new online record,
+// when a transaction that set one is rolled back, or when the config is
+// reloaded.
+//	Host names are resolved when worlds are loaded, and again whenever they're
+// older than `HostNameExpireTime`, so world configs and character endpoints
+// don't need to go through the host cache every time.
+struct TWorldEntry{
+	TWorldRecord Record;
+	bool Resolved;
+	int IPAddress;
+	int ResolveTime;
+};
+
+static TWorldEntry *g_Worlds;
+static int g_NumWorlds;
+static int g_WorldCacheDataVersion;
+static bool g_WorldCacheLoaded;
+static bool g_WorldCacheModified;
+
+static void ResolveWorldHost(TWorldEntry *World){
+	World->Resolved = !StringEmpty(World->Record.Host)
+			&& ResolveHostName(World->Record.Host, &World->IPAddress);
+	World->ResolveTime = g_MonotonicTimeMS;
+	if(!World->Resolved){
+		LOG_ERR("Failed to resolve world \"%s\" host name \"%s\"",
+				World->Record.Name, World->Record.Host);
+	}
+}
+
+static bool LoadWorldCache(void){
+	DynamicArray<TWorldRecord> Records;
+	if(!GetWorldRecords(&Records)){
+		return false;
+	}
+
+	TWorldEntry *Worlds = NULL;
+	if(Records.Length() > 0){
+		Worlds = (TWorldEntry*)calloc((usize)Records.Length(), sizeof(TWorldEntry));
+		if(Worlds == NULL){
+			PANIC("Failed to allocate world cache with %d worlds", Records.Length());
+			return false;
+		}
+	}
+
+	for(int i = 0; i < Records.Length(); i += 1){
+		Worlds[i].Record = Records[i];
+		ResolveWorldHost(&Worlds[i]);
+	}
+
+	free(g_Worlds);
+	g_Worlds = Worlds;
+	g_NumWorlds = Records.Length();
+	return true;
+}
+
+static bool CheckWorldCache(void){
+	int DataVersion;
+	if(!GetDataVersion(&DataVersion)){
+		return g_WorldCacheLoaded;
+	}
+
+	if(!g_WorldCacheLoaded || DataVersion != g_WorldCacheDataVersion){
+		if(!LoadWorldCache()){
+			LOG_ERR("Failed to load world cache");
+			g_WorldCacheLoaded = false;
+			return false;
+		}
+
+		g_WorldCacheDataVersion = DataVersion;
+		g_WorldCacheLoaded = true;
+	}
+
+	return true;
+}
+
+static TWorldEntry *FindWorld(int WorldID){
+	if(!CheckWorldCache()){
+		return NULL;
+	}
+
+	for(int i = 0; i < g_NumWorlds; i += 1){
+		if(g_Worlds[i].Record.WorldID == WorldID){
+			return &g_Worlds[i];
+		}
+	}
+	return NULL;
+}
+
+static bool GetWorldAddress(TWorldEntry *World, int *IPAddress){
+	if((g_MonotonicTimeMS - World->ResolveTime) >= g_HostNameExpireTime){
+		ResolveWorldHost(World);
+	}
+
+	if(World->Resolved){
+		*IPAddress = World->IPAddress;
+	}
+	return World->Resolved;
+}
+
+bool InitWorldCache(void){
+	if(!CheckWorldCache()){
+		return false;
+	}
+
+	LOG("Worlds: %d", g_NumWorlds);
+	return true;
+}
+
+void ExitWorldCache(void){
+	free(g_Worlds);
+	g_Worlds = NULL;
+	g_NumWorlds = 0;
+	g_WorldCacheLoaded = false;
+}
+
+void InvalidateWorldCache(void){
+	g_WorldCacheLoaded = false;
+	InvalidateResponseCache();
+}
+
+void InvalidateWorldOnlineRecord(void){
+	g_WorldCacheModified = true;
+	InvalidateWorldCache();
+}
+
+void MarkWorldCache(void){
+	g_WorldCacheModified = false;
+}
+
+void RollbackWorldCache(void){
+	// NOTE(fusion): Online records are the only world fields written by us so
+	// the cache can only have picked up uncommitted values if one was set.
+	if(g_WorldCacheModified){
+		InvalidateWorldCache();
+	}
+	g_WorldCacheModified = false;
+}
+
+int GetWorldID(const char *WorldName){
+	ASSERT(WorldName != NULL);
+	if(CheckWorldCache()){
+		for(int i = 0; i < g_NumWorlds; i += 1){
+			if(StringEqCI(g_Worlds[i].Record.Name, WorldName)){
+				return g_Worlds[i].Record.WorldID;
+			}
+		}
+	}
+	return 0;
+}
+
+bool GetWorlds(DynamicArray<TWorld> *Worlds){
+	ASSERT(Worlds != NULL);
+	if(!CheckWorldCache()){
+		return false;
+	}
+
+	// NOTE(fusion): `NumPlayers` comes from the in-memory online lists.
+	Worlds->Reserve(Worlds->Length() + g_NumWorlds);
+	for(int i = 0; i < g_NumWorlds; i += 1){
+		const TWorldRecord *Record = &g_Worlds[i].Record;
+		TWorld World = {};
+		World.WorldID = Record->WorldID;
+		memcpy(World.Name, Record->Name, sizeof(World.Name));
+		World.Type = Record->Type;
+		World.NumPlayers = GetOnlineCharacterCount(Record->WorldID);
+		World.MaxPlayers = Record->MaxPlayers;
+		World.OnlineRecord = Record->OnlineRecord;
+		World.OnlineRecordTimestamp = Record->OnlineRecordTimestamp;
+		Worlds->Push(World);
+	}
+	return true;
+}
+
+bool GetWorldConfig(int WorldID, TWorldConfig *WorldConfig){
+	ASSERT(WorldConfig != NULL);
+	TWorldEntry *World = FindWorld(WorldID);
+	if(World == NULL){
+		LOG_ERR("World %d not found", WorldID);
+		return false;
+	}
+
+	int IPAddress;
+	if(!GetWorldAddress(World, &IPAddress)){
+		return false;
+	}
+
+	WorldConfig->Type					= World->Record.Type;
+	WorldConfig->RebootTime				= World->Record.RebootTime;
+	WorldConfig->IPAddress				= IPAddress;
+	WorldConfig->Port					= World->Record.Port;
+	WorldConfig->MaxPlayers				= World->Record.MaxPlayers;
+	WorldConfig->PremiumPlayerBuffer	= World->Record.PremiumPlayerBuffer;
+	WorldConfig->MaxNewbies				= World->Record.MaxNewbies;
+	WorldConfig->PremiumNewbieBuffer	= World->Record.PremiumNewbieBuffer;
+	return true;
+}
+
+bool GetWorldEndpoint(int WorldID, int *IPAddress, int *Port){
+	ASSERT(IPAddress != NULL && Port != NULL);
+	TWorldEntry *World = FindWorld(WorldID);
+	if(World == NULL || !GetWorldAddress(World, IPAddress)){
+		return false;
+	}
+
+	*Port = World->Record.Port;
+	return true;
+}
+
+int GetWorldOnlineRecord(int WorldID){
+	// NOTE(fusion): Returns -1 if the world isn't known so the caller always
+	// goes through the database.
+	TWorldEntry *World = FindWorld(WorldID);
+	return (World != NULL ? World->Record.OnlineRecord : -1);
+}